@@ -0,0 +1,203 @@
+#include <tll/channel.h>
+#include <tll/logger.h>
+#include <tll/util/argparse.h>
+#include <tll/util/bench.h>
+#include <tll/util/conv.h>
+
+#include <chrono>
+#include <vector>
+
+#include <unistd.h>
+
+template <typename R, typename... Args>
+[[nodiscard]]
+R fail(R err, tll::logger::format_string<Args...> format, Args && ... args)
+{
+	fmt::print(format, std::forward<Args>(args)...);
+	return err;
+}
+
+using namespace std::chrono;
+
+struct Echo
+{
+	tll::Channel * server = nullptr;
+	size_t count = 0;
+
+	int callback(const tll::Channel *, const tll_msg_t *msg)
+	{
+		if (msg->type != TLL_MESSAGE_DATA)
+			return 0;
+		count++;
+		return server->post(msg);
+	}
+};
+
+struct Counter
+{
+	size_t count = 0;
+
+	int callback(const tll::Channel *, const tll_msg_t *msg)
+	{
+		if (msg->type == TLL_MESSAGE_DATA)
+			count++;
+		return 0;
+	}
+};
+
+tll::Channel * last_child(tll::Channel * c)
+{
+	tll::Channel * r = nullptr;
+	for (auto ptr = c->children(); ptr; ptr = ptr->next)
+		r = static_cast<tll::Channel *>(ptr->channel);
+	return r;
+}
+
+int run(tll::channel::Context &ctx, const std::string &path, unsigned frames, unsigned count, unsigned batch, unsigned msgsize)
+{
+	auto url = fmt::format("tcp://{};frame=std;process-frames={};sndbuf=1mb;rcvbuf=1mb;buffer-size=1mb", path, frames);
+	auto s = ctx.channel(fmt::format("{};mode=server;name=server", url));
+	auto c = ctx.channel(fmt::format("{};mode=client;name=client", url));
+	if (!s || !c)
+		return fail(1, "Failed to create channels\n");
+
+	Echo echo = { s.get() };
+	Counter counter;
+	s->callback_add(&echo, TLL_MESSAGE_MASK_DATA);
+	c->callback_add(&counter, TLL_MESSAGE_MASK_DATA);
+
+	if (s->open())
+		return fail(1, "Failed to open server\n");
+	if (c->open())
+		return fail(1, "Failed to open client\n");
+
+	tll::Channel * socket = nullptr;
+	for (auto i = 0; i < 1000 && (c->state() != tll::state::Active || socket == nullptr); i++) {
+		c->process();
+		for (auto ptr = s->children(); ptr; ptr = ptr->next)
+			static_cast<tll::Channel *>(ptr->channel)->process();
+		if (auto child = last_child(s.get()); child != static_cast<tll::Channel *>(s->children()->channel))
+			socket = child;
+	}
+	if (c->state() != tll::state::Active || !socket)
+		return fail(1, "Failed to establish connection\n");
+
+	std::vector<char> data(msgsize);
+	tll_msg_t msg = { TLL_MESSAGE_DATA };
+	msg.data = data.data();
+	msg.size = data.size();
+
+	size_t calls = 0;
+	auto start = steady_clock::now();
+	for (auto i = 0u; i < count; i += batch) {
+		for (auto j = 0u; j < batch; j++) {
+			msg.seq = i + j;
+			if (c->post(&msg))
+				return fail(1, "Failed to post message {}\n", msg.seq);
+		}
+		auto end = counter.count + batch;
+		while (counter.count < end) {
+			socket->process();
+			c->process();
+			calls += 2;
+		}
+	}
+	nanoseconds dt = steady_clock::now() - start;
+
+	fmt::print("Time process-frames={}: {:.3}/{}: {}, {:.1f} process calls per batch of {}\n", frames,
+		duration<double, std::milli>(dt), counter.count, dt / counter.count, (double) calls * batch / counter.count, batch);
+
+	c->close();
+	s->close();
+	return 0;
+}
+
+int run_connect(tll::channel::Context &ctx, const std::string &path, unsigned cache, unsigned count)
+{
+	auto url = fmt::format("tcp://{};frame=std", path);
+	auto s = ctx.channel(fmt::format("{};mode=server;name=server;socket-cache={}", url, cache));
+	auto c = ctx.channel(fmt::format("{};mode=client;name=client", url));
+	if (!s || !c)
+		return fail(1, "Failed to create channels\n");
+
+	if (s->open())
+		return fail(1, "Failed to open server\n");
+	auto listen = static_cast<tll::Channel *>(s->children()->channel);
+
+	auto start = steady_clock::now();
+	for (auto i = 0u; i < count; i++) {
+		if (c->open())
+			return fail(1, "Failed to open client\n");
+		for (auto j = 0; j < 1000 && c->state() != tll::state::Active; j++)
+			c->process();
+		if (c->state() != tll::state::Active)
+			return fail(1, "Failed to establish connection {}\n", i);
+		listen->process();
+		auto socket = last_child(s.get());
+		if (socket == listen)
+			return fail(1, "Connection {} is not accepted\n", i);
+		c->close();
+		for (auto j = 0; j < 1000 && socket->state() == tll::state::Active; j++)
+			socket->process();
+		s->process(); // Cleanup closed socket
+	}
+	nanoseconds dt = steady_clock::now() - start;
+
+	fmt::print("Connect socket-cache={}: {:.3}/{}: {}\n", cache, duration<double, std::milli>(dt), count, dt / count);
+
+	s->close();
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	tll::Logger::set("tll", tll::Logger::Warning, true);
+
+	tll::util::ArgumentParser parser("[--frames=N]");
+
+	std::vector<std::string> frames;
+	unsigned count = 1000000;
+	unsigned batch = 1000;
+	unsigned msgsize = 50;
+	unsigned connect = 0;
+
+	parser.add_argument({"-f", "--frames"}, "process-frames parameter, can be specified several times", &frames);
+	parser.add_argument({"-C", "--count"}, "number of messages", &count);
+	parser.add_argument({"-b", "--batch"}, "number of messages posted before waiting for echo", &batch);
+	parser.add_argument({"--msgsize"}, "message size", &msgsize);
+	parser.add_argument({"--connect"}, "number of connections in connection rate test, 0 to disable", &connect);
+	auto pr = parser.parse(argc, argv);
+	if (!pr) {
+		fmt::print("Invalid arguments: {}\nRun '{} --help' for more information\n", pr.error(), argv[0]);
+		return 1;
+	} else if (parser.help) {
+		fmt::print("Usage {} {}\n", argv[0], parser.format_help());
+		return 1;
+	}
+
+	if (frames.empty())
+		frames = {"1", "16", "256"};
+	if (batch == 0 || msgsize == 0)
+		return fail(1, "Batch and message size must be non-zero\n");
+
+	auto ctx = tll::channel::Context(tll::Config());
+	auto path = fmt::format("/tmp/tll-bench-tcp.{}.sock", getpid());
+
+	tll::bench::prewarm(100ms);
+	if (connect) {
+		for (auto cache : {0u, 16u}) {
+			if (auto r = run_connect(ctx, path, cache, connect); r)
+				return r;
+		}
+	}
+
+	for (auto & f : frames) {
+		auto v = tll::conv::to_any<unsigned>(f);
+		if (!v || *v == 0)
+			return fail(1, "Invalid frames value '{}'\n", f);
+		if (auto r = run(ctx, path, *v, count, batch, msgsize); r)
+			return r;
+	}
+
+	return 0;
+}
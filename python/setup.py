@@ -6,7 +6,7 @@ from Cython.Distutils import build_ext
 
 setup( name = 'tll'
      , packages = ['tll', 'tll.channel', 'tll.processor', 'tll.templates']
-     , scripts = ['tll-pyprocessor', 'tll-schemegen', 'tll-resolve-browse']
+     , scripts = ['tll-pyprocessor', 'tll-schemegen', 'tll-resolve-browse', 'tll-lz4-dict']
      , include_dirs = ["../src"]
      , cmdclass = {'build_ext': build_ext}
      , ext_modules =
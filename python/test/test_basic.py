@@ -533,6 +533,70 @@ class TestUdpNone(_test_udp_base):
     CLEANUP = ['./test.sock']
     FRAME = []
 
+@pytest.mark.skipif(sys.platform != 'linux', reason='Batch recv and send not supported')
+class TestUdpBatch(_test_udp_base):
+    PROTO = 'udp://::1:{};batch=4;timestamping=yes'.format(ports.UDP6)
+
+@pytest.mark.skipif(sys.platform != 'linux', reason='Batch recv and send not supported')
+def test_udp_batch(tmp_path):
+    s = Accum(f'udp://{tmp_path}/udp.sock;batch=8', mode='server', name='server-batch', stat='yes', context=ctx)
+    c = Accum(f'udp://{tmp_path}/udp.sock;batch=4', mode='client', name='client-batch', stat='yes', context=ctx)
+
+    s.open()
+    c.open()
+
+    spoll = select.poll()
+    spoll.register(s.fd, select.POLLIN)
+
+    for i in range(3):
+        c.post(b'x' * (i + 1), seq=i, flags=c.PostFlags.More)
+    assert c.dcaps & c.DCaps.Pending
+    assert spoll.poll(0) == []
+
+    c.post(b'x' * 4, seq=3, flags=c.PostFlags.More) # Batch is full
+    c.post(b'x' * 5, seq=4, flags=c.PostFlags.More)
+    c.post(b'x' * 6, seq=5)
+    assert not c.dcaps & c.DCaps.Pending
+
+    assert spoll.poll(10) != []
+    s.process()
+    assert [(m.seq, m.data.tobytes()) for m in s.result] == [(i, b'x' * (i + 1)) for i in range(6)]
+
+    stat = [x for x in ctx.stat_list if x.name == 'client-batch'][0]
+    assert [(f.name, f.count, f.sum, f.min, f.max) for f in stat.swap() if f.name == 'txbatch'] == [('txbatch', 2, 6, 2, 4)]
+    stat = [x for x in ctx.stat_list if x.name == 'server-batch'][0]
+    assert [(f.name, f.count, f.sum) for f in stat.swap() if f.name == 'rxbatch'] == [('rxbatch', 1, 6)]
+
+@pytest.mark.skipif(sys.platform != 'linux', reason='Network timestamping not supported')
+def test_udp_latency():
+    url = f'udp://::1:{ports.UDP6};timestamping=yes;timestamping-tx=yes;stat=yes'
+    s = Accum(url, mode='server', name='server-latency', context=ctx)
+    c = Accum(url, mode='client', name='client-latency', context=ctx)
+
+    s.open()
+    c.open()
+
+    spoll = select.poll()
+    spoll.register(s.fd, select.POLLIN)
+    cpoll = select.poll()
+    cpoll.register(c.fd, select.POLLIN)
+
+    c.post(b'xxx', seq=10)
+    if c.result == []:
+        assert cpoll.poll(10) != []
+        c.process()
+    assert [(m.type, m.seq) for m in c.result] == [(c.Type.Control, 10)]
+
+    assert spoll.poll(10) != []
+    s.process()
+    assert [m.seq for m in s.result] == [10]
+
+    for name, field in [('server-latency', 'rxlat'), ('client-latency', 'txlat')]:
+        stat = [x for x in ctx.stat_list if x.name == name][0]
+        lat = [f for f in stat.swap() if f.name == field][0]
+        assert lat.count == 1
+        assert 0 < lat.min < 1000000000
+
 @pytest.mark.skipif(sys.platform != 'linux', reason='Network timestamping not supported')
 class TestUdpTS(_test_udp_base):
     PROTO = 'udp://::1:{};timestamping=yes;timestamping-tx=yes'.format(ports.UDP6)
@@ -565,6 +629,24 @@ def test_lz4():
     c.post(b'xxx')
     assert s.state == s.State.Error
 
+def test_lz4_dict(tmp_path):
+    d = b'market data dictionary ' * 10
+    (tmp_path / 'lz4.dict').write_bytes(d)
+
+    s = Accum('lz4+direct://', name='server', context=ctx, dict=str(tmp_path / 'lz4.dict'))
+    c = Accum('direct://', name='client', master=s, context=ctx)
+
+    s.open()
+    c.open()
+
+    for i in range(3):
+        s.post(b'market data dictionary %d' % i, seq=i)
+    assert [lz4.block.decompress(m.data.tobytes(), uncompressed_size=1024, dict=d) for m in c.result] == [b'market data dictionary %d' % i for i in range(3)]
+    assert len(c.result[-1].data) < len(lz4.block.compress(b'market data dictionary 2', store_size=False))
+
+    c.post(lz4.block.compress(b'market data dictionary yyy', store_size=False, dict=d), seq=21)
+    assert [(m.data.tobytes(), m.seq) for m in s.result] == [(b'market data dictionary yyy', 21)]
+
 def test_lz4_block():
     s = Accum('lz4b+direct://;dump=frame;direct.dump=yes', name='server', context=ctx)
     c = Accum('direct://', name='client', master=s, context=ctx)
@@ -0,0 +1,183 @@
+#!/usr/bin/env python3
+# vim: sts=4 sw=4 et
+
+import pytest
+import struct
+import time
+
+from tll.channel import Context
+from tll.error import TLLError
+from tll.test_util import Accum
+
+SCHEME = '''yamls://
+- name: Trade
+  id: 10
+  fields:
+    - {name: price, type: double}
+    - {name: size, type: int64}
+    - {name: side, type: uint8}
+- name: Quote
+  id: 20
+  fields:
+    - {name: bid, type: double}
+    - {name: ask, type: double}
+    - {name: name, type: byte8, options.type: string}
+- name: Pointer
+  id: 30
+  fields:
+    - {name: list, type: '*int32'}
+'''
+
+@pytest.fixture
+def context():
+    return Context()
+
+def generate(count):
+    for i in range(count):
+        if i % 3:
+            yield 'Trade', {'price': 100 + i, 'size': i * 10, 'side': i % 2}
+        else:
+            yield 'Quote', {'bid': 100 + i - 0.5, 'ask': 100 + i + 0.5, 'name': f'q{i}'}
+
+@pytest.mark.parametrize("compression", ['none', 'lz4'])
+def test_basic(context, tmp_path, compression):
+    w = context.Channel(f'column+file://{tmp_path}/column.dat', name='writer', dir='w', scheme=SCHEME, **{'chunk-rows': '100', 'column-compression': compression, 'stat': 'yes'})
+    w.open()
+
+    data = list(generate(1000))
+    for i, (name, body) in enumerate(data):
+        w.post(body, name=name, seq=i)
+
+    with pytest.raises(TLLError):
+        w.post({'list': [1, 2, 3]}, name='Pointer', seq=1000)
+    with pytest.raises(TLLError):
+        w.post({}, name='Trade', seq=10)
+    with pytest.raises(TLLError):
+        w.post(b'x' * 64, msgid=10, seq=1000) # Larger then scheme size
+
+    w.close()
+
+    f = Accum(f'file://{tmp_path}/column.dat', name='file', context=context)
+    f.open()
+    for _ in range(20):
+        f.process()
+    assert [m.seq for m in f.result] == list(range(99, 1000, 100))
+    f.close()
+
+    r = Accum(f'column+file://{tmp_path}/column.dat', name='reader', context=context, autoclose='no')
+    r.open()
+    for _ in range(20):
+        r.children[0].process()
+    assert [(m.seq, r.unpack(m).SCHEME.name, r.unpack(m).as_dict()) for m in r.result if m.type == m.Type.Data] == [(i, n, b) for i, (n, b) in enumerate(data)]
+    r.close()
+
+    r.result = []
+    r.open(seq='550')
+    for _ in range(20):
+        r.children[0].process()
+    assert [m.seq for m in r.result if m.type == m.Type.Data] == list(range(550, 1000))
+    r.close()
+
+def test_chunk_timeout(context, tmp_path):
+    w = context.Channel(f'column+file://{tmp_path}/column.dat', name='writer', dir='w', scheme=SCHEME, **{'chunk-rows': '100', 'chunk-timeout': '10ms'})
+    w.open()
+    assert [c.name for c in w.children] == ['writer/column', 'writer/timer']
+
+    data = list(generate(10))
+    for i, (name, body) in enumerate(data):
+        w.post(body, name=name, seq=i)
+
+    r = Accum(f'column+file://{tmp_path}/column.dat', name='reader', context=context, autoclose='no')
+    r.open()
+    r.children[0].process()
+    assert [m for m in r.result if m.type == m.Type.Data] == []
+
+    time.sleep(0.02)
+    w.children[-1].process()
+
+    for _ in range(5):
+        r.children[0].process()
+    assert [(m.seq, r.unpack(m).SCHEME.name, r.unpack(m).as_dict()) for m in r.result if m.type == m.Type.Data] == [(i, n, b) for i, (n, b) in enumerate(data)]
+
+def test_project(context, tmp_path):
+    w = context.Channel(f'column+file://{tmp_path}/column.dat', name='writer', dir='w', scheme=SCHEME, **{'chunk-rows': '100'})
+    w.open()
+    data = list(generate(1000))
+    for i, (name, body) in enumerate(data):
+        w.post(body, name=name, seq=i)
+    w.close()
+
+    r = Accum(f'column+file://{tmp_path}/column.dat', name='reader', context=context, autoclose='no', fields='price,bid')
+    r.open()
+    for _ in range(20):
+        r.children[0].process()
+    result = [(m.seq, r.unpack(m).as_dict()) for m in r.result if m.type == m.Type.Data]
+    assert result[:3] == [(0, {'bid': 99.5, 'ask': 0., 'name': ''}), (1, {'price': 101., 'size': 0, 'side': 0}), (2, {'price': 102., 'size': 0, 'side': 0})]
+    assert len(result) == 1000
+
+def test_filter(context, tmp_path):
+    w = context.Channel(f'column+file://{tmp_path}/column.dat', name='writer', dir='w', scheme=SCHEME, **{'chunk-rows': '100'})
+    w.open()
+    data = list(generate(1000))
+    for i, (name, body) in enumerate(data):
+        w.post(body, name=name, seq=i)
+    w.close()
+
+    r = Accum(f'column+file://{tmp_path}/column.dat', name='reader', context=context, autoclose='no', stat='yes',
+              fields='size', filter='price', **{'filter-min': '450', 'filter-max': '560'})
+    r.open()
+    for _ in range(20):
+        r.children[0].process()
+    assert [(m.seq, r.unpack(m).as_dict()) for m in r.result if m.type == m.Type.Data] == [(i, {'price': 100. + i, 'size': i * 10, 'side': 0}) for i in range(350, 461) if i % 3]
+
+    s = [x for x in context.stat_list if x.name == 'reader'][0]
+    assert {f.name: f.value for f in s.swap() if f.name in ('chunk', 'skip')} == {'chunk': 10, 'skip': 8}
+
+    r = context.Channel(f'column+file://{tmp_path}/column.dat', name='missing', filter='missing')
+    r.open()
+    assert r.state == r.State.Error
+
+def chunk_columns(data):
+    magic, version, columns, rows = struct.unpack_from('<IHHI', data, 0)
+    offset = 12
+    for _ in range(columns):
+        msgid, field, compression, stat, rows, size, raw = struct.unpack_from('<ihBBIII', data, offset)
+        yield offset, (msgid, field, rows, size)
+        offset += 40 + size
+
+@pytest.mark.parametrize("corrupt", ['msgid', 'rows', 'size'])
+def test_corrupt(context, tmp_path, corrupt):
+    w = context.Channel(f'column+file://{tmp_path}/column.dat', name='writer', dir='w', scheme=SCHEME, **{'chunk-rows': '30', 'column-compression': 'none'})
+    w.open()
+    for i, (name, body) in enumerate(generate(30)):
+        w.post(body, name=name, seq=i)
+    w.close()
+
+    f = Accum(f'file://{tmp_path}/column.dat', name='file', context=context)
+    f.open()
+    f.process()
+    chunk = bytearray(f.result[0].data.tobytes())
+    f.close()
+
+    columns = dict((k, v) for v, k in chunk_columns(chunk))
+    if corrupt == 'msgid': # First message is Quote, make it Trade so Trade columns are too short
+        offset = [o for (msgid, field, rows, size), o in columns.items() if field == -2][0] + 40
+        assert struct.unpack_from('<i', chunk, offset) == (20,)
+        struct.pack_into('<i', chunk, offset, 10)
+    elif corrupt == 'rows': # Trade price column has less rows then other Trade columns
+        offset = [o for (msgid, field, rows, size), o in columns.items() if (msgid, field) == (10, 0)][0]
+        rows, size = struct.unpack_from('<II', chunk, offset + 8)
+        struct.pack_into('<III', chunk, offset + 8, rows - 1, size, size - 8)
+    elif corrupt == 'size': # Stored size is less then raw size for uncompressed column
+        offset = [o for (msgid, field, rows, size), o in columns.items() if (msgid, field) == (10, 0)][0]
+        rows, size = struct.unpack_from('<II', chunk, offset + 8)
+        struct.pack_into('<II', chunk, offset + 12, size - 8, size)
+        del chunk[offset + 40 + size - 8:offset + 40 + size]
+
+    master = context.Channel('direct://', name='master', scheme=SCHEME)
+    r = Accum('column+direct://', name='reader', master=master, scheme=SCHEME, context=context)
+    master.open()
+    r.open()
+    master.post(bytes(chunk), seq=29)
+    assert r.state == r.State.Error
+    assert [m for m in r.result if m.type == m.Type.Data] == []
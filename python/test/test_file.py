@@ -5,6 +5,7 @@ import collections
 import os
 import random
 import struct
+import time
 
 import pytest
 
@@ -88,7 +89,7 @@ def test_basic(writer, reader, filename):
     assert reader.dcaps == reader.DCaps.Process | reader.DCaps.Pending
 
     assert reader.scheme_control is not None
-    assert [m.name for m in reader.scheme_control.messages] == ['Seek', 'EndOfData']
+    assert [m.name for m in reader.scheme_control.messages] == ['Seek', 'EndOfData', 'Lookup']
 
     assert reader.config['info.seq-begin'] == '0'
     assert reader.config['info.seq'] == '1'
@@ -409,6 +410,233 @@ def test_compress(context, filename, io, compress):
             assert [(m.msgid, m.seq) for m in reader.result[-1:]] == [(i + 10, i)]
             assert reader.result[-1].data.tobytes() == data * (i % 7 + 1)
 
+@pytest.mark.parametrize("io", ['posix', 'mmap'])
+@pytest.mark.parametrize("compress", ['none', 'lz4'])
+def test_readahead(context, filename, io, compress):
+    writer = Accum(f'file://{filename}', name='writer', dump='frame', context=context, dir='w', block='4kb', compression=compress, io=io)
+    reader = Accum(f'file://{filename}', name='reader', dump='frame', context=context, autoclose='no', io=io, readahead='4')
+
+    data = bytes(range(0, 0x100))
+    writer.open()
+    for i in range(200):
+        writer.post(data * (i % 5 + 1), seq=i, msgid=i % 7)
+
+    reader.open()
+    time.sleep(0.05) # Give helper thread time to decode first blocks
+    for i in range(200):
+        reader.process()
+        assert [(m.msgid, m.seq) for m in reader.result[-1:]] == [(i % 7, i)]
+        assert reader.result[-1].data.tobytes() == data * (i % 5 + 1)
+    reader.process()
+    assert reader.result[-1].type == reader.Type.Control
+
+    for i in range(200, 300):
+        writer.post(data * (i % 5 + 1), seq=i, msgid=i % 7)
+
+    time.sleep(0.05)
+    for i in range(200, 300):
+        reader.process()
+        assert [(m.msgid, m.seq) for m in reader.result[-1:]] == [(i % 7, i)]
+        assert reader.result[-1].data.tobytes() == data * (i % 5 + 1)
+
+    for oseq in range(0, 300, 37):
+        reader.post(b'', type=reader.Type.Control, name='Seek', seq=oseq)
+        reader.result = []
+        for i in range(oseq, 300):
+            reader.process()
+            assert [(m.msgid, m.seq) for m in reader.result[-1:]] == [(i % 7, i)]
+            assert reader.result[-1].data.tobytes() == data * (i % 5 + 1)
+
+@pytest.mark.parametrize("io", ['posix', 'mmap'])
+def test_lz4_dict(context, tmp_path, io):
+    rand = random.Random(0)
+    templates = [bytes(rand.randrange(256) for _ in range(200)) for _ in range(8)]
+    data = [templates[i % 8] + struct.pack('=qq', i, i * 100) for i in range(200)]
+    dictfile = tmp_path / 'lz4.dict'
+    dictfile.write_bytes(b''.join(templates))
+
+    for d, fn in [(False, tmp_path / 'plain.dat'), (True, tmp_path / 'dict.dat')]:
+        kw = {'dict': str(dictfile)} if d else {}
+        w = context.Channel(f'file://{fn}', name='writer', dir='w', block='4kb', compression='lz4', io=io, **kw)
+        w.open()
+        for i, body in enumerate(data[:100]):
+            w.post(body, seq=i, msgid=i % 3)
+        w.close()
+
+        # Reopen and append, encoder is initialized with dictionary from meta
+        w = context.Channel(f'file://{fn}', name='writer', dir='w', block='4kb', compression='lz4', io=io)
+        w.open()
+        for i, body in enumerate(data[100:], 100):
+            w.post(body, seq=i, msgid=i % 3)
+        w.close()
+
+    # Dictionary is stored in meta, compare only data size
+    assert (tmp_path / 'plain.dat').stat().st_size > (tmp_path / 'dict.dat').stat().st_size - len(dictfile.read_bytes())
+
+    for readahead in ['0', '2']:
+        reader = Accum(f'file://{tmp_path / "dict.dat"}', name='reader', context=context, autoclose='no', io=io, readahead=readahead)
+        reader.open()
+        time.sleep(0.05)
+        for i in range(200):
+            reader.process()
+            assert [(m.msgid, m.seq) for m in reader.result[-1:]] == [(i % 3, i)]
+            assert reader.result[-1].data.tobytes() == data[i]
+
+        for oseq in range(0, 200, 37):
+            reader.post(b'', type=reader.Type.Control, name='Seek', seq=oseq)
+            reader.result = []
+            reader.process()
+            assert [(m.msgid, m.seq, m.data.tobytes()) for m in reader.result] == [(oseq % 3, oseq, data[oseq])]
+        reader.close()
+
+def test_lz4_dict_meta(context, filename, tmp_path):
+    w = context.Channel(f'file://{filename}', name='writer', dir='w', compression='lz4')
+    w.open()
+    w.close()
+    assert filename.stat().st_size == META_SIZE # No dictionary, old meta layout
+
+    dictfile = tmp_path / 'lz4.dict'
+    dictfile.write_bytes(b'x' * 100)
+    w = context.Channel(f'file://{filename}', name='writer', dir='w', compression='lz4', dict=str(dictfile))
+    w.open(overwrite='yes')
+    w.close()
+    assert filename.stat().st_size == META_SIZE + 8 + 100 # Dictionary field and data
+
+    with pytest.raises(TLLError): context.Channel(f'file://{filename}', name='none', dir='w', dict=str(dictfile))
+    with pytest.raises(TLLError): context.Channel(f'file://{filename}', name='missing', dir='w', compression='lz4', dict=str(tmp_path / 'missing'))
+
+@pytest.mark.parametrize("readahead", ['0', '2'])
+@pytest.mark.parametrize("compress", ['none', 'lz4'])
+def test_block_cache(context, filename, compress, readahead):
+    writer = context.Channel(f'file://{filename}', name='writer', dir='w', block='4kb', compression=compress)
+    writer.open()
+
+    rand = random.Random(0)
+    data = [bytes(rand.randrange(256) for _ in range(64 * (i % 3 + 1))) for i in range(150)]
+    for i in range(100):
+        writer.post(data[i], seq=i, msgid=i % 7)
+
+    def stat(name):
+        s = [x for x in context.stat_list if x.name == name][0]
+        return {f.name: f.value for f in s.swap() if f.name in ('chit', 'cmiss')}
+
+    r0 = Accum(f'file://{filename}', name='r0', context=context, autoclose='no', stat='yes', readahead=readahead, **{'block-cache': '1mb'})
+    r0.open()
+    time.sleep(0.05)
+    for i in range(100):
+        r0.process()
+        assert [(m.msgid, m.seq, m.data.tobytes()) for m in r0.result[-1:]] == [(i % 7, i, data[i])]
+    r0.process()
+    assert r0.result[-1].type == r0.Type.Control
+
+    blocks = filename.stat().st_size // 4096 # Last block is not finished and is read inline
+    assert stat('r0') == {'chit': 0, 'cmiss': blocks}
+
+    r1 = Accum(f'file://{filename}', name='r1', context=context, autoclose='no', stat='yes', readahead=readahead, **{'block-cache': '1mb'})
+    r1.open(seq='35')
+    time.sleep(0.05)
+    for i in range(35, 100):
+        r1.process()
+        assert [(m.msgid, m.seq, m.data.tobytes()) for m in r1.result[-1:]] == [(i % 7, i, data[i])]
+    r1.process()
+    assert r1.result[-1].type == r1.Type.Control
+
+    s = stat('r1')
+    assert s['cmiss'] == 0
+    assert s['chit'] > 0
+
+    # Append data, finished tail block is added to cache
+    for i in range(100, 150):
+        writer.post(data[i], seq=i, msgid=i % 7)
+    for r in (r0, r1):
+        r.result = []
+        for i in range(100, 150):
+            r.process()
+            assert [(m.msgid, m.seq, m.data.tobytes()) for m in r.result[-1:]] == [(i % 7, i, data[i])]
+
+    for oseq in range(0, 150, 37):
+        r1.post(b'', type=r1.Type.Control, name='Seek', seq=oseq)
+        r1.result = []
+        for i in range(oseq, 150):
+            r1.process()
+            assert [(m.msgid, m.seq, m.data.tobytes()) for m in r1.result[-1:]] == [(i % 7, i, data[i])]
+
+    # Cache is released when last reader is closed
+    r0.close()
+    r1.close()
+    stat('r0')
+    r0.open()
+    time.sleep(0.05)
+    for i in range(100):
+        r0.process()
+    assert stat('r0')['chit'] == 0
+
+def test_block_cache_replace(context, filename):
+    def write(data):
+        if filename.exists():
+            filename.unlink()
+        w = context.Channel(f'file://{filename}', name='writer', dir='w', block='4kb')
+        w.open()
+        for i in range(100):
+            w.post(data, seq=i)
+        w.close()
+        return os.stat(filename).st_ino
+
+    def read():
+        r = Accum(f'file://{filename}', name='reader', context=context, autoclose='no', **{'block-cache': '1mb'})
+        r.open()
+        for _ in range(100):
+            r.process()
+        r.close()
+        return set(m.data.tobytes() for m in r.result)
+
+    ino = write(b'a' * 128)
+    assert read() == {b'a' * 128}
+
+    time.sleep(0.05)
+    # Removed file inode is usually reused by next created file
+    if write(b'b' * 128) != ino:
+        pytest.skip("Inode is not reused")
+    assert read() == {b'b' * 128}
+
+@pytest.mark.parametrize("cache", ['0b', '1mb'])
+@pytest.mark.parametrize("compress", ['none', 'lz4'])
+def test_lookup(context, filename, compress, cache):
+    writer = context.Channel(f'file://{filename}', name='writer', dir='w', block='4kb', compression=compress)
+    writer.open()
+
+    rand = random.Random(0)
+    data = [bytes(rand.randrange(256) for _ in range(64 * (i % 3 + 1))) for i in range(200)]
+    for i in range(0, 200, 2): # Only even seqs
+        writer.post(data[i], seq=i, msgid=i % 7)
+
+    reader = Accum(f'file://{filename}', name='reader', context=context, autoclose='no', **{'block-cache': cache})
+    reader.open()
+    for i in range(10):
+        reader.process()
+    assert [m.seq for m in reader.result] == list(range(0, 20, 2))
+
+    reader.result = []
+    for seq in [190, 0, 2, 100, 198, 102, 50]:
+        reader.post(b'', type=reader.Type.Control, name='Lookup', seq=seq, addr=seq + 1000)
+        assert [(m.type, m.msgid, m.seq, m.addr, m.data.tobytes()) for m in reader.result] == [(reader.Type.Data, seq % 7, seq, seq + 1000, data[seq])]
+        reader.result = []
+
+    for seq in [1, 99, 199, 200, -1]:
+        with pytest.raises(TLLError):
+            reader.post(b'', type=reader.Type.Control, name='Lookup', seq=seq)
+        assert reader.result == []
+
+    # Sequential position is not changed
+    reader.process()
+    assert [m.seq for m in reader.result] == [20]
+
+    # Lookup in unfinished tail block
+    writer.post(data[1], seq=201, msgid=1)
+    reader.result = []
+    reader.post(b'', type=reader.Type.Control, name='Lookup', seq=201)
+    assert [(m.seq, m.data.tobytes()) for m in reader.result] == [(201, data[1])]
+
 def test_skip_frame_trim(context, filename):
     writer = Accum(f'file://{filename}', name='writer', dump='frame', context=context, dir='w', block='1kb', io='posix')
     writer.open()
@@ -0,0 +1,136 @@
+#!/usr/bin/env python3
+# vim: sts=4 sw=4 et
+
+import tll.channel as C
+from tll.channel.prefix import Prefix
+from tll.error import TLLError
+from tll.test_util import Accum, ports
+
+import pytest
+import socket
+import time
+
+class Drop(Prefix):
+    PROTO = 'drop+'
+
+    def _init(self, url, master=None):
+        super()._init(url, master)
+        self._every = int(url.get('drop-every', '0'))
+
+    def _open(self, props):
+        self._posted = 0
+        super()._open(props)
+
+    def _post(self, msg, flags):
+        if msg.type == msg.Type.Data and msg.msgid != -1 and self._every:
+            self._posted += 1
+            if self._posted % self._every == 0:
+                return
+        super()._post(msg, flags)
+
+@pytest.fixture
+def context():
+    ctx = C.Context()
+    ctx.register(Drop)
+    return ctx
+
+def process(*channels):
+    for c in channels:
+        c.process()
+        process(*c.children)
+
+def create(context, tmp_path, sub_kw=None, **kw):
+    sub_kw = dict(sub_kw or {})
+    url = f'rmcast+udp://127.0.0.1:{ports.UDP4}'
+    recovery = f'tcp://{tmp_path}/recovery.sock'
+    pub = Accum(f'rmcast+drop+udp://127.0.0.1:{ports.UDP4}', mode='client', name='pub', recovery=recovery, stat='yes', context=context, **kw)
+    sub = Accum(url, mode='server', name='sub', recovery=sub_kw.pop('recovery', recovery), stat='yes', context=context, **sub_kw)
+
+    pub.open()
+    sub.open()
+
+    recovery = sub.children[-1]
+    assert recovery.name == 'sub/recovery'
+    for _ in range(100):
+        if recovery.state == recovery.State.Active:
+            break
+        process(pub, sub)
+    assert recovery.state == recovery.State.Active
+    return pub, sub
+
+def stat(context, name, fields):
+    s = [x for x in context.stat_list if x.name == name][0]
+    return {f.name: f.value if hasattr(f, 'value') else f.count for f in s.swap() if f.name in fields}
+
+def test_recovery(context, tmp_path):
+    pub, sub = create(context, tmp_path, **{'drop-every': '3'})
+
+    for i in range(10):
+        pub.post(b'data' * i, seq=i, msgid=10 + i)
+
+    for _ in range(100):
+        if len(sub.result) == 10:
+            break
+        process(pub, sub)
+
+    assert [(m.seq, m.msgid, m.data.tobytes()) for m in sub.result] == [(i, 10 + i, b'data' * i) for i in range(10)]
+
+    assert stat(context, 'sub', ['gap', 'lost', 'request', 'retrans', 'recover']) == {'gap': 3, 'lost': 0, 'request': 3, 'retrans': 3, 'recover': 3}
+    assert stat(context, 'pub', ['request', 'retrans']) == {'request': 3, 'retrans': 3}
+
+def test_lost(context, tmp_path):
+    pub, sub = create(context, tmp_path, **{'drop-every': '10', 'size': '1kb'})
+
+    for i in range(31):
+        pub.post(b'x' * 100, seq=i)
+
+    for _ in range(200):
+        if sub.result and sub.result[-1].seq == 30:
+            break
+        process(pub, sub)
+
+    assert [m.seq for m in sub.result] == [i for i in range(31) if i not in (9, 19)]
+    assert stat(context, 'sub', ['gap', 'lost']) == {'gap': 3, 'lost': 2}
+
+def test_heartbeat(context, tmp_path):
+    pub, sub = create(context, tmp_path, heartbeat='10ms', **{'drop-every': '5'})
+
+    for i in range(5):
+        pub.post(b'data', seq=i)
+
+    for _ in range(100):
+        if len(sub.result) == 5:
+            break
+        process(pub, sub)
+        time.sleep(0.005)
+
+    assert [m.seq for m in sub.result] == list(range(5))
+    assert stat(context, 'sub', ['gap', 'lost', 'request', 'retrans']) == {'gap': 1, 'lost': 0, 'request': 1, 'retrans': 1}
+
+def test_request_timeout(context, tmp_path):
+    # Requests are sent to listening socket that never replies
+    silent = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    silent.bind(str(tmp_path / 'silent.sock'))
+    silent.listen(1)
+    pub, sub = create(context, tmp_path, sub_kw={'request-timeout': '10ms', 'request-retry': '2', 'recovery': f'tcp://{tmp_path}/silent.sock'}, **{'drop-every': '3'})
+
+    for i in range(5):
+        pub.post(b'data', seq=i)
+
+    for _ in range(100):
+        if len(sub.result) == 4:
+            break
+        process(pub, sub)
+        time.sleep(0.005)
+
+    assert [m.seq for m in sub.result] == [0, 1, 3, 4]
+    assert stat(context, 'sub', ['gap', 'lost', 'request']) == {'gap': 1, 'lost': 1, 'request': 3}
+
+def test_invalid(context, tmp_path):
+    with pytest.raises(TLLError):
+        context.Channel(f'rmcast+udp://127.0.0.1:{ports.UDP4}', mode='server', name='sub', recovery=f'udp://127.0.0.1:{ports.UDP4 + 1}')
+    with pytest.raises(TLLError):
+        context.Channel(f'rmcast+udp://127.0.0.1:{ports.UDP4}', mode='server', name='sub', recovery=f'mudp://239.255.0.1:{ports.UDP4 + 1}')
+
+    pub, sub = create(context, tmp_path)
+    with pytest.raises(TLLError): pub.post(b'data', seq=0, msgid=-1)
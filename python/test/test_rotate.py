@@ -2,6 +2,7 @@
 # vim: sts=4 sw=4 et
 
 import os
+import time
 
 import pytest
 
@@ -281,3 +282,86 @@ def test_convert(context, tmp_path):
     data = [m for m in r.result if m.type == m.Type.Data]
     assert [m.seq for m in data] == [100, 101, 102]
     assert [r.unpack(m).as_dict() for m in data] == [{'h0': 0, 'h1': 0, 'f0': 1000}, {'h0': 11, 'h1': 0, 'f0': 1001}, {'h0': 12, 'h1': 102, 'f0': 1002}]
+
+@pytest.mark.parametrize("compression", ['none', 'lz4'])
+def test_archive(context, tmp_path, compression):
+    w = context.Channel(f'rotate+file://{tmp_path}/rotate', dir='w', name='write', block='4kb', compression=compression, archive='yes', **{'archive-level': '9'})
+    w.open()
+
+    data = [b'xxx' * (i % 10 + 1) + b'%08d' % i for i in range(300)]
+    for i in range(300):
+        w.post(data[i], seq=i)
+        if i % 100 == 99:
+            w.post({}, name='Rotate', type=w.Type.Control)
+
+    for _ in range(100):
+        if all(os.path.exists(tmp_path / f'rotate.{i}.dat.idx') for i in (0, 100, 200)):
+            break
+        time.sleep(0.01)
+    w.close()
+
+    assert sorted(os.listdir(tmp_path)) == sorted(['rotate.current.dat'] + [f'rotate.{i}.dat{s}' for i in (0, 100, 200) for s in ('', '.idx')])
+
+    f = Accum(f'file://{tmp_path}/rotate.100.dat', name='file', context=context)
+    f.open()
+    assert f.config['info.compression'] == 'lz4'
+    assert f.config['info.seq-begin'] == '100'
+    assert f.config['info.seq'] == '199'
+    for seq in (100, 150, 199):
+        f.post(b'', type=f.Type.Control, name='Lookup', seq=seq) # Block is found with index
+        assert [(m.seq, m.data.tobytes()) for m in f.result[-1:]] == [(seq, data[seq])]
+    f.close()
+
+    r = Accum(f'rotate+file://{tmp_path}/rotate', name='read', context=context, autoclose='no')
+    r.open()
+    for _ in range(400):
+        r.process()
+        r.children[0].process()
+    assert [(m.seq, m.data.tobytes()) for m in r.result if m.type == m.Type.Data] == list(enumerate(data))
+    r.close()
+
+    for seq in range(0, 300, 17):
+        r.result = []
+        r.open(seq=str(seq))
+        for _ in range(5):
+            r.process()
+            r.children[0].process()
+        assert [(m.seq, m.data.tobytes()) for m in r.result if m.type == m.Type.Data][:1] == [(seq, data[seq])]
+        r.close()
+
+def test_prefetch(context, tmp_path):
+    w = context.Channel(f'rotate+file://{tmp_path}/rotate', name='write', dir='w', block='4kb')
+    w.open()
+    data = [f'xxx{i:08d}'.encode() for i in range(300)]
+    for i, d in enumerate(data):
+        if i and i % 100 == 0:
+            w.post(b'', type=w.Type.Control, name='Rotate')
+        w.post(d, seq=i)
+    w.close()
+
+    r = Accum(f'rotate+file://{tmp_path}/rotate', name='read', context=context, autoclose='no', prefetch='0.5')
+    r.open()
+
+    def read(count):
+        for _ in range(count):
+            r.process()
+            r.children[0].process()
+
+    read(100)
+    assert [m.seq for m in r.result if m.type == m.Type.Data] == list(range(100))
+    assert [c.name for c in r.children] == ['read/rotate']
+
+    read(2) # End of file and switch
+    assert [c.name for c in r.children] == ['read/prefetch'] # Prefetched file is used
+    assert [m.seq for m in r.result if m.type == m.Type.Data][-1] == 100
+    assert r.children[0].config['info.seq-begin'] == '100'
+
+    read(300)
+    assert [c.name for c in r.children] == ['read/rotate']
+    assert [(m.seq, m.data.tobytes()) for m in r.result if m.type == m.Type.Data] == list(enumerate(data))
+
+    r.result = []
+    r.post({}, type=r.Type.Control, name='Seek', seq=150)
+    read(10)
+    assert [m.seq for m in r.result if m.type == m.Type.Data] == list(range(150, 160))
+    r.close()
@@ -495,6 +495,90 @@ def test_blocks_channel(context, tmp_path):
     assert r.config['info.seq'] == '10'
     assert r.config['info.seq-begin'] == '-1'
 
+LVC_SCHEME = '''yamls://
+- name: Quote
+  id: 10
+  fields:
+    - {name: symbol, type: byte8, options.type: string}
+    - {name: price, type: double}
+- name: Status
+  id: 20
+  fields:
+    - {name: status, type: int32}
+'''
+
+def test_lvc_channel(context, tmp_path):
+    w = context.Channel(f'lvc://{tmp_path}/lvc;dir=w;key=symbol;capacity=2', scheme=LVC_SCHEME)
+    w.open()
+    assert w.config['info.seq'] == '-1'
+
+    with pytest.raises(TLLError): w.post({'type':''}, name='Block', type=w.Type.Control)
+
+    w.post({'symbol': 'A', 'price': 1.0}, name='Quote', seq=10)
+    w.post({'symbol': 'B', 'price': 2.0}, name='Quote', seq=11)
+    w.post({'status': 1}, name='Status', seq=12)
+    w.post({'symbol': 'A', 'price': 3.0}, name='Quote', seq=13)
+    assert w.config['info.seq'] == '13'
+    assert not (tmp_path / 'lvc' / 'w' / 'table.dat.tmp').exists()
+
+    with pytest.raises(TLLError): w.post({'symbol': 'D', 'price': 5.0}, name='Quote', seq=13)
+    with pytest.raises(TLLError): w.post({'symbol': 'A', 'price': 5.0}, name='Quote', seq=12)
+    assert w.config['info.seq'] == '13'
+    w.post({'type':''}, name='Block', type=w.Type.Control)
+
+    w.close()
+    w.open()
+    assert w.config['info.seq'] == '13'
+
+    w.post({'status': 2}, name='Status', seq=14)
+    w.post({'symbol': 'C', 'price': 4.0}, name='Quote', seq=15)
+    w.post({'type':'other'}, name='Block', type=w.Type.Control)
+
+    def check(r, block, btype, seq, result):
+        r.result = []
+        r.open({'block': str(block), 'block-type': btype})
+        assert r.config['info.seq'] == str(seq)
+        assert r.config['info.seq-begin'] == str(result[0][0])
+        for _ in range(len(result) + 1):
+            r.process()
+        assert r.state == r.State.Closed
+        assert [(m.seq, w.unpack(m).as_dict()) for m in r.result] == result
+
+    r = Accum('lvc://', master=w, context=context)
+    with pytest.raises(TLLError): r.open({'block': '1', 'block-type': 'default'})
+    r.close()
+
+    s0 = [(11, {'symbol': 'B', 'price': 2.0}), (12, {'status': 1}), (13, {'symbol': 'A', 'price': 3.0})]
+    s1 = [(11, {'symbol': 'B', 'price': 2.0}), (13, {'symbol': 'A', 'price': 3.0}), (14, {'status': 2}), (15, {'symbol': 'C', 'price': 4.0})]
+    check(r, 0, 'default', 13, s0)
+    check(r, 0, 'other', 15, s1)
+
+    r = Accum(f'lvc://{tmp_path}/lvc;dir=r', context=context)
+    check(r, 0, 'other', 15, s1)
+
+@asyncloop_run
+async def test_stream_lvc(asyncloop, tmp_path):
+    common = f'stream+pub+tcp://{tmp_path}/stream.sock;request=tcp://{tmp_path}/request.sock;dump=frame'
+    s = asyncloop.Channel(f'{common};storage=file://{tmp_path}/storage;name=server;mode=server;blocks=lvc://{tmp_path}/lvc;blocks.key=symbol', scheme=LVC_SCHEME)
+    c = asyncloop.Channel(f'{common};name=client;mode=client;peer=test', scheme=LVC_SCHEME)
+
+    s.open()
+    for i in range(100):
+        s.post({'symbol': f'S{i % 5}', 'price': float(i)}, name='Quote', seq=i)
+    s.post({'type':'default'}, name='Block', type=s.Type.Control)
+    s.post({'symbol': 'S0', 'price': 100.}, name='Quote', seq=100)
+
+    c.open(block='0', mode='block')
+    for i in range(95, 100):
+        m = await c.recv(1)
+        assert (m.seq, c.unpack(m).as_dict()) == (i, {'symbol': f'S{i % 5}', 'price': float(i)})
+
+    m = await c.recv(1)
+    assert (m.type, m.seq, c.unpack(m).SCHEME.name) == (m.Type.Control, 99, 'EndOfBlock')
+
+    m = await c.recv(1)
+    assert (m.seq, c.unpack(m).as_dict()) == (100, {'symbol': 'S0', 'price': 100.})
+
 @asyncloop_run
 async def test_rotate(asyncloop, tmp_path):
     common = f'stream+pub+tcp://{tmp_path}/stream.sock;request=tcp://{tmp_path}/request.sock;dump=frame;pub.dump=frame;request.dump=frame;storage.dump=frame'
@@ -831,6 +915,368 @@ async def test_ring_autoclose(asyncloop, tmp_path):
 
     assert await c.recv_state() == c.State.Error
 
+@pytest.mark.parametrize("params", ["replay-messages=3", "replay-bytes=250b", "replay-rate=1kb"])
+@asyncloop_run
+async def test_replay_scheduler(asyncloop, tmp_path, params):
+    common = f'stream+pub+tcp:///{tmp_path}/stream.sock;request=tcp:///{tmp_path}/request.sock;dump=frame'
+    s = asyncloop.Channel(f'{common};storage=file:///{tmp_path}/storage.dat;name=server;mode=server;stat=yes;{params}')
+    c = asyncloop.Channel(f'{common};name=client;mode=client;peer=test')
+
+    s.open()
+    for i in range(15):
+        s.post(b'x' * 100, msgid=10, seq=i)
+
+    c.open(seq='0', mode='seq')
+    assert await c.recv_state() == c.State.Active
+
+    for i in range(15):
+        m = await c.recv(1)
+        assert (m.type, m.seq) == (m.Type.Data, i)
+
+    replay = s.config.sub('info.replay').as_dict()
+    assert [(v['name'], v['seq'], v['lag']) for v in replay.values()] == [('test', '14', '0')]
+
+    stat = [x for x in asyncloop.context.stat_list if x.name == 'server'][0]
+    result = [(f.name, f.value) for f in stat.swap() if f.name in ('replay', 'throttl')]
+    assert result[:2] == [('replay', 15), ('replay', 1500)]
+    assert result[2][1] > 0
+
+    m = await c.recv(1)
+    assert (m.seq, c.unpack(m).SCHEME.name) == (14, 'Online')
+
+    for i in range(15, 20):
+        s.post(b'x' * 100, msgid=10, seq=i)
+
+    for i in range(15, 20):
+        m = await c.recv(1)
+        assert (m.type, m.seq) == (m.Type.Data, i)
+
+    c.close()
+    for _ in range(10):
+        await asyncloop.sleep(0.01)
+        if s.config.sub('info.replay').as_dict() == {}:
+            break
+    assert s.config.sub('info.replay').as_dict() == {}
+
+@pytest.mark.parametrize("params", ["", "replay-messages=7"])
+@asyncloop_run
+async def test_replay_threads(asyncloop, tmp_path, params):
+    common = f'stream+pub+tcp:///{tmp_path}/stream.sock;request=tcp:///{tmp_path}/request.sock;dump=frame'
+    s = asyncloop.Channel(f'{common};storage=file:///{tmp_path}/storage.dat;name=server;mode=server;replay-threads=2;replay-ring=4kb;{params}')
+    clients = [asyncloop.Channel(f'{common};name=client{i};mode=client;peer=test{i}') for i in range(3)]
+
+    s.open()
+    for i in range(100):
+        s.post(b'x' * (i % 10 * 10), msgid=10, seq=i)
+
+    for i, c in enumerate(clients):
+        c.open(seq=str(i * 10), mode='seq')
+
+    for i, c in enumerate(clients):
+        assert await c.recv_state() == c.State.Active
+        for j in range(i * 10, 100):
+            m = await c.recv(1)
+            assert (m.type, m.seq, len(m.data)) == (m.Type.Data, j, j % 10 * 10)
+        m = await c.recv(1)
+        assert (m.seq, c.unpack(m).SCHEME.name) == (99, 'Online')
+
+    assert [x.name for x in s.children] == ['server/stream', 'server/request', 'server/storage']
+
+    for i in range(100, 110):
+        s.post(b'x' * 10, msgid=10, seq=i)
+
+    for c in clients:
+        for j in range(100, 110):
+            m = await c.recv(1)
+            assert (m.type, m.seq) == (m.Type.Data, j)
+        c.close()
+
+    for _ in range(10):
+        await asyncloop.sleep(0.01)
+        if s.config.sub('info.replay').as_dict() == {}:
+            break
+    assert s.config.sub('info.replay').as_dict() == {}
+    s.close()
+
+@pytest.mark.parametrize("params", ["msgid-include=10", "msgid-exclude=20,30", "msgid-include=Data"])
+@pytest.mark.parametrize("threads", ["0", "1"])
+@asyncloop_run
+async def test_msgid_filter(asyncloop, tmp_path, params, threads):
+    scheme = 'yamls://[{name: Data, id: 10}, {name: Other, id: 20}, {name: Skip, id: 30}]'
+    common = f'stream+pub+tcp:///{tmp_path}/stream.sock;request=tcp:///{tmp_path}/request.sock;dump=frame'
+    s = asyncloop.Channel(f'{common};storage=file:///{tmp_path}/storage.dat;name=server;mode=server;replay-threads={threads}', scheme=scheme)
+    c = asyncloop.Channel(f'{common};name=client;mode=client;peer=test', scheme=scheme)
+
+    s.open()
+    for i in range(20):
+        s.post(b'', msgid=10 if i % 3 == 0 else 20, seq=i)
+
+    c.open(seq='0', mode='seq', **dict([params.split('=')]))
+    assert await c.recv_state() == c.State.Active
+
+    for i in range(0, 20, 3):
+        m = await c.recv(1)
+        assert (m.type, m.msgid, m.seq) == (m.Type.Data, 10, i)
+
+    m = await c.recv(1)
+    assert (m.seq, c.unpack(m).SCHEME.name) == (19, 'Online')
+
+    assert c.config['info.reopen.' + params.split('=')[0]] == params.split('=')[1].replace('Data', '10')
+
+    for i in range(20, 30):
+        s.post(b'', msgid=10 if i % 2 else 30, seq=i)
+
+    for i in range(21, 30, 2):
+        m = await c.recv(1)
+        assert (m.type, m.msgid, m.seq) == (m.Type.Data, 10, i)
+
+@asyncloop_run
+async def test_client_storage(asyncloop, tmp_path):
+    common = f'stream+pub+tcp:///{tmp_path}/stream.sock;request=tcp:///{tmp_path}/request.sock;dump=frame'
+    s = asyncloop.Channel(f'{common};storage=file:///{tmp_path}/storage.dat;name=server;mode=server;stat=yes')
+    c = asyncloop.Channel(f'{common};name=client;mode=client;peer=test;storage=file:///{tmp_path}/client.dat')
+
+    assert [x.name for x in c.children] == ['client/stream', 'client/request', 'client/storage']
+
+    s.open()
+    for i in range(10):
+        s.post(b'xxx', msgid=10, seq=i)
+
+    async def check(seq, first, last):
+        c.open(seq=str(seq), mode='seq')
+        assert await c.recv_state() == c.State.Active
+        for i in range(first, last):
+            m = await c.recv(1)
+            assert (m.type, m.seq, m.data.tobytes()) == (m.Type.Data, i, b'xxx')
+        m = await c.recv(1)
+        assert (m.seq, c.unpack(m).SCHEME.name) == (last - 1, 'Online')
+
+    await check(0, 0, 10)
+
+    s.post(b'xxx', msgid=10, seq=10)
+    m = await c.recv(1)
+    assert (m.type, m.seq) == (m.Type.Data, 10)
+
+    c.close()
+
+    for i in range(11, 20):
+        s.post(b'xxx', msgid=10, seq=i)
+
+    stat = [x for x in asyncloop.context.stat_list if x.name == 'server'][0]
+    stat.swap()
+
+    await check(5, 5, 20)
+    assert [f.value for f in stat.swap() if f.name == 'replay'][0] == 9 # Only 11..19 from server
+    c.close()
+
+    f = asyncloop.Channel(f'file://{tmp_path}/client.dat', name='file', autoclose='no')
+    f.open()
+    for i in range(20):
+        m = await f.recv(1)
+        assert (m.seq, m.data.tobytes()) == (i, b'xxx')
+
+@asyncloop_run
+async def test_client_storage_gap(asyncloop, tmp_path):
+    common = f'stream+pub+tcp:///{tmp_path}/stream.sock;request=tcp:///{tmp_path}/request.sock;dump=frame'
+    s = asyncloop.Channel(f'{common};storage=file:///{tmp_path}/storage.dat;name=server;mode=server')
+    c = asyncloop.Channel(f'{common};name=client;mode=client;peer=test;storage=file:///{tmp_path}/client.dat')
+
+    s.open()
+    for i in range(20):
+        s.post(b'xxx', msgid=10, seq=i)
+
+    async def check(seq, first, last):
+        c.open(seq=str(seq), mode='seq')
+        assert await c.recv_state() == c.State.Active
+        for i in range(first, last):
+            m = await c.recv(1)
+            assert (m.type, m.seq) == (m.Type.Data, i)
+        m = await c.recv(1)
+        assert (m.seq, c.unpack(m).SCHEME.name) == (last - 1, 'Online')
+        c.close()
+
+    def stored():
+        f = c.children[-1]
+        f.open()
+        r = (int(f.config['info.seq-begin']), int(f.config['info.seq']))
+        f.close()
+        return r
+
+    await check(15, 15, 20)
+    assert stored() == (15, 19)
+
+    for i in range(20, 30):
+        s.post(b'xxx', msgid=10, seq=i)
+
+    await check(25, 25, 30) # Gap between requested seq and storage
+    assert stored() == (15, 19)
+
+    await check(17, 17, 30)
+    assert stored() == (15, 29)
+
+@asyncloop_run
+async def test_client_storage_filter(asyncloop, tmp_path):
+    scheme = 'yamls://[{name: Data, id: 10}, {name: Other, id: 20}]'
+    common = f'stream+pub+tcp:///{tmp_path}/stream.sock;request=tcp:///{tmp_path}/request.sock;dump=frame'
+    s = asyncloop.Channel(f'{common};storage=file:///{tmp_path}/storage.dat;name=server;mode=server', scheme=scheme)
+    c = asyncloop.Channel(f'{common};name=client;mode=client;peer=test;storage=file:///{tmp_path}/client.dat', scheme=scheme)
+
+    s.open()
+    for i in range(10):
+        s.post(b'', msgid=10 if i % 2 else 20, seq=i)
+
+    c.open(seq='0', mode='seq', **{'msgid-include': 'Data'})
+    assert await c.recv_state() == c.State.Active
+    for i in range(1, 10, 2):
+        m = await c.recv(1)
+        assert (m.type, m.msgid, m.seq) == (m.Type.Data, 10, i)
+    m = await c.recv(1)
+    assert (m.seq, c.unpack(m).SCHEME.name) == (9, 'Online')
+    c.close()
+
+    assert c.children[-1].name == 'client/storage'
+    c.children[-1].open()
+    assert c.children[-1].config['info.seq'] == '-1'
+    c.children[-1].close()
+
+    c.open(seq='0', mode='seq')
+    assert await c.recv_state() == c.State.Active
+    for i in range(10):
+        m = await c.recv(1)
+        assert (m.type, m.seq) == (m.Type.Data, i)
+    c.close()
+
+@asyncloop_run
+async def test_overlap_spill(asyncloop, tmp_path):
+    common = f'stream+pub+tcp:///{tmp_path}/stream.sock;request=tcp:///{tmp_path}/request.sock;dump=frame'
+    s = asyncloop.Channel(f'{common};storage=file:///{tmp_path}/storage.dat;name=server;mode=server')
+    c = asyncloop.Channel(f'{common};name=client;mode=client;peer=test;size=256b;spill=yes;spill-dir={tmp_path};stat=yes')
+
+    s.open()
+    for i in range(10, 31, 10):
+        s.post(b'xxx', msgid=10, seq=i)
+
+    c.open(seq='20', mode='seq')
+
+    for _ in range(100):
+        if c.children[1].state == c.State.Active:
+            break
+        await asyncloop.sleep(0.001)
+    c.children[1].suspend() # Hold history until online buffer is full
+    for i in range(40, 241, 10):
+        s.post(b'xxx', msgid=10, seq=i)
+    for _ in range(10):
+        await asyncloop.sleep(0.01)
+    assert [x.name for x in tmp_path.iterdir() if x.name.startswith('tll-stream-spill')] != []
+    c.children[1].resume()
+
+    for i in range(20, 241, 10):
+        m = await c.recv(1)
+        assert (m.type, m.seq, m.data.tobytes()) == (m.Type.Data, i, b'xxx')
+
+    m = await c.recv(1)
+    assert m.type == m.Type.Control
+    assert (m.seq, c.unpack(m).SCHEME.name) == (240, 'Online')
+
+    s.post(b'online', msgid=10, seq=250)
+    m = await c.recv(1)
+    assert (m.seq, m.data.tobytes()) == (250, b'online')
+
+    assert [x.name for x in tmp_path.iterdir() if x.name.startswith('tll-stream-spill')] == []
+
+    stat = [x for x in asyncloop.context.stat_list if x.name == 'client'][0]
+    result = [(f.name, f.value) for f in stat.swap() if f.name in ('overlap', 'spill')]
+    assert result[0] == ('overlap', 21)
+    assert result[2][0] == 'spill' and 0 < result[2][1] < 21
+    assert result[3] == ('spill', result[2][1] * 3)
+
+@pytest.mark.parametrize("seq,chunks", [(0, 3), (45, 4), (95, 3)])
+@asyncloop_run
+async def test_chunks(asyncloop, tmp_path, seq, chunks):
+    common = f'stream+pub+tcp:///{tmp_path}/stream.sock;request=tcp:///{tmp_path}/request.sock;dump=frame'
+    s = asyncloop.Channel(f'{common};storage=file:///{tmp_path}/storage.dat;name=server;mode=server')
+    c = asyncloop.Channel(f'{common};name=client;mode=client;peer=test;chunks={chunks};chunk-min-size=10')
+
+    assert [x.name for x in c.children] == ['client/stream', 'client/request'] + [f'client/request/{i}' for i in range(1, chunks)]
+
+    s.open()
+    for i in range(100):
+        s.post(f'{i}'.encode(), msgid=10, seq=i)
+
+    c.open(seq=str(seq), mode='seq')
+    assert await c.recv_state() == c.State.Active
+
+    for i in range(seq, 100):
+        m = await c.recv(1)
+        assert (m.type, m.seq, m.data.tobytes()) == (m.Type.Data, i, f'{i}'.encode())
+    m = await c.recv(1)
+    assert (m.type, m.seq, c.unpack(m).SCHEME.name) == (m.Type.Control, 99, 'Online')
+
+    s.post(b'online', msgid=10, seq=100)
+    m = await c.recv(1)
+    assert (m.seq, m.data.tobytes()) == (100, b'online')
+
+    assert [x.state for x in c.children[2:]] == [c.State.Closed] * (chunks - 1)
+
+@asyncloop_run
+async def test_chunks_suspend(asyncloop, tmp_path):
+    common = f'stream+pub+tcp:///{tmp_path}/stream.sock;request=tcp:///{tmp_path}/request.sock;dump=frame'
+    s = asyncloop.Channel(f'{common};storage=file:///{tmp_path}/storage.dat;name=server;mode=server')
+    c = asyncloop.Channel(f'{common};name=client;mode=client;peer=test;chunks=3;chunk-min-size=10;size=1kb')
+
+    s.open()
+    for i in range(300):
+        s.post(b'x' * 100, msgid=10, seq=i)
+
+    c.open(seq='0', mode='seq')
+    request, chunk1, chunk2 = c.children[1:]
+    for _ in range(100):
+        if chunk1.state != c.State.Closed:
+            break
+        await asyncloop.sleep(0.001)
+    chunk1.suspend() # Hold first chunk, other connections buffer data
+    for _ in range(100):
+        if request.dcaps & request.DCaps.Suspend and chunk2.dcaps & chunk2.DCaps.Suspend:
+            break
+        await asyncloop.sleep(0.001)
+    assert request.dcaps & request.DCaps.Suspend
+    assert chunk2.dcaps & chunk2.DCaps.Suspend
+    chunk1.resume()
+
+    assert await c.recv_state() == c.State.Active
+    for i in range(300):
+        m = await c.recv(1)
+        assert (m.type, m.seq) == (m.Type.Data, i)
+    m = await c.recv(1)
+    assert (m.type, m.seq, c.unpack(m).SCHEME.name) == (m.Type.Control, 299, 'Online')
+    assert not request.dcaps & request.DCaps.Suspend
+
+@pytest.mark.parametrize("chunks,compression", [(1, 'yes'), (3, 'yes'), (1, 'no')])
+@asyncloop_run
+async def test_compression(asyncloop, tmp_path, chunks, compression):
+    common = f'stream+pub+tcp:///{tmp_path}/stream.sock;request=tcp:///{tmp_path}/request.sock;dump=frame'
+    s = asyncloop.Channel(f'{common};storage=file:///{tmp_path}/storage.dat;name=server;mode=server;compression={compression};compression-block=1kb')
+    c = asyncloop.Channel(f'{common};name=client;mode=client;peer=test;compression=lz4;chunks={chunks};chunk-min-size=10')
+
+    data = [f'{i:04d}'.encode() * (i % 50 if i % 17 else 1000) for i in range(100)] # Some messages are larger then block
+
+    s.open()
+    for i, d in enumerate(data):
+        s.post(d, msgid=10, seq=i)
+
+    c.open(seq='10', mode='seq')
+    assert await c.recv_state() == c.State.Active
+
+    for i in range(10, 100):
+        m = await c.recv(1)
+        assert (m.type, m.seq, m.data.tobytes()) == (m.Type.Data, i, data[i])
+    m = await c.recv(1)
+    assert (m.type, m.seq, c.unpack(m).SCHEME.name) == (m.Type.Control, 99, 'Online')
+
+    s.post(b'online' * 10, msgid=10, seq=100)
+    m = await c.recv(1)
+    assert (m.seq, m.data.tobytes()) == (100, b'online' * 10)
+
 @asyncloop_run
 async def test_export_client(asyncloop, tmp_path):
     scheme = 'yamls://[{name: Test, id: 10}]'
@@ -551,6 +551,427 @@ async def test_send_hwm(asyncloop, tmp_path):
     assert [(m.type, m.msgid) for m in s.result] == [(s.Type.Control, s.scheme_control.messages.WriteFull.msgid)]
     assert [(m.type, m.msgid) for m in c.result] == [(s.Type.Control, s.scheme_control.messages.WriteFull.msgid)]
 
+def test_process_frames(tmp_path):
+    s = Accum(f'tcp://{tmp_path}/server.sock;mode=server;process-frames=4', name='server', dump='frame', context=ctx)
+    c = Accum(f'tcp://{tmp_path}/server.sock;mode=client', name='client', dump='frame', context=ctx)
+
+    s.open()
+    c.open()
+
+    spoll = select.poll()
+    for i in s.children:
+        spoll.register(i.fd, select.POLLIN)
+    assert spoll.poll(100) != []
+    for i in s.children:
+        i.process()
+    assert len(s.children) == 2
+    assert c.state == c.State.Active
+    s.result = []
+
+    for i in range(10):
+        c.post(f'{i}'.encode(), seq=i)
+
+    sock = s.children[-1]
+    spoll.register(sock.fd, select.POLLIN)
+    assert spoll.poll(100) != []
+    time.sleep(0.01) # All messages are in one read
+
+    sock.process()
+    assert [m.seq for m in s.result] == list(range(4))
+    assert sock.dcaps & sock.DCaps.Pending
+
+    sock.process()
+    assert [m.seq for m in s.result] == list(range(8))
+    assert sock.dcaps & sock.DCaps.Pending
+
+    sock.process()
+    assert [(m.seq, m.data.tobytes()) for m in s.result] == [(i, f'{i}'.encode()) for i in range(10)]
+    assert not sock.dcaps & sock.DCaps.Pending
+
+    c.close()
+    s.close()
+
+def test_post_more(tmp_path):
+    s = Accum(f'tcp://{tmp_path}/server.sock;mode=server', name='server', dump='frame', context=ctx)
+    c = Accum(f'tcp://{tmp_path}/server.sock;mode=client;coalesce-size=256b', name='client', dump='frame', context=ctx, stat='yes')
+
+    s.open()
+    c.open()
+
+    spoll = select.poll()
+    for i in s.children:
+        spoll.register(i.fd, select.POLLIN)
+    assert spoll.poll(100) != []
+    for i in s.children:
+        i.process()
+    assert c.state == c.State.Active
+    s.result = []
+
+    sock = s.children[-1]
+    spoll = select.poll()
+    spoll.register(sock.fd, select.POLLIN)
+
+    for i in range(3):
+        c.post(b'more', seq=i, flags=c.PostFlags.More)
+    assert c.dcaps & c.DCaps.Pending
+    assert spoll.poll(10) == []
+
+    c.post(b'last', seq=3)
+    assert spoll.poll(100) != []
+    sock.process()
+    assert [(m.seq, m.data.tobytes()) for m in s.result] == [(0, b'more'), (1, b'more'), (2, b'more'), (3, b'last')]
+    s.result = []
+
+    c.post(b'more', seq=4, flags=c.PostFlags.More)
+    assert spoll.poll(10) == []
+    c.process() # Flush on process
+    assert not c.dcaps & c.DCaps.Pending
+    assert spoll.poll(100) != []
+    sock.process()
+    assert [(m.seq, m.data.tobytes()) for m in s.result] == [(4, b'more')]
+    s.result = []
+
+    for i in range(20): # Flushed when buffer reaches coalesce-size
+        c.post(b'x' * 32, seq=i, flags=c.PostFlags.More)
+    assert spoll.poll(100) != []
+    time.sleep(0.01)
+    sock.process()
+    assert [m.seq for m in s.result] == list(range(18)) # Flush after each 6 messages: 6 * (16 + 32) >= 256
+    assert c.dcaps & c.DCaps.Pending
+
+    c.process()
+    assert spoll.poll(100) != []
+    sock.process()
+    assert [m.seq for m in s.result] == list(range(20))
+
+    stat = [x for x in ctx.stat_list if x.name == 'client'][0]
+    assert [(f.name, f.count, f.sum, f.min, f.max) for f in stat.swap() if f.name == 'send'] == [('send', 6, 80 + 20 + 3 * 288 + 96, 20, 288)]
+
+    c.close()
+    s.close()
+
+@pytest.mark.parametrize("policy", ['eagain', 'drop', 'disconnect'])
+def test_send_policy(tmp_path, policy):
+    base = f'tcp://{tmp_path}/server.sock;send-buffer-size=1mb'
+    s = Accum(f'{base};mode=server', name='server', context=ctx)
+    c = Accum(f'{base};mode=client;send-buffer-hwm=256kb;send-buffer-lwm=64kb;send-buffer-policy={policy}', name='client-policy', context=ctx, stat='yes')
+
+    s.open()
+    c.open()
+
+    spoll = select.poll()
+    for i in s.children:
+        spoll.register(i.fd, select.POLLIN)
+    assert spoll.poll(100) != []
+    for i in s.children:
+        i.process()
+    assert c.state == c.State.Active
+    sock = s.children[-1]
+
+    WriteFull = c.scheme_control.messages.WriteFull.msgid
+    WriteReady = c.scheme_control.messages.WriteReady.msgid
+
+    data = b'x' * 16 * 1024
+    for i in range(1000): # WriteFull is reported when buffer exceeds high watermark
+        c.post(data, seq=i)
+        if c.result:
+            break
+    assert [(m.type, m.msgid) for m in c.result] == [(c.Type.Control, WriteFull)]
+    c.result = []
+
+    if policy == 'eagain':
+        with pytest.raises(TLLError):
+            c.post(data, seq=100)
+    elif policy == 'drop':
+        for i in range(4):
+            c.post(data, seq=100 + i)
+        stat = [x for x in ctx.stat_list if x.name == 'client-policy'][0]
+        assert [(f.name, f.value) for f in stat.swap() if f.name == 'drop'] == [('drop', 4)]
+    else:
+        with pytest.raises(TLLError):
+            c.post(data, seq=100)
+        assert c.state == c.State.Closed
+        return
+
+    for i in range(1000):
+        sock.process()
+        c.process()
+        if c.result:
+            break
+    assert [(m.type, m.msgid) for m in c.result] == [(c.Type.Control, WriteReady)]
+    c.result = []
+
+    for i in range(100):
+        sock.process()
+        c.process()
+    assert c.result == [] # No second WriteReady when buffer is empty
+
+@asyncloop_run
+async def test_socket_cache(asyncloop, tmp_path):
+    s = asyncloop.Channel(f'tcp://{tmp_path}/server.sock;mode=server;socket-cache=2', name='server')
+    s.open()
+
+    names = set()
+    for i in range(4):
+        clients = [asyncloop.Channel(f'tcp://{tmp_path}/server.sock;mode=client', name=f'client-{j}') for j in range(3)]
+        for c in clients:
+            c.open()
+        for c in clients:
+            assert (await c.recv_state()) == c.State.Active
+
+        addr = []
+        for c in clients:
+            m = await s.recv()
+            assert (m.type, m.msgid) == (s.Type.Control, s.scheme_control.messages.Connect.msgid)
+            addr.append(m.addr)
+        names |= {x.name for x in s.children[1:]}
+        assert len(s.children) == 4
+
+        for j, c in enumerate(clients):
+            c.post(b'xxx', seq=10 * i + j)
+        for j, c in enumerate(clients):
+            m = await s.recv()
+            s.post(b'yyy', seq=m.seq, addr=m.addr)
+        for j, c in enumerate(clients):
+            m = await c.recv()
+            assert (m.seq, m.data.tobytes()) == (10 * i + j, b'yyy')
+
+        for c in clients:
+            c.close()
+        for c in clients:
+            m = await s.recv()
+            assert (m.type, m.msgid) == (s.Type.Control, s.scheme_control.messages.Disconnect.msgid)
+        for c in clients:
+            c.free()
+        await asyncloop.sleep(0.01)
+        assert len(s.children) == 1
+
+    assert names == {'server/0', 'server/1', 'server/2', 'server/3', 'server/4', 'server/5'} # Two sockets are reused
+
+def test_buffer_pool(tmp_path):
+    s = Accum(f'tcp://{tmp_path}/server.sock;mode=server;buffer-pool=yes;buffer-size=4kb', name='server-pool', dump='frame', context=ctx, stat='yes')
+    s.open()
+
+    clients = [Accum(f'tcp://{tmp_path}/server.sock;mode=client', name=f'client-{i}', dump='frame', context=ctx) for i in range(4)]
+    for c in clients:
+        c.open()
+
+    spoll = select.poll()
+    spoll.register(s.children[0].fd, select.POLLIN)
+    for i in range(10):
+        if len(s.children) == 5:
+            break
+        assert spoll.poll(100) != []
+        s.children[0].process()
+    assert len(s.children) == 5
+    for c in clients:
+        c.process()
+        assert c.state == c.State.Active
+    s.result = []
+
+    stat = [x for x in ctx.stat_list if x.name == 'server-pool'][0]
+    def pool():
+        return {f.name: f.value for f in stat.swap() if f.name in ('used', 'cached')}
+
+    raw = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    raw.connect(f'{tmp_path}/server.sock')
+    assert spoll.poll(100) != []
+    s.children[0].process()
+    sock = s.children[-1]
+    s.result = []
+
+    raw.send(b'\x10\x00\x00\x00' + b'\x00' * 12 + b'x' * 8) # Partial frame with 16 bytes body
+    time.sleep(0.01)
+    sock.process()
+    assert s.result == []
+    assert pool() == {'used': 4096, 'cached': 0} # Buffer is held while it has partial data
+
+    raw.send(b'x' * 8)
+    time.sleep(0.01)
+    sock.process()
+    assert [m.data.tobytes() for m in s.result] == [b'x' * 16]
+    assert pool() == {'used': 0, 'cached': 4096} # Buffer is returned to the pool
+
+    s.result = []
+    for i, c in enumerate(clients):
+        c.post(b'z' * 1024, seq=i)
+    time.sleep(0.01)
+    for c in s.children[1:]:
+        c.process()
+    assert sorted([m.seq for m in s.result]) == [0, 1, 2, 3]
+    assert all(m.data.tobytes() == b'z' * 1024 for m in s.result)
+
+    s.post(b'y' * 8192, addr=s.result[0].addr) # Larger then buffer, size class is increased
+    clients[s.result[0].seq].process()
+    raw.close()
+    for c in clients:
+        c.close()
+    s.close()
+
+@asyncloop_run
+async def test_zerocopy(asyncloop):
+    url = f'tcp://127.0.0.1:{ports.TCP4};zerocopy=yes;zerocopy-size=1kb;buffer-size=2mb;send-buffer-hwm=1500kb;sndbuf=64kb'
+    s = asyncloop.Channel(f'{url};mode=server', name='server')
+    c = asyncloop.Channel(f'{url};mode=client', name='client')
+
+    s.open()
+    c.open()
+    assert (await c.recv_state()) == c.State.Active
+    m = await s.recv()
+    assert m.type == m.Type.Control
+
+    # Socket is blocked after first messages and rest are flushed from output buffer with zerocopy
+    data = bytearray(b'x' * 64 * 1024)
+    for i in range(16):
+        data[:4] = b'%04d' % i
+        c.post(data, seq=i) # Data is modified right after post
+        c.post(b'small', seq=100 + i)
+
+    for i in range(16):
+        m = await s.recv()
+        assert (m.seq, m.data.tobytes()[:8]) == (i, b'%04dxxxx' % i)
+        assert len(m.data) == 64 * 1024
+        m = await s.recv()
+        assert (m.seq, m.data.tobytes()) == (100 + i, b'small')
+
+    # Batch of small messages is accumulated in output buffer and sent with zerocopy
+    for i in range(64):
+        c.post(b'%04d' % i + b'y' * 60, seq=i, flags=c.PostFlags.More)
+    c.post(b'last', seq=64)
+
+    for i in range(64):
+        m = await s.recv()
+        assert (m.seq, m.data.tobytes()) == (i, b'%04d' % i + b'y' * 60)
+    assert (await s.recv()).seq == 64
+
+    c.close() # Socket with zerocopy sends in flight is closed
+    assert (await s.recv()).type == m.Type.Control
+
+@pytest.mark.skipif(sys.platform != 'linux', reason='Network timestamping not supported')
+@pytest.mark.parametrize("params,timestamping", [
+    ('timestamping=yes', True),
+    ('timestamping=yes;zerocopy=yes', True),
+    ('timestamping=no;zerocopy=yes', False),
+])
+@asyncloop_run
+async def test_rx_latency(asyncloop, params, timestamping):
+    url = f'tcp://127.0.0.1:{ports.TCP4};{params}'
+    s = asyncloop.Channel(f'{url};mode=server', name='server')
+    c = asyncloop.Channel(f'{url};mode=client', name='client-latency', stat='yes')
+
+    s.open()
+    c.open()
+    assert (await c.recv_state()) == c.State.Active
+    m = await s.recv()
+    assert m.type == m.Type.Control
+
+    for i in range(4):
+        s.post(b'xxx', seq=i, addr=m.addr)
+    for i in range(4):
+        assert (await c.recv()).seq == i
+
+    stat = [x for x in asyncloop.context.stat_list if x.name == 'client-latency'][0]
+    rxlat = [f for f in stat.swap() if f.name == 'rxlat'][0]
+    if not timestamping:
+        assert rxlat.count == 0
+        return
+    assert rxlat.count == 4
+    assert 0 < rxlat.min <= rxlat.max < 1000000000
+
+@asyncloop_run
+async def test_reuse_port(asyncloop):
+    port = ports(af=socket.AF_INET)
+    url = f'tcp://127.0.0.1:{port};mode=server'
+
+    s0 = asyncloop.Channel(url, name='server-0')
+    s1 = asyncloop.Channel(url, name='server-1')
+    s0.open()
+    with pytest.raises(TLLError):
+        s1.open()
+    s0.close()
+    s1.close()
+
+    servers = [asyncloop.Channel(f'{url};reuse-port=yes', name=f'server-{i}') for i in range(2)]
+    for s in servers:
+        s.open()
+
+    clients = [asyncloop.Channel(f'tcp://127.0.0.1:{port};mode=client', name=f'client-{i}') for i in range(8)]
+    for c in clients:
+        c.open()
+    for c in clients:
+        assert (await c.recv_state()) == c.State.Active
+
+    for i in range(8):
+        if sum(len(s.result) for s in servers) == 8:
+            break
+        await asyncloop.sleep(0.01)
+    assert sum(len(s.result) for s in servers) == 8
+
+    for s in servers:
+        for m in s.result:
+            assert (m.type, s.unpack(m).SCHEME.name) == (s.Type.Control, 'Connect')
+
+    for s in servers: # Each server handles only its own clients
+        for m in s.result:
+            s.post(b'yyy', addr=m.addr)
+    for c in clients:
+        m = await c.recv()
+        assert m.data.tobytes() == b'yyy'
+
+@asyncloop_run
+async def test_shard(asyncloop):
+    port = ports(af=socket.AF_INET)
+    url = f'tcp://127.0.0.1:{port};mode=server;shard=yes'
+
+    with pytest.raises(TLLError):
+        asyncloop.Channel(f'{url};master=server-0', name='invalid', master=asyncloop.Channel('null://', name='null'))
+
+    servers = [asyncloop.Channel(url, name='server-0', stat='yes')]
+    servers += [asyncloop.Channel(url, name=f'server-{i}', master=servers[0]) for i in range(1, 3)]
+    for s in servers:
+        s.open()
+
+    clients = [asyncloop.Channel(f'tcp://127.0.0.1:{port};mode=client', name=f'client-{i}') for i in range(8)]
+    for c in clients:
+        c.open()
+    for c in clients:
+        assert (await c.recv_state()) == c.State.Active
+
+    for i in range(10):
+        if sum(len(s.result) for s in servers) == 8:
+            break
+        await asyncloop.sleep(0.01)
+    assert sum(len(s.result) for s in servers) == 8
+
+    view = servers[0].config.sub('info.shard').as_dict()
+    assert sorted(view.keys()) == [s.name for s in servers]
+    for s in servers:
+        assert sorted(view[s.name].keys()) == sorted(str(m.addr) for m in s.result)
+        for host in view[s.name].values():
+            assert host.startswith('127.0.0.1:')
+
+    busy = [s for s in servers if s.result]
+    if len(busy) > 1: # Address of other shard is rejected
+        with pytest.raises(TLLError):
+            busy[0].post(b'xxx', addr=busy[1].result[0].addr)
+
+    stat = [x for x in asyncloop.context.stat_list if x.name == 'server-0/shard'][0]
+    assert {f.name: f.value for f in stat.swap()} == {'connect': 8, 'disconn': 0, 'clients': 8}
+
+    for c in clients:
+        c.close()
+    empty = {s.name: {} for s in servers}
+    for i in range(10):
+        if servers[0].config.sub('info.shard').as_dict() == empty:
+            break
+        await asyncloop.sleep(0.01)
+    assert servers[0].config.sub('info.shard').as_dict() == empty
+    assert {f.name: f.value for f in stat.swap()} == {'connect': 0, 'disconn': 8, 'clients': 0}
+
+    servers[2].close()
+    servers[2].free()
+    assert sorted(servers[0].config.sub('info.shard').as_dict().keys()) == ['server-0', 'server-1']
+
 @asyncloop_run
 async def test_bind(asyncloop):
     port = ports(af=socket.AF_INET6)
@@ -0,0 +1,572 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Pavel Shramov <shramov@mexmat.net>
+
+#include "channel/column.h"
+
+#include <cstring>
+
+#include <lz4.h>
+
+using namespace tll::channel;
+using namespace tll::channel::column;
+
+TLL_DEFINE_IMPL(Column);
+
+namespace {
+bool fixed_field(const tll::scheme::Field * field);
+
+bool fixed_message(const tll::scheme::Message * message)
+{
+	for (auto f = message->fields; f; f = f->next) {
+		if (!fixed_field(f))
+			return false;
+	}
+	return true;
+}
+
+bool fixed_field(const tll::scheme::Field * field)
+{
+	switch (field->type) {
+	case tll::scheme::Field::Pointer:
+		return false;
+	case tll::scheme::Field::Message:
+		return fixed_message(field->type_msg);
+	case tll::scheme::Field::Array:
+		return fixed_field(field->type_array);
+	case tll::scheme::Field::Union:
+		for (auto i = 0u; i < field->type_union->fields_size; i++) {
+			if (!fixed_field(field->type_union->fields + i))
+				return false;
+		}
+		return true;
+	default:
+		return true;
+	}
+}
+
+Stat field_stat(const tll::scheme::Field * field)
+{
+	switch (field->type) {
+	case tll::scheme::Field::Int8:
+	case tll::scheme::Field::Int16:
+	case tll::scheme::Field::Int32:
+	case tll::scheme::Field::Int64:
+		return Stat::Int;
+	case tll::scheme::Field::UInt8:
+	case tll::scheme::Field::UInt16:
+	case tll::scheme::Field::UInt32:
+	case tll::scheme::Field::UInt64:
+		return Stat::UInt;
+	case tll::scheme::Field::Double:
+		return Stat::Double;
+	default:
+		return Stat::None;
+	}
+}
+
+template <typename T>
+T read_value(const char * data)
+{
+	T v;
+	memcpy(&v, data, sizeof(v));
+	return v;
+}
+
+/// Read numeric value of given size, unaligned data is allowed
+stat_value_t stat_read(Stat stat, const char * data, size_t size)
+{
+	stat_value_t r = {};
+	switch (stat) {
+	case Stat::Int:
+		switch (size) {
+		case 1: r.i = read_value<int8_t>(data); break;
+		case 2: r.i = read_value<int16_t>(data); break;
+		case 4: r.i = read_value<int32_t>(data); break;
+		case 8: r.i = read_value<int64_t>(data); break;
+		}
+		break;
+	case Stat::UInt:
+		switch (size) {
+		case 1: r.u = read_value<uint8_t>(data); break;
+		case 2: r.u = read_value<uint16_t>(data); break;
+		case 4: r.u = read_value<uint32_t>(data); break;
+		case 8: r.u = read_value<uint64_t>(data); break;
+		}
+		break;
+	case Stat::Double:
+		r.d = read_value<double>(data);
+		break;
+	case Stat::None:
+		break;
+	}
+	return r;
+}
+
+double stat_double(Stat stat, const stat_value_t &v)
+{
+	switch (stat) {
+	case Stat::Int: return v.i;
+	case Stat::UInt: return v.u;
+	case Stat::Double: return v.d;
+	case Stat::None: break;
+	}
+	return 0;
+}
+
+bool stat_less(Stat stat, const stat_value_t &l, const stat_value_t &r)
+{
+	switch (stat) {
+	case Stat::Int: return l.i < r.i;
+	case Stat::UInt: return l.u < r.u;
+	case Stat::Double: return l.d < r.d;
+	case Stat::None: break;
+	}
+	return false;
+}
+}
+
+int Column::_init(const tll::Channel::Url &url, tll::Channel *master)
+{
+	if (auto r = Base::_init(url, master); r)
+		return r;
+
+	auto reader = channel_props_reader(url);
+	_chunk_rows = reader.getT("chunk-rows", 4096u);
+	_chunk_timeout = reader.getT<tll::duration>("chunk-timeout", tll::duration {});
+	_compression = reader.getT("column-compression", Compression::LZ4, {{"none", Compression::None}, {"lz4", Compression::LZ4}});
+	auto fields = reader.getT("fields", std::list<std::string> {});
+	auto filter = reader.getT<std::string>("filter", "");
+	_filter_min = reader.getT("filter-min", _filter_min);
+	_filter_max = reader.getT("filter-max", _filter_max);
+	if (!reader)
+		return _log.fail(EINVAL, "Invalid url: {}", reader.error());
+
+	if (_chunk_rows == 0)
+		return _log.fail(EINVAL, "Zero chunk-rows parameter");
+
+	if ((internal.caps & caps::InOut) == 0) // Defaults to input
+		internal.caps |= caps::Input;
+	if ((internal.caps & caps::InOut) == caps::InOut)
+		return _log.fail(EINVAL, "column+ can be either read-only or write-only, need proper dir in parameters");
+	_filter.reset();
+	if (filter.size())
+		_filter = filter;
+
+	_fields.clear();
+	for (auto & f : fields)
+		_fields.insert(f);
+
+	if ((internal.caps & caps::Output) && _chunk_timeout.count()) {
+		auto curl = child_url_parse("timer://;clock=realtime", "timer");
+		if (!curl)
+			return _log.fail(EINVAL, "Failed to parse timer url: {}", curl.error());
+		curl->set("interval", conv::to_string(_chunk_timeout));
+		_timer = context().channel(*curl);
+		if (!_timer)
+			return _log.fail(EINVAL, "Failed to create timer channel");
+		_timer->callback_add<Column, &Column::_on_timer>(this, TLL_MESSAGE_MASK_DATA);
+		_child_add(_timer.get(), "timer");
+	}
+	return 0;
+}
+
+int Column::_open(const tll::ConstConfig &cfg)
+{
+	_messages.clear();
+	_rows = 0;
+	_msgid_column.clear();
+	_seq_column.clear();
+
+	auto reader = tll::make_props_reader(cfg);
+	_seq_skip = reader.getT<long long>("seq", -1);
+	if (!reader)
+		return _log.fail(EINVAL, "Invalid params: {}", reader.error());
+
+	if (_timer && _timer->open())
+		return _log.fail(EINVAL, "Failed to open timer channel");
+	return Base::_open(cfg);
+}
+
+int Column::_close(bool force)
+{
+	if ((internal.caps & caps::Output) && _child->state() == tll::state::Active) {
+		if (auto r = _flush(); r)
+			_log.error("Failed to write last chunk of {} messages", _rows);
+	}
+	if (_timer)
+		_timer->close(true);
+	return Base::_close(force);
+}
+
+int Column::_on_timer(const tll::Channel *, const tll_msg_t *)
+{
+	if (!_rows || _child->state() != tll::state::Active)
+		return 0;
+	if (tll::time::now() - _chunk_time < _chunk_timeout)
+		return 0;
+	_log.debug("Write incomplete chunk of {} rows by timeout", _rows);
+	if (auto r = _flush(); r)
+		_log.error("Failed to write chunk of {} messages", _rows);
+	return 0;
+}
+
+int Column::_on_active()
+{
+	auto scheme = _child->scheme();
+	if (!scheme)
+		return _log.fail(EINVAL, "Child without scheme, can not split messages into columns");
+
+	_messages.clear();
+	bool filter = false;
+	for (auto m = scheme->messages; m; m = m->next) {
+		if (!m->msgid)
+			continue;
+		auto & msg = _messages[m->msgid];
+		msg.message = m;
+		msg.fixed = fixed_message(m);
+		for (auto f = m->fields; f; f = f->next) {
+			Field field = { f, (int16_t) msg.fields.size(), field_stat(f) };
+			if (_fields.size())
+				field.project = _fields.find(f->name) != _fields.end();
+			if (_filter && *_filter == f->name) {
+				if (field.stat == Stat::None)
+					return _log.fail(EINVAL, "Filter field {} in message {} is not numeric", f->name, m->name);
+				field.project = true;
+				filter = true;
+			}
+			msg.fields.push_back(field);
+		}
+		if (_filter) {
+			for (auto & f : msg.fields) {
+				if (*_filter == f.field->name)
+					msg.filter = &f;
+			}
+		}
+		msg.columns.resize(msg.fields.size());
+	}
+
+	if ((internal.caps & caps::Input) && _filter && !filter)
+		return _log.fail(EINVAL, "Filter field {} not found in any message", *_filter);
+
+	if (internal.caps & caps::Output) {
+		auto reader = tll::make_props_reader(_child->config());
+		_seq_last = reader.getT<long long>("info.seq", -1);
+		if (!reader)
+			return _log.fail(EINVAL, "Invalid last seq in child info: {}", reader.error());
+	}
+	return Base::_on_active();
+}
+
+int Column::_post(const tll_msg_t *msg, int flags)
+{
+	if (msg->type != TLL_MESSAGE_DATA) {
+		if (msg->type == TLL_MESSAGE_CONTROL && (internal.caps & caps::Input)) {
+			if (auto s = _child->scheme(TLL_MESSAGE_CONTROL); s) {
+				if (auto m = s->lookup("Seek"); m && m->msgid == msg->msgid)
+					_seq_skip = msg->seq;
+			}
+		}
+		return _child->post(msg, flags);
+	}
+
+	if (internal.caps & caps::Input)
+		return _log.fail(EINVAL, "Can not post data into input channel");
+
+	auto it = _messages.find(msg->msgid);
+	if (it == _messages.end())
+		return _log.fail(ENOENT, "Message {} not found", msg->msgid);
+	auto & m = it->second;
+	if (!m.fixed)
+		return _log.fail(EINVAL, "Message {} has pointer fields, can not be split into columns", m.message->name);
+	if (msg->size != m.message->size)
+		return _log.fail(EMSGSIZE, "Message {} size {} does not match scheme size {}", m.message->name, msg->size, m.message->size);
+	if (_seq_last != -1 && msg->seq <= _seq_last)
+		return _log.fail(EINVAL, "Non monotonic seq: {} <= last seq {}", msg->seq, _seq_last);
+
+	auto data = static_cast<const char *>(msg->data);
+	m.rows.insert(m.rows.end(), data, data + m.message->size);
+	m.count++;
+	_msgid_column.push_back(msg->msgid);
+	_seq_column.push_back(msg->seq);
+	_seq_last = msg->seq;
+
+	if (_rows == 0 && _timer)
+		_chunk_time = tll::time::now();
+	if (++_rows >= _chunk_rows)
+		return _flush();
+	return 0;
+}
+
+void Column::_column_write(int msgid, int16_t field, Stat stat, size_t rows, const void * data, size_t size)
+{
+	column_header_t header = {};
+	header.msgid = msgid;
+	header.field = field;
+	header.stat = stat;
+	header.rows = rows;
+	header.raw = rows * size;
+
+	if (stat != Stat::None && rows) {
+		auto ptr = static_cast<const char *>(data);
+		header.min = header.max = stat_read(stat, ptr, size);
+		for (auto i = 1u; i < rows; i++) {
+			auto v = stat_read(stat, ptr + i * size, size);
+			if (stat_less(stat, v, header.min))
+				header.min = v;
+			if (stat_less(stat, header.max, v))
+				header.max = v;
+		}
+	}
+
+	auto offset = _buf.size();
+	_buf.resize(offset + sizeof(header) + LZ4_compressBound(header.raw));
+	auto body = _buf.data() + offset + sizeof(header);
+
+	header.compression = Compression::None;
+	header.size = header.raw;
+	if (_compression == Compression::LZ4 && header.raw) {
+		auto r = LZ4_compress_default(static_cast<const char *>(data), body, header.raw, LZ4_compressBound(header.raw));
+		if (r > 0 && (size_t) r < header.raw) {
+			header.compression = Compression::LZ4;
+			header.size = r;
+		}
+	}
+	if (header.compression == Compression::None)
+		memcpy(body, data, header.raw);
+
+	memcpy(_buf.data() + offset, &header, sizeof(header));
+	_buf.resize(offset + sizeof(header) + header.size);
+}
+
+int Column::_flush()
+{
+	if (!_rows)
+		return 0;
+
+	_buf.resize(sizeof(chunk_header_t));
+	chunk_header_t chunk = { chunk_magic, chunk_version, 0, (uint32_t) _rows };
+
+	// Seq is stored as deltas from previous value, first value is absolute
+	auto last = _seq_column.back();
+	for (auto i = _rows - 1; i > 0; i--)
+		_seq_column[i] -= _seq_column[i - 1];
+	_column_write(0, field_seq, Stat::None, _rows, _seq_column.data(), sizeof(int64_t));
+	_column_write(0, field_msgid, Stat::None, _rows, _msgid_column.data(), sizeof(int32_t));
+	chunk.columns += 2;
+
+	for (auto & [msgid, m] : _messages) {
+		if (!m.count)
+			continue;
+		auto msize = m.message->size;
+		for (auto & f : m.fields) {
+			auto size = f.field->size;
+			_column.resize(m.count * size);
+			for (auto i = 0u; i < m.count; i++)
+				memcpy(_column.data() + i * size, m.rows.data() + i * msize + f.field->offset, size);
+			_column_write(msgid, f.index, f.stat, m.count, _column.data(), size);
+			chunk.columns++;
+		}
+		m.rows.clear();
+		m.count = 0;
+	}
+	memcpy(_buf.data(), &chunk, sizeof(chunk));
+
+	_log.debug("Write chunk of {} rows, {} columns, {} bytes", _rows, chunk.columns, _buf.size());
+	_rows = 0;
+	_msgid_column.clear();
+	_seq_column.clear();
+
+	tll_msg_t msg = { TLL_MESSAGE_DATA };
+	msg.seq = last;
+	msg.data = _buf.data();
+	msg.size = _buf.size();
+	if (auto r = _child->post(&msg); r)
+		return _log.fail(r, "Failed to post chunk with seq {}", last);
+	_count(false);
+	return 0;
+}
+
+void Column::_count(bool skipped)
+{
+	if (!_stat_enable)
+		return;
+	auto page = stat()->acquire();
+	if (page) {
+		page->chunks = 1;
+		if (skipped)
+			page->skipped = 1;
+		stat()->release(page);
+	}
+}
+
+const char * Column::_column_read(const column_header_t * header, const char * data)
+{
+	if (header->compression == Compression::None) {
+		if (header->size != header->raw)
+			return _log.fail(nullptr, "Uncompressed column size {} does not match raw size {}", header->size, header->raw);
+		return data;
+	}
+	if (header->compression != Compression::LZ4)
+		return _log.fail(nullptr, "Unknown column compression {}", (int) header->compression);
+
+	_decoded.emplace_back(header->raw);
+	auto & buf = _decoded.back();
+	auto r = LZ4_decompress_safe(data, buf.data(), header->size, header->raw);
+	if (r < 0 || (size_t) r != header->raw)
+		return _log.fail(nullptr, "Failed to decompress column: {}", r);
+	return buf.data();
+}
+
+int Column::_on_data(const tll_msg_t *msg)
+{
+	if (msg->size < sizeof(chunk_header_t))
+		return _log.fail(EMSGSIZE, "Chunk size {} less then header size {}", msg->size, sizeof(chunk_header_t));
+	auto data = static_cast<const char *>(msg->data);
+	auto chunk = read_value<chunk_header_t>(data);
+	if (chunk.magic != chunk_magic)
+		return _log.fail(EINVAL, "Invalid chunk magic: 0x{:08x}", chunk.magic);
+	if (chunk.version != chunk_version)
+		return _log.fail(EINVAL, "Unsupported chunk version {}", chunk.version);
+
+	if (_seq_skip != -1 && msg->seq < _seq_skip) {
+		_count(true);
+		return 0;
+	}
+
+	std::vector<std::pair<column_header_t, const char *>> columns;
+	columns.reserve(chunk.columns);
+
+	bool match = !_filter;
+	auto end = data + msg->size;
+	auto ptr = data + sizeof(chunk_header_t);
+	for (auto i = 0u; i < chunk.columns; i++) {
+		if (ptr + sizeof(column_header_t) > end)
+			return _log.fail(EMSGSIZE, "Truncated chunk: column {} header out of bounds", i);
+		auto header = read_value<column_header_t>(ptr);
+		ptr += sizeof(column_header_t);
+		if (ptr + header.size > end)
+			return _log.fail(EMSGSIZE, "Truncated chunk: column {} data out of bounds", i);
+		columns.emplace_back(header, ptr);
+		ptr += header.size;
+
+		if (match || header.field < 0)
+			continue;
+		auto it = _messages.find(header.msgid);
+		if (it == _messages.end() || !it->second.filter || it->second.filter->index != header.field)
+			continue;
+		if (stat_double(header.stat, header.min) <= _filter_max && stat_double(header.stat, header.max) >= _filter_min)
+			match = true;
+	}
+
+	if (!match) {
+		_log.trace("Skip chunk with seq {}: no values of {} in range", msg->seq, *_filter);
+		_count(true);
+		return 0;
+	}
+	_count(false);
+
+	_decoded.clear();
+	_decoded.reserve(chunk.columns);
+
+	const char * seq_column = nullptr;
+	const char * msgid_column = nullptr;
+	for (auto & m : _messages) {
+		m.second.cursor = 0;
+		m.second.chunk_rows = 0;
+		m.second.present = false;
+		std::fill(m.second.columns.begin(), m.second.columns.end(), nullptr);
+	}
+
+	for (auto & [header, body] : columns) {
+		const char ** dest = nullptr;
+		size_t size = 0;
+		if (header.field == field_seq || header.field == field_msgid) {
+			if (header.rows != chunk.rows)
+				return _log.fail(EINVAL, "Invalid number of rows in {} column: {}, chunk has {}", header.field == field_seq ? "seq" : "msgid", header.rows, chunk.rows);
+			dest = header.field == field_seq ? &seq_column : &msgid_column;
+			size = (header.field == field_seq ? sizeof(int64_t) : sizeof(int32_t)) * chunk.rows;
+		} else {
+			auto it = _messages.find(header.msgid);
+			if (it == _messages.end())
+				return _log.fail(EINVAL, "Unknown message {} in chunk", header.msgid);
+			auto & m = it->second;
+			if (header.field < 0 || (size_t) header.field >= m.fields.size())
+				return _log.fail(EINVAL, "Invalid field index {} for message {}", header.field, m.message->name);
+			if (!m.present) {
+				m.present = true;
+				m.chunk_rows = header.rows;
+			} else if (m.chunk_rows != header.rows)
+				return _log.fail(EINVAL, "Invalid number of rows in message {} field {} column: {}, other columns have {}", m.message->name, header.field, header.rows, m.chunk_rows);
+			auto & f = m.fields[header.field];
+			if (!f.project)
+				continue;
+			dest = &m.columns[header.field];
+			size = f.field->size * header.rows;
+		}
+		if (header.raw != size)
+			return _log.fail(EINVAL, "Invalid column size {} for message {} field {}: expected {}", header.raw, header.msgid, header.field, size);
+		*dest = _column_read(&header, body);
+		if (!*dest)
+			return _log.fail(EINVAL, "Failed to read column for message {} field {}", header.msgid, header.field);
+	}
+
+	if (!seq_column || !msgid_column)
+		return _log.fail(EINVAL, "Chunk without seq or msgid columns");
+
+	// Check that each message has as many rows in its columns as there are entries in msgid column
+	for (auto i = 0u; i < chunk.rows; i++) {
+		auto msgid = read_value<int32_t>(msgid_column + i * sizeof(int32_t));
+		auto it = _messages.find(msgid);
+		if (it == _messages.end())
+			return _log.fail(EINVAL, "Unknown message {} in chunk", msgid);
+		it->second.cursor++;
+	}
+	for (auto & [msgid, m] : _messages) {
+		if (m.present && m.cursor != m.chunk_rows)
+			return _log.fail(EINVAL, "Message {} has {} rows in chunk, columns have {}", m.message->name, m.cursor, m.chunk_rows);
+		if (!m.present && m.cursor && m.fields.size())
+			return _log.fail(EINVAL, "Message {} has {} rows in chunk without columns", m.message->name, m.cursor);
+		m.cursor = 0;
+	}
+
+	tll_msg_t out = { TLL_MESSAGE_DATA };
+	out.addr = msg->addr;
+	out.time = msg->time;
+	long long seq = 0;
+	for (auto i = 0u; i < chunk.rows; i++) {
+		seq += read_value<int64_t>(seq_column + i * sizeof(int64_t));
+		auto msgid = read_value<int32_t>(msgid_column + i * sizeof(int32_t));
+		auto it = _messages.find(msgid);
+		if (it == _messages.end())
+			return _log.fail(EINVAL, "Unknown message {} in chunk", msgid);
+		auto & m = it->second;
+		auto row = m.cursor++;
+		if (seq < _seq_skip)
+			continue;
+
+		if (_filter) {
+			if (!m.filter || !m.columns[m.filter->index])
+				continue;
+			auto size = m.filter->field->size;
+			auto v = stat_double(m.filter->stat, stat_read(m.filter->stat, m.columns[m.filter->index] + row * size, size));
+			if (v < _filter_min || v > _filter_max)
+				continue;
+		}
+
+		_row.assign(m.message->size, 0);
+		for (auto & f : m.fields) {
+			auto column = m.columns[f.index];
+			if (!column)
+				continue;
+			auto size = f.field->size;
+			memcpy(_row.data() + f.field->offset, column + row * size, size);
+		}
+
+		out.msgid = msgid;
+		out.seq = seq;
+		out.data = _row.data();
+		out.size = _row.size();
+		_callback_data(&out);
+	}
+	return 0;
+}
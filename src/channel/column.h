@@ -0,0 +1,163 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Pavel Shramov <shramov@mexmat.net>
+
+#ifndef _TLL_CHANNEL_COLUMN_H
+#define _TLL_CHANNEL_COLUMN_H
+
+#include "tll/channel/prefix.h"
+#include "tll/util/time.h"
+
+#include <limits>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace tll::channel {
+
+namespace column {
+
+static constexpr uint32_t chunk_magic = 0x434c4c54; // "TLLC"
+static constexpr uint16_t chunk_version = 1;
+
+static constexpr int16_t field_seq = -1;
+static constexpr int16_t field_msgid = -2;
+
+enum class Compression : uint8_t { None = 0, LZ4 = 1 };
+enum class Stat : uint8_t { None = 0, Int = 1, UInt = 2, Double = 3 };
+
+union stat_value_t
+{
+	int64_t i;
+	uint64_t u;
+	double d;
+};
+
+// Headers have no implicit padding and are copied with memcpy, chunk data is not aligned
+
+/// Chunk header, followed by list of columns
+struct chunk_header_t
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t columns;
+	uint32_t rows;
+};
+
+/// Column header, followed by ``size`` bytes of column data
+struct column_header_t
+{
+	int32_t msgid; ///< Message id, zero for seq and msgid columns
+	int16_t field; ///< Index of top level field in the message or negative for special columns
+	Compression compression;
+	Stat stat;
+	uint32_t rows;
+	uint32_t size; ///< Stored data size
+	uint32_t raw; ///< Uncompressed data size
+	uint32_t reserved;
+	stat_value_t min;
+	stat_value_t max;
+};
+
+static_assert(sizeof(chunk_header_t) == 12);
+static_assert(sizeof(column_header_t) == 40);
+
+} // namespace column
+
+/**
+ * Columnar storage prefix
+ *
+ * Writer collects messages into row groups and posts each group into child as single chunk where
+ * fields of each message type are stored in separate columns. Reader expands chunks back into
+ * messages, optionally decoding only subset of fields and skipping chunks by field range.
+ */
+class Column : public tll::channel::Prefix<Column>
+{
+	using Base = tll::channel::Prefix<Column>;
+
+	struct Field
+	{
+		const tll::scheme::Field * field = nullptr;
+		int16_t index = 0;
+		column::Stat stat = column::Stat::None;
+		bool project = true; ///< Field is decoded by reader
+	};
+
+	struct Message
+	{
+		const tll::scheme::Message * message = nullptr;
+		bool fixed = true; ///< Message has no pointer fields
+		std::vector<Field> fields;
+		const Field * filter = nullptr;
+
+		std::vector<char> rows; ///< Row data collected by writer
+		size_t count = 0;
+
+		std::vector<const char *> columns; ///< Decoded columns, indexed by field
+		size_t cursor = 0;
+		size_t chunk_rows = 0; ///< Number of rows in columns of current chunk
+		bool present = false; ///< Message has columns in current chunk
+	};
+
+	std::map<int, Message> _messages;
+
+	size_t _chunk_rows = 4096;
+	tll::duration _chunk_timeout = {}; ///< Write incomplete chunk after this time, zero to disable
+	std::unique_ptr<tll::Channel> _timer;
+	column::Compression _compression = column::Compression::LZ4;
+	size_t _rows = 0;
+	tll::time_point _chunk_time = {}; ///< Time when first row of current chunk was posted
+	long long _seq_last = -1;
+	std::vector<int32_t> _msgid_column;
+	std::vector<int64_t> _seq_column;
+
+	std::set<std::string, std::less<>> _fields;
+	std::optional<std::string> _filter;
+	double _filter_min = -std::numeric_limits<double>::infinity();
+	double _filter_max = std::numeric_limits<double>::infinity();
+	long long _seq_skip = -1;
+
+	std::vector<char> _buf;
+	std::vector<char> _column;
+	std::vector<std::vector<char>> _decoded;
+	std::vector<char> _row;
+
+ public:
+	static constexpr std::string_view channel_protocol() { return "column+"; }
+
+	struct StatType : public Base::StatType
+	{
+		tll::stat::Integer<tll::stat::Sum, tll::stat::Unknown, 'c', 'h', 'u', 'n', 'k'> chunks;
+		tll::stat::Integer<tll::stat::Sum, tll::stat::Unknown, 's', 'k', 'i', 'p'> skipped;
+	};
+
+	tll::stat::BlockT<StatType> * stat() { return static_cast<tll::stat::BlockT<StatType> *>(this->internal.stat); }
+
+	int _init(const tll::Channel::Url &, tll::Channel *master);
+	void _free()
+	{
+		_timer.reset();
+		return Base::_free();
+	}
+
+	int _open(const tll::ConstConfig &);
+	int _close(bool force);
+
+	int _post(const tll_msg_t *msg, int flags);
+
+	int _on_active();
+	int _on_data(const tll_msg_t *msg);
+
+ private:
+	int _flush();
+	int _on_timer(const tll::Channel *, const tll_msg_t *);
+	void _column_write(int msgid, int16_t field, column::Stat stat, size_t rows, const void * data, size_t size);
+	const char * _column_read(const column::column_header_t * header, const char * data);
+	void _count(bool skipped);
+};
+
+} // namespace tll::channel
+
+#endif//_TLL_CHANNEL_COLUMN_H
@@ -27,6 +27,7 @@
 #include "channel/channels.h"
 
 #include "channel/blocks.h"
+#include "channel/column.h"
 #include "channel/convert.h"
 #include "channel/direct.h"
 #include "channel/ipc.h"
@@ -37,6 +38,7 @@
 #include "channel/json.h"
 #endif
 #include "channel/loader.h"
+#include "channel/lvc.h"
 #include "channel/lz4.h"
 #include "channel/lz4block.h"
 #include "channel/mem.h"
@@ -45,6 +47,7 @@
 #include "channel/pub-mem.h"
 #include "channel/random.h"
 #include "channel/rate.h"
+#include "channel/rmcast.h"
 #include "channel/resolve.h"
 #include "channel/rotate.h"
 #include "channel/serial.h"
@@ -68,6 +71,7 @@ TLL_DEFINE_IMPL(tll::channel::Random);
 TLL_DEFINE_IMPL(tll::channel::SeqCheck);
 
 TLL_DECLARE_IMPL(tll::channel::Blocks);
+TLL_DECLARE_IMPL(tll::channel::Column);
 TLL_DECLARE_IMPL(ChDirect);
 TLL_DECLARE_IMPL(ChIpc);
 TLL_DECLARE_IMPL(channel::FileInit);
@@ -75,6 +79,7 @@ TLL_DECLARE_IMPL(Framed);
 #ifdef WITH_RAPIDJSON
 TLL_DECLARE_IMPL(ChJSON);
 #endif
+TLL_DECLARE_IMPL(tll::channel::LastValue);
 TLL_DECLARE_IMPL(ChMem);
 TLL_DECLARE_IMPL(ChLZ4);
 TLL_DECLARE_IMPL(ChLZ4B);
@@ -84,6 +89,7 @@ TLL_DECLARE_IMPL(ChSerial);
 TLL_DECLARE_IMPL(tll::channel::StreamServer);
 TLL_DECLARE_IMPL(tll::channel::Rate);
 TLL_DECLARE_IMPL(tll::channel::Resolve);
+TLL_DECLARE_IMPL(tll::channel::RMcast);
 TLL_DECLARE_IMPL(tll::channel::Rotate);
 TLL_DECLARE_IMPL(ChTcp);
 TLL_DECLARE_IMPL(ChTimer);
@@ -117,6 +123,7 @@ struct tll_channel_context_t : public tll::util::refbase_t<tll_channel_context_t
 	tll_channel_context_t(Config defaults) : config_defaults(defaults)
 	{
 		reg(&tll::channel::Blocks::impl);
+		reg(&tll::channel::Column::impl);
 		reg(&tll::channel::Convert::impl);
 		reg(&ChDirect::impl);
 		reg(&ChIpc::impl);
@@ -126,6 +133,7 @@ struct tll_channel_context_t : public tll::util::refbase_t<tll_channel_context_t
 #ifdef WITH_RAPIDJSON
 		reg(&ChJSON::impl);
 #endif
+		reg(&tll::channel::LastValue::impl);
 		reg(&ChMem::impl);
 		reg(&ChLZ4::impl);
 		reg(&ChLZ4B::impl);
@@ -136,6 +144,7 @@ struct tll_channel_context_t : public tll::util::refbase_t<tll_channel_context_t
 		reg(&tll::channel::Random::impl);
 		reg(&tll::channel::Rate::impl);
 		reg(&tll::channel::Resolve::impl);
+		reg(&tll::channel::RMcast::impl);
 		reg(&tll::channel::Rotate::impl);
 		reg(&ChSerial::impl);
 		reg(&tll::channel::StreamServer::impl);
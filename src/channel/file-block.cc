@@ -0,0 +1,582 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Pavel Shramov <shramov@mexmat.net>
+
+#include "channel/file-block.h"
+#include "channel/file-scheme.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace tll::file;
+
+int BlockDecoder::init(size_t block, Compression compression, tll::const_memory dict)
+{
+	_block_size = block;
+	_compression = compression;
+	_buf.resize(block);
+	if (_compression == Compression::LZ4) {
+		if (_lz4.init(block, dict))
+			return _fail(EINVAL, "Failed to init lz4 decoder with block size {}", block);
+	}
+	return 0;
+}
+
+int BlockDecoder::decode(int fd, size_t offset, Block &block)
+{
+	block.offset = offset;
+	block.complete = false;
+	block.messages.clear();
+	block.data.clear();
+
+	auto r = pread(fd, _buf.data(), _buf.size(), offset);
+	if (r < 0)
+		return _fail(EINVAL, "Failed to read block at 0x{:x}: {}", offset, strerror(errno));
+	const size_t size = r;
+
+	if (_compression == Compression::LZ4)
+		_lz4.reset();
+
+	if (size < sizeof(frame_size_t))
+		return EAGAIN;
+
+	// Skip block header or metadata
+	auto frame = *(const frame_size_t *) _buf.data();
+	if (frame == 0)
+		return EAGAIN;
+	if (frame < 0 || (size_t) frame > _block_size)
+		return _fail(EINVAL, "Invalid block header at 0x{:x}: frame size {}", offset, frame);
+
+	long long seq_base = 0;
+	for (size_t pos = frame; ; pos += frame) {
+		if (pos + sizeof(full_frame_t) + 1 > _block_size) { // No space for message, writer moved to next block
+			block.complete = true;
+			break;
+		}
+
+		if (pos + sizeof(frame_size_t) > size)
+			break;
+		frame = *(const frame_size_t *) (_buf.data() + pos);
+		if (frame == -1) {
+			block.complete = true;
+			break;
+		} else if (frame == 0)
+			break;
+
+		if (frame < (ssize_t) (2 * sizeof(frame_size_t) + 1) || pos + frame > _block_size)
+			return _fail(EINVAL, "Invalid frame size at 0x{:x}: {}", offset + pos, frame);
+		if (pos + frame > size)
+			break;
+		if ((_buf[pos + frame - 1] & 0x80) == 0) // No tail marker
+			break;
+
+		tll::const_memory data = { _buf.data() + pos + sizeof(frame_size_t), frame - sizeof(frame_size_t) - 1 };
+		if (_compression == Compression::LZ4) {
+			data = _lz4.decompress(data.data, data.size);
+			if (!data.data)
+				return _fail(EINVAL, "Failed to decompress {} bytes of data at 0x{:x}", frame, offset + pos);
+		}
+
+		if (data.size < sizeof(frame_t))
+			return _fail(EINVAL, "Invalid data size at 0x{:x}: {} too small", offset + pos, data.size);
+
+		auto meta = (const frame_t *) data.data;
+		long long seq = meta->seq;
+		if (_compression == Compression::LZ4) {
+			seq += seq_base;
+			seq_base = seq;
+		}
+
+		const size_t body = data.size - sizeof(frame_t);
+		block.messages.push_back({ offset + pos, (size_t) frame, meta->msgid, seq, block.data.size(), body });
+		block.data.insert(block.data.end(), (const char *) (meta + 1), (const char *) (meta + 1) + body);
+	}
+
+	return block.complete ? 0 : EAGAIN;
+}
+
+int BlockDecoder::first(int fd, size_t offset, long long &seq)
+{
+	frame_size_t frame;
+	auto r = pread(fd, &frame, sizeof(frame), offset);
+	if (r < 0)
+		return _fail(EINVAL, "Failed to read block at 0x{:x}: {}", offset, strerror(errno));
+	if ((size_t) r < sizeof(frame) || frame == 0)
+		return EAGAIN;
+	if (frame < 0 || (size_t) frame > _block_size)
+		return _fail(EINVAL, "Invalid block header at 0x{:x}: frame size {}", offset, frame);
+
+	const size_t pos = frame;
+	if (pos + sizeof(full_frame_t) + 1 > _block_size) // Block is filled with metadata
+		return EAGAIN;
+
+	r = pread(fd, &frame, sizeof(frame), offset + pos);
+	if (r < 0)
+		return _fail(EINVAL, "Failed to read frame at 0x{:x}: {}", offset + pos, strerror(errno));
+	if ((size_t) r < sizeof(frame) || frame == 0 || frame == -1)
+		return EAGAIN;
+	if (frame < (ssize_t) (2 * sizeof(frame_size_t) + 1) || pos + frame > _block_size)
+		return _fail(EINVAL, "Invalid frame size at 0x{:x}: {}", offset + pos, frame);
+
+	r = pread(fd, _buf.data(), frame, offset + pos);
+	if (r < 0)
+		return _fail(EINVAL, "Failed to read frame at 0x{:x}: {}", offset + pos, strerror(errno));
+	if (r < frame || (_buf[frame - 1] & 0x80) == 0) // Frame is not finished yet
+		return EAGAIN;
+
+	tll::const_memory data = { _buf.data() + sizeof(frame_size_t), frame - sizeof(frame_size_t) - 1 };
+	if (_compression == Compression::LZ4) {
+		_lz4.reset();
+		data = _lz4.decompress(data.data, data.size);
+		if (!data.data)
+			return _fail(EINVAL, "Failed to decompress {} bytes of data at 0x{:x}", frame, offset + pos);
+	}
+
+	if (data.size < sizeof(frame_t))
+		return _fail(EINVAL, "Invalid data size at 0x{:x}: {} too small", offset + pos, data.size);
+	seq = ((const frame_t *) data.data)->seq; // First message in the block has absolute seq
+	return 0;
+}
+
+BlockCache & BlockCache::instance()
+{
+	static BlockCache cache;
+	return cache;
+}
+
+int BlockCache::key(int fd, Key &key)
+{
+	struct stat s;
+	if (fstat(fd, &s))
+		return errno;
+	key = { s.st_dev, s.st_ino, 0, 0 };
+	key.id = (s.st_ctim.tv_sec * 1000000000ull + s.st_ctim.tv_nsec) ^ ((uint64_t) s.st_size << 32);
+#ifdef STATX_BTIME
+	struct statx sx;
+	if (!statx(fd, "", AT_EMPTY_PATH, STATX_BTIME, &sx) && (sx.stx_mask & STATX_BTIME))
+		key.id = sx.stx_btime.tv_sec * 1000000000ull + sx.stx_btime.tv_nsec;
+#endif
+	return 0;
+}
+
+void BlockCache::reserve(size_t size)
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	_reserved.insert(size);
+	_budget = *_reserved.rbegin();
+}
+
+void BlockCache::release(size_t size)
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	if (auto it = _reserved.find(size); it != _reserved.end())
+		_reserved.erase(it);
+	_budget = _reserved.empty() ? 0 : *_reserved.rbegin();
+	_evict();
+}
+
+std::shared_ptr<const Block> BlockCache::get(const Key &key)
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	auto it = _index.find(key);
+	if (it == _index.end())
+		return nullptr;
+	_lru.splice(_lru.begin(), _lru, it->second);
+	return it->second->second;
+}
+
+void BlockCache::put(const Key &key, std::shared_ptr<const Block> block)
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	if (_index.find(key) != _index.end())
+		return;
+	_size += block->memory();
+	_lru.emplace_front(key, std::move(block));
+	_index.emplace(key, _lru.begin());
+	_evict();
+}
+
+void BlockCache::_evict()
+{
+	while (_size > _budget && _lru.size()) {
+		auto & e = _lru.back();
+		_size -= e.second->memory();
+		_index.erase(e.first);
+		_lru.pop_back();
+	}
+}
+
+void BlockCache::clear()
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	_index.clear();
+	_lru.clear();
+	_size = 0;
+}
+
+int Readahead::start(int fd, size_t block, Compression compression, tll::const_memory dict, size_t depth, size_t position)
+{
+	_fd = fd;
+	_block_size = block;
+	_depth = depth;
+	_position = position - position % block + block; // Current block is processed by reader
+	_tail = -1;
+	_stop = false;
+	_blocks.clear();
+
+	if (auto r = _decoder.init(block, compression, dict); r)
+		return r;
+
+	_thread = std::thread(&Readahead::_run, this);
+	return 0;
+}
+
+void Readahead::stop()
+{
+	{
+		std::unique_lock<std::mutex> lock(_lock);
+		_stop = true;
+	}
+	_cond.notify_one();
+
+	if (_thread.joinable())
+		_thread.join();
+	_thread = {};
+	_blocks.clear();
+}
+
+std::shared_ptr<const Block> Readahead::get(size_t offset)
+{
+	std::shared_ptr<const Block> r;
+	{
+		std::unique_lock<std::mutex> lock(_lock);
+		for (auto it = _blocks.begin(); it != _blocks.end() && it->first <= offset;) {
+			if (it->first == offset)
+				r = std::move(it->second);
+			it = _blocks.erase(it);
+		}
+
+		if (_position != offset + _block_size) {
+			_position = offset + _block_size;
+			_tail = -1;
+		}
+	}
+	_cond.notify_one();
+	return r;
+}
+
+size_t Readahead::_next()
+{
+	for (auto offset = _position; offset < _position + _depth * _block_size; offset += _block_size) {
+		if (offset >= _tail)
+			break;
+		if (_blocks.find(offset) == _blocks.end())
+			return offset;
+	}
+	return -1;
+}
+
+void Readahead::_run()
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	while (!_stop) {
+		auto offset = _next();
+		if (offset == (size_t) -1) {
+			_cond.wait(lock);
+			continue;
+		}
+
+		lock.unlock();
+
+		std::shared_ptr<const Block> block;
+		if (_cache) {
+			auto key = _cache_key;
+			key.offset = offset;
+			block = _cache->get(key);
+		}
+
+		int r = 0;
+		if (!block) {
+			auto decoded = std::make_shared<Block>();
+			r = _decoder.decode(_fd, offset, *decoded);
+			block = std::move(decoded);
+		}
+
+		lock.lock();
+
+		if (r) {
+			// Block is not finished or broken, wait until reader moves
+			if (offset >= _position)
+				_tail = offset;
+			continue;
+		}
+
+		if (offset >= _position)
+			_blocks.emplace(offset, std::move(block));
+	}
+}
+
+int tll::file::index_load(const std::string &filename, int fd, size_t block, std::vector<index_entry_t> &index)
+{
+	index.clear();
+
+	struct stat s;
+	if (fstat(fd, &s))
+		return errno;
+
+	auto ifd = ::open((filename + ".idx").c_str(), O_RDONLY);
+	if (ifd == -1)
+		return errno == ENOENT ? ENOENT : errno;
+	std::unique_ptr<int, void (*)(int *)> _ifd = { &ifd, [](int * fd) { ::close(*fd); } };
+
+	index_header_t header;
+	if (pread(ifd, &header, sizeof(header), 0) != sizeof(header))
+		return ENOENT;
+	if (memcmp(header.magic, index_header_t {}.magic, sizeof(header.magic)) || header.version != index_header_t {}.version)
+		return EINVAL;
+	if (header.block != block || header.inode != s.st_ino || header.size != (uint64_t) s.st_size)
+		return ENOENT; // Stale index
+
+	struct stat is;
+	if (fstat(ifd, &is))
+		return errno;
+	if ((is.st_size - sizeof(header)) % sizeof(index_entry_t))
+		return EINVAL;
+	index.resize((is.st_size - sizeof(header)) / sizeof(index_entry_t));
+	auto size = index.size() * sizeof(index_entry_t);
+	if (pread(ifd, index.data(), size, sizeof(header)) != (ssize_t) size) {
+		index.clear();
+		return EINVAL;
+	}
+	return 0;
+}
+
+namespace {
+/// Sequential writer of compressed data file, mirrors layout created by file:// channel
+class ArchiveWriter
+{
+	int _fd = -1;
+	size_t _block = 0;
+	size_t _offset = 0; ///< Offset of current block
+	size_t _pos = 0; ///< Position in current block
+	std::vector<char> _buf;
+
+	tll::lz4::StreamEncode _lz4;
+	std::vector<char> _lz4_buf;
+	long long _seq = 0;
+	bool _block_empty = true;
+
+ public:
+	std::vector<index_entry_t> index;
+
+	int init(int fd, size_t block, tll::const_memory dict, int level)
+	{
+		_fd = fd;
+		_block = block;
+		_buf.resize(block);
+		_lz4_buf.resize(LZ4_compressBound(block));
+		return _lz4.init(block, dict, level);
+	}
+
+	void meta(const void * data, size_t size)
+	{
+		memcpy(_buf.data(), data, size);
+		_pos = size;
+	}
+
+	int write(int msgid, long long seq, const void * data, size_t size)
+	{
+		auto r = _compress(msgid, _block_empty ? seq : seq - _seq, data, size);
+		if (!r.data)
+			return EINVAL;
+
+		size_t frame = sizeof(frame_size_t) + r.size + 1;
+		if (frame > _block)
+			return EMSGSIZE;
+
+		if (_pos + frame > _block) {
+			if (_pos + sizeof(frame_size_t) < _block) {
+				*(frame_size_t *) (_buf.data() + _pos) = -1;
+				_pos += sizeof(frame_size_t);
+			}
+			if (auto r = _flush(); r)
+				return r;
+			_offset += _block;
+			static constexpr uint8_t header[5] = {5, 0, 0, 0, 0x80};
+			memcpy(_buf.data(), header, sizeof(header));
+			_pos = sizeof(header);
+			_block_empty = true;
+
+			_lz4.reset();
+			r = _compress(msgid, seq, data, size);
+			if (!r.data)
+				return EINVAL;
+			frame = sizeof(frame_size_t) + r.size + 1;
+		}
+
+		if (_block_empty)
+			index.push_back({ seq, _offset });
+		_block_empty = false;
+		_seq = seq;
+
+		*(frame_size_t *) (_buf.data() + _pos) = frame;
+		memcpy(_buf.data() + _pos + sizeof(frame_size_t), r.data, r.size);
+		_buf[_pos + frame - 1] = 0x80;
+		_pos += frame;
+		return 0;
+	}
+
+	int finish()
+	{
+		if (auto r = _flush(); r)
+			return r;
+		if (fsync(_fd))
+			return errno;
+		return 0;
+	}
+
+	size_t size() const { return _offset + _pos; }
+
+ private:
+	tll::const_memory _compress(int msgid, long long seq, const void * data, size_t size)
+	{
+		auto view = _lz4.view();
+		if (sizeof(frame_t) + size > _block)
+			return { nullptr, 0 };
+		*view.dataT<frame_t>() = frame_t { msgid, seq };
+		memcpy(view.view(sizeof(frame_t)).data(), data, size);
+		return _lz4.compress(_lz4_buf, sizeof(frame_t) + size, 0);
+	}
+
+	int _flush()
+	{
+		if (pwrite(_fd, _buf.data(), _pos, _offset) != (ssize_t) _pos)
+			return errno ? errno : EIO;
+		return 0;
+	}
+};
+}
+
+int tll::file::archive(const std::string &from, const std::string &to, int level, std::string &error, const std::atomic<bool> * stop)
+{
+	auto fd = ::open(from.c_str(), O_RDONLY);
+	if (fd == -1) {
+		error = fmt::format("Failed to open file {}: {}", from, strerror(errno));
+		return EINVAL;
+	}
+	std::unique_ptr<int, void (*)(int *)> _fd = { &fd, [](int * fd) { ::close(*fd); } };
+
+	struct stat s;
+	if (fstat(fd, &s)) {
+		error = fmt::format("Failed to get file info: {}", strerror(errno));
+		return EINVAL;
+	}
+
+	full_frame_t frame;
+	if (pread(fd, &frame, sizeof(frame), 0) != sizeof(frame) || frame.frame.msgid != file_scheme::Meta::meta_id()) {
+		error = fmt::format("Failed to read meta frame from {}", from);
+		return EINVAL;
+	}
+	if (frame.size < (ssize_t) (sizeof(frame) + file_scheme::Meta::offset_dictionary + 1)) {
+		error = fmt::format("Invalid meta frame size: {}", (int) frame.size);
+		return EINVAL;
+	}
+
+	std::vector<char> meta(frame.size);
+	if (pread(fd, meta.data(), meta.size(), 0) != (ssize_t) meta.size()) {
+		error = fmt::format("Failed to read meta from {}", from);
+		return EINVAL;
+	}
+
+	auto view = tll::make_view(meta).view(sizeof(frame)); // Tail marker is left in view, it does not change field offsets
+	auto bind = file_scheme::Meta::bind(view);
+	const size_t block = bind.get_block();
+	auto compression = (Compression) bind.get_compression();
+	if (compression != Compression::None && compression != Compression::LZ4) {
+		error = fmt::format("Unsupported compression {}", (int) compression);
+		return EINVAL;
+	}
+
+	std::vector<char> dict;
+	if (bind.get_meta_size() >= file_scheme::Meta::offset_dictionary + sizeof(tll_scheme_offset_ptr_t)) {
+		auto d = bind.get_dictionary();
+		if (d.size()) {
+			auto ptr = (const char *) &*d.begin();
+			dict.assign(ptr, ptr + d.size());
+		}
+	}
+
+	BlockDecoder decoder;
+	if (decoder.init(block, compression, { dict.data(), dict.size() })) {
+		error = fmt::format("Failed to init decoder for block size {}", block);
+		return EINVAL;
+	}
+
+	bind.set_compression(file_scheme::Meta::Compression::LZ4);
+
+	auto ofd = ::open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC, s.st_mode & 0777);
+	if (ofd == -1) {
+		error = fmt::format("Failed to create file {}: {}", to, strerror(errno));
+		return EINVAL;
+	}
+	std::unique_ptr<int, void (*)(int *)> _ofd = { &ofd, [](int * fd) { ::close(*fd); } };
+
+	ArchiveWriter writer;
+	if (writer.init(ofd, block, { dict.data(), dict.size() }, level)) {
+		error = fmt::format("Failed to init lz4 encoder for block size {}", block);
+		return EINVAL;
+	}
+	writer.meta(meta.data(), meta.size());
+
+	Block data;
+	for (size_t offset = 0; offset < (size_t) s.st_size; offset += block) {
+		if (stop && *stop) {
+			error = "Cancelled";
+			return ECANCELED;
+		}
+
+		if (auto r = decoder.decode(fd, offset, data); r && r != EAGAIN) {
+			error = fmt::format("Failed to decode block at 0x{:x}", offset);
+			return r;
+		}
+
+		for (auto & m : data.messages) {
+			if (auto r = writer.write(m.msgid, m.seq, data.body(m), m.size); r) {
+				error = fmt::format("Failed to write message {} at 0x{:x}: {}", m.seq, m.offset, strerror(r));
+				return r;
+			}
+		}
+	}
+
+	if (auto r = writer.finish(); r) {
+		error = fmt::format("Failed to write file {}: {}", to, strerror(r));
+		return r;
+	}
+
+	struct stat os;
+	if (fstat(ofd, &os)) {
+		error = fmt::format("Failed to get file info: {}", strerror(errno));
+		return EINVAL;
+	}
+
+	index_header_t header;
+	header.block = block;
+	header.size = writer.size();
+	header.inode = os.st_ino;
+
+	auto idx = to + ".idx";
+	auto ifd = ::open(idx.c_str(), O_WRONLY | O_CREAT | O_TRUNC, s.st_mode & 0777);
+	if (ifd == -1) {
+		error = fmt::format("Failed to create index file {}: {}", idx, strerror(errno));
+		return EINVAL;
+	}
+	std::unique_ptr<int, void (*)(int *)> _ifd = { &ifd, [](int * fd) { ::close(*fd); } };
+
+	const size_t size = writer.index.size() * sizeof(index_entry_t);
+	if (pwrite(ifd, &header, sizeof(header), 0) != sizeof(header) || pwrite(ifd, writer.index.data(), size, sizeof(header)) != (ssize_t) size) {
+		error = fmt::format("Failed to write index file {}: {}", idx, strerror(errno));
+		return EINVAL;
+	}
+	return 0;
+}
@@ -0,0 +1,225 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Pavel Shramov <shramov@mexmat.net>
+
+#ifndef _TLL_CHANNEL_FILE_BLOCK_H
+#define _TLL_CHANNEL_FILE_BLOCK_H
+
+#include "channel/file.h"
+
+#include "tll/logger.h"
+#include "tll/util/lz4block.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace tll::file {
+
+/// Fully decoded file block, messages are stored in one contiguous buffer
+struct Block
+{
+	struct Message
+	{
+		size_t offset; ///< File offset of the frame
+		size_t frame; ///< Full frame size, including size and tail marker
+		int msgid;
+		long long seq;
+		size_t data; ///< Offset of message body in data buffer
+		size_t size;
+	};
+
+	size_t offset = 0;
+	bool complete = false; ///< Block is finished and no new data can be appended to it
+	std::vector<Message> messages;
+	std::vector<char> data;
+
+	const void * body(const Message &m) const { return data.data() + m.data; }
+
+	/// Approximate memory used by decoded block
+	size_t memory() const { return sizeof(*this) + data.capacity() + messages.capacity() * sizeof(Message); }
+};
+
+/**
+ * Process wide LRU cache of complete decoded blocks shared by all file readers
+ *
+ * Blocks are identified by device, inode, file identity and offset. Complete blocks are never
+ * changed, but inode number of removed or replaced file can be reused by new one, so identity
+ * (birth time or change time, see @ref identity) is part of the key and blocks of the old file are
+ * never matched. Evicted blocks are kept alive while they are used by readers.
+ */
+class BlockCache
+{
+ public:
+	struct Key
+	{
+		dev_t dev = 0;
+		ino_t ino = 0;
+		uint64_t id = 0; ///< File identity, distinguishes files with reused inode number
+		size_t offset = 0;
+
+		bool operator < (const Key &rhs) const
+		{
+			return std::tie(dev, ino, id, offset) < std::tie(rhs.dev, rhs.ino, rhs.id, rhs.offset);
+		}
+	};
+
+	static BlockCache & instance();
+
+	/**
+	 * Get key of the file without offset
+	 *
+	 * Identity is file birth time if filesystem reports it, otherwise change time mixed with file
+	 * size. Change time is updated on each write or rename, in this case readers opened at different
+	 * times do not share blocks but never get blocks of another file.
+	 */
+	static int key(int fd, Key &key);
+
+	/// Add memory reservation, budget is the largest of active reservations
+	void reserve(size_t size);
+	/// Drop reservation made by @ref reserve, cache is shrunk to new budget
+	void release(size_t size);
+
+	std::shared_ptr<const Block> get(const Key &key);
+	void put(const Key &key, std::shared_ptr<const Block> block);
+
+	/// Drop all cached blocks
+	void clear();
+
+	size_t budget() const { return _budget; }
+	size_t size() const { return _size; }
+
+ private:
+	using entry_t = std::pair<Key, std::shared_ptr<const Block>>;
+
+	void _evict();
+
+	std::mutex _lock;
+	std::multiset<size_t> _reserved; ///< Active reservations
+	size_t _budget = 0;
+	size_t _size = 0;
+	std::list<entry_t> _lru; ///< Recently used blocks are in the front
+	std::map<Key, std::list<entry_t>::iterator> _index;
+};
+
+/// Decoder for whole blocks, independent from reader position in the file
+class BlockDecoder
+{
+	const tll::Logger * _log = nullptr;
+	size_t _block_size = 0;
+	Compression _compression = Compression::None;
+
+	std::vector<char> _buf;
+	tll::lz4::StreamDecode _lz4;
+
+ public:
+	/// Logger is optional, decoder used from helper thread reports only error codes
+	BlockDecoder(const tll::Logger * log = nullptr) : _log(log) {}
+
+	int init(size_t block, Compression compression, tll::const_memory dict = {});
+
+	/**
+	 * Decode block at given offset.
+	 *
+	 * @return 0 if block is complete, EAGAIN if block is not finished yet (messages that are
+	 * already available are filled in ``block``), error code otherwise.
+	 */
+	int decode(int fd, size_t offset, Block &block);
+
+	/**
+	 * Read seq of first message in the block without decoding whole block.
+	 *
+	 * @return 0 on success, EAGAIN if block has no messages, error code otherwise.
+	 */
+	int first(int fd, size_t offset, long long &seq);
+
+ private:
+	template <typename... Args>
+	int _fail(int r, tll::logger::format_string<Args...> format, Args && ... args)
+	{
+		if (_log)
+			return _log->fail(r, format, std::forward<Args>(args)...);
+		return r;
+	}
+};
+
+/**
+ * Helper thread that decodes blocks ahead of reader position
+ *
+ * Thread does not write any logs so it can not block on logger that is waiting for main thread. If
+ * block can not be decoded it is skipped and reader processes it inline, reporting errors.
+ */
+class Readahead
+{
+	int _fd = -1;
+	size_t _block_size = 0;
+	size_t _depth = 0;
+
+	BlockDecoder _decoder;
+
+	BlockCache * _cache = nullptr;
+	BlockCache::Key _cache_key = {};
+
+	std::mutex _lock;
+	std::condition_variable _cond;
+	std::thread _thread;
+	bool _stop = false;
+
+	size_t _position = 0; ///< First block that is not yet consumed by the reader
+	size_t _tail = -1; ///< First unfinished block for current position
+	std::map<size_t, std::shared_ptr<const Block>> _blocks;
+
+ public:
+	Readahead() = default;
+	~Readahead() { stop(); }
+
+	int start(int fd, size_t block, Compression compression, tll::const_memory dict, size_t depth, size_t position);
+	void stop();
+
+	/// Take blocks that are already present in cache instead of decoding them, set before start
+	void cache(BlockCache * cache, const BlockCache::Key &key) { _cache = cache; _cache_key = key; }
+
+	/**
+	 * Get decoded block at offset and move readahead window past it.
+	 *
+	 * @return block or nullptr if it is not decoded yet, in this case reader is expected to
+	 * process it by itself.
+	 */
+	std::shared_ptr<const Block> get(size_t offset);
+
+ private:
+	void _run();
+	size_t _next();
+};
+
+/**
+ * Load block index for opened data file
+ *
+ * @return 0 if index is loaded, ENOENT if it is missing or does not match data file, error code
+ * otherwise.
+ */
+int index_load(const std::string &filename, int fd, size_t block, std::vector<index_entry_t> &index);
+
+/**
+ * Recompress finished data file with LZ4 and build block index for it.
+ *
+ * Result is written into ``to`` and ``to + ".idx"`` files. Function does not log anything so it can
+ * be used from helper thread, error description is stored in ``error``.
+ *
+ * @param level LZ4 HC compression level, 0 for default fast mode
+ * @param stop optional flag that is checked after each block, job is cancelled when it is set
+ */
+int archive(const std::string &from, const std::string &to, int level, std::string &error, const std::atomic<bool> * stop = nullptr);
+
+} // namespace tll::file
+
+#endif//_TLL_CHANNEL_FILE_BLOCK_H
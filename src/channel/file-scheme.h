@@ -5,12 +5,14 @@
 
 namespace file_scheme {
 
-static constexpr std::string_view scheme_string = R"(yamls+gz://eJyFksFOwzAMhu97Ct8ioVZK2MhCbwyJE/AAIITSzhvRmnRqUiSY+u6k7VrSlomb5Xy2/99ODEZqTIDcOVeqtHJIFgA7hfnWJj4CiOF0RuSAROC+jk3K+ozZk3pCfsq8+ouK+2lP6GQzSG0TYHx5Q5mgnPkEmkqfB5P7Qh9LtFYVhiRw6ppVyjgRtZzPkceXlX9jEZDnwqAPad2ISZXruzzkcm/H9XwVdQS8vtUX7Wqv8d2q78BIU8z43C6WrcgRJ2ZYFvgZ0NDktCDNi+ww7rq8nlE2+0D9/0127R4GqlvLFBpOHJBXv18juOCm1dafUFDG12txSxc/YuiwqA==)";
+static constexpr std::string_view scheme_string = R"(yamls+gz://eJyFksFOwzAMhu97Ct8ioVZKtpGF3hgSJ8YDgBBK22xENOnUpJPG1HcnbdeQtiBulvPZ/n87MWiuRALo3tpKprUVaAGwl6LITeIigBguV4R7JAJ7PrYp4zL6gJoJeeJF/RsVD9N2wvJ2kMwTIHR1iwnDlLiE0LW6DkYPpTpWwhhZapTApW9WS21Z1HEuh55e1u6NRICeSy1ciJtWTCrt0OWx4AczrqfrqCfg9a35065yGt+N/AqMtMWEzu2KqhM54tgMywI/Hg1NTgvSosw+x11Xyxllsg+h/r/JvtuDp/q1TCF/4oC8+fkaUzyXmXXCeXUO8MG8P/a2szFcm2FCNxt2hxffgEm9zg==)";
 
 struct Attribute
 {
 	static constexpr size_t meta_size() { return 16; }
 	static constexpr std::string_view meta_name() { return "Attribute"; }
+	static constexpr size_t offset_attribute = 0;
+	static constexpr size_t offset_value = 8;
 
 	template <typename Buf>
 	struct binder_type : public tll::scheme::Binder<Buf>
@@ -21,11 +23,11 @@ struct Attribute
 		static constexpr auto meta_name() { return Attribute::meta_name(); }
 		void view_resize() { this->_view_resize(meta_size()); }
 
-		std::string_view get_attribute() const { return this->template _get_string<tll_scheme_offset_ptr_t>(0); }
-		void set_attribute(std::string_view v) { return this->template _set_string<tll_scheme_offset_ptr_t>(0, v); }
+		std::string_view get_attribute() const { return this->template _get_string<tll_scheme_offset_ptr_t>(offset_attribute); }
+		void set_attribute(std::string_view v) { return this->template _set_string<tll_scheme_offset_ptr_t>(offset_attribute, v); }
 
-		std::string_view get_value() const { return this->template _get_string<tll_scheme_offset_ptr_t>(8); }
-		void set_value(std::string_view v) { return this->template _set_string<tll_scheme_offset_ptr_t>(8, v); }
+		std::string_view get_value() const { return this->template _get_string<tll_scheme_offset_ptr_t>(offset_value); }
+		void set_value(std::string_view v) { return this->template _set_string<tll_scheme_offset_ptr_t>(offset_value, v); }
 	};
 
 	template <typename Buf>
@@ -37,9 +39,17 @@ struct Attribute
 
 struct Meta
 {
-	static constexpr size_t meta_size() { return 32; }
+	static constexpr size_t meta_size() { return 40; }
 	static constexpr std::string_view meta_name() { return "Meta"; }
 	static constexpr int meta_id() { return 1635018061; }
+	static constexpr size_t offset_meta_size = 0;
+	static constexpr size_t offset_version = 2;
+	static constexpr size_t offset_compression = 3;
+	static constexpr size_t offset_block = 4;
+	static constexpr size_t offset_scheme = 8;
+	static constexpr size_t offset_flags = 16;
+	static constexpr size_t offset_attributes = 24;
+	static constexpr size_t offset_dictionary = 32;
 
 	enum class Compression: uint8_t
 	{
@@ -68,31 +78,35 @@ struct Meta
 		void view_resize() { this->_view_resize(meta_size()); }
 
 		using type_meta_size = uint16_t;
-		type_meta_size get_meta_size() const { return this->template _get_scalar<type_meta_size>(0); }
-		void set_meta_size(type_meta_size v) { return this->template _set_scalar<type_meta_size>(0, v); }
+		type_meta_size get_meta_size() const { return this->template _get_scalar<type_meta_size>(offset_meta_size); }
+		void set_meta_size(type_meta_size v) { return this->template _set_scalar<type_meta_size>(offset_meta_size, v); }
 
 		using type_version = uint8_t;
-		type_version get_version() const { return this->template _get_scalar<type_version>(2); }
-		void set_version(type_version v) { return this->template _set_scalar<type_version>(2, v); }
+		type_version get_version() const { return this->template _get_scalar<type_version>(offset_version); }
+		void set_version(type_version v) { return this->template _set_scalar<type_version>(offset_version, v); }
 
 		using type_compression = Compression;
-		type_compression get_compression() const { return this->template _get_scalar<type_compression>(3); }
-		void set_compression(type_compression v) { return this->template _set_scalar<type_compression>(3, v); }
+		type_compression get_compression() const { return this->template _get_scalar<type_compression>(offset_compression); }
+		void set_compression(type_compression v) { return this->template _set_scalar<type_compression>(offset_compression, v); }
 
 		using type_block = uint32_t;
-		type_block get_block() const { return this->template _get_scalar<type_block>(4); }
-		void set_block(type_block v) { return this->template _set_scalar<type_block>(4, v); }
+		type_block get_block() const { return this->template _get_scalar<type_block>(offset_block); }
+		void set_block(type_block v) { return this->template _set_scalar<type_block>(offset_block, v); }
 
-		std::string_view get_scheme() const { return this->template _get_string<tll_scheme_offset_ptr_t>(8); }
-		void set_scheme(std::string_view v) { return this->template _set_string<tll_scheme_offset_ptr_t>(8, v); }
+		std::string_view get_scheme() const { return this->template _get_string<tll_scheme_offset_ptr_t>(offset_scheme); }
+		void set_scheme(std::string_view v) { return this->template _set_string<tll_scheme_offset_ptr_t>(offset_scheme, v); }
 
 		using type_flags = Flags;
-		type_flags get_flags() const { return this->template _get_scalar<type_flags>(16); }
-		void set_flags(type_flags v) { return this->template _set_scalar<type_flags>(16, v); }
+		type_flags get_flags() const { return this->template _get_scalar<type_flags>(offset_flags); }
+		void set_flags(type_flags v) { return this->template _set_scalar<type_flags>(offset_flags, v); }
 
 		using type_attributes = tll::scheme::binder::List<Buf, Attribute::binder_type<Buf>, tll_scheme_offset_ptr_t>;
-		const type_attributes get_attributes() const { return this->template _get_binder<type_attributes>(24); }
-		type_attributes get_attributes() { return this->template _get_binder<type_attributes>(24); }
+		const type_attributes get_attributes() const { return this->template _get_binder<type_attributes>(offset_attributes); }
+		type_attributes get_attributes() { return this->template _get_binder<type_attributes>(offset_attributes); }
+
+		using type_dictionary = tll::scheme::binder::List<Buf, uint8_t, tll_scheme_offset_ptr_t>;
+		const type_dictionary get_dictionary() const { return this->template _get_binder<type_dictionary>(offset_dictionary); }
+		type_dictionary get_dictionary() { return this->template _get_binder<type_dictionary>(offset_dictionary); }
 	};
 
 	template <typename Buf>
@@ -6,6 +6,7 @@
  */
 
 #include "channel/file.h"
+#include "channel/file-block.h"
 #include "channel/file-init.h"
 #include "channel/file-scheme.h"
 
@@ -42,9 +43,15 @@ static constexpr std::string_view control_scheme = R"(yamls://
   id: 10
 - name: EndOfData
   id: 20
+- name: Lookup
+  id: 30
 )";
 static constexpr int control_seek_msgid = 10;
 static constexpr int control_eod_msgid = 20;
+static constexpr int control_lookup_msgid = 30;
+
+// Meta written before dictionary field was added
+static constexpr size_t meta_size_min = file_scheme::Meta::offset_dictionary;
 
 #ifdef __APPLE__
 #if MAC_OS_X_VERSION_MIN_REQUIRED <= 1010
@@ -63,12 +70,6 @@ ssize_t pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset)
 #define MAP_POPULATE 0
 #endif
 
-struct __attribute__((packed)) full_frame_t
-{
-	frame_size_t size = 0;
-	frame_t frame;
-};
-
 struct IOBase
 {
 	int fd = -1;
@@ -231,6 +232,12 @@ std::optional<const tll_channel_impl_t *> tll::channel::FileInit::_init_replace(
 	return &File<IOMMap>::impl;
 }
 
+template <typename TIO>
+File<TIO>::File() = default;
+
+template <typename TIO>
+File<TIO>::~File() = default;
+
 template <typename TIO>
 int File<TIO>::_init(const tll::Channel::Url &url, tll::Channel *master)
 {
@@ -239,14 +246,20 @@ int File<TIO>::_init(const tll::Channel::Url &url, tll::Channel *master)
 	auto reader = this->channel_props_reader(url);
 	_block_init = reader.getT("block", util::Size {1024 * 1024});
 	_compression_init = reader.getT("compression", Compression::None, {{"none", Compression::None}, {"lz4", Compression::LZ4}});
+	_compression_level = reader.getT("compression-level", 0);
 	_autoclose = reader.getT("autoclose", true);
 	_tail_extra_size = reader.getT("extra-space", util::Size { 0 });
 	_access_mode = reader.getT("access-mode", 0644u);
+	_readahead_depth = reader.getT("readahead", 0u);
+	_block_cache_size = reader.getT("block-cache", util::Size { 0 });
+	auto dict = reader.getT("dict", std::string());
 	if (!reader)
 		return this->_log.fail(EINVAL, "Invalid url: {}", reader.error());
 
 	if (_access_mode > 0777)
 		return this->_log.fail(EINVAL, "Invalid file access-mode parameter: 0{:o} greater then maximum 0777", _access_mode);
+	if (_compression_level < 0 || _compression_level > LZ4HC_CLEVEL_MAX)
+		return this->_log.fail(EINVAL, "Invalid compression-level {}: must be in range [0, {}]", _compression_level, LZ4HC_CLEVEL_MAX);
 
 	_filename = url.host();
 
@@ -255,6 +268,17 @@ int File<TIO>::_init(const tll::Channel::Url &url, tll::Channel *master)
 	if ((this->internal.caps & caps::InOut) == caps::InOut)
 		return this->_log.fail(EINVAL, "file:// can be either read-only or write-only, need proper dir in parameters");
 
+	_lz4_dict_init.clear();
+	if (dict.size() && (this->internal.caps & caps::Output)) {
+		if (_compression_init != Compression::LZ4)
+			return this->_log.fail(EINVAL, "Dictionary can be used only with lz4 compression");
+		if (auto r = tll::lz4::load_dictionary(dict, _lz4_dict_init); r)
+			return this->_log.fail(EINVAL, "Failed to load dictionary from '{}': {}", dict, strerror(r));
+		if (_lz4_dict_init.empty())
+			return this->_log.fail(EINVAL, "Empty dictionary file '{}'", dict);
+		this->_log.info("Loaded {} bytes of lz4 dictionary from '{}'", _lz4_dict_init.size(), dict);
+	}
+
 	if (_io.name() == "mmap" && _tail_extra_size == 0)
 		_tail_extra_size = 1;
 
@@ -273,6 +297,7 @@ int File<TIO>::_open(const ConstConfig &props)
 	auto filename = _filename;
 	_end_of_data = false;
 	_compression = _compression_init;
+	_lz4_dict = _lz4_dict_init;
 
 	if (filename.empty()) {
 		auto fn = props.get("filename");
@@ -304,6 +329,11 @@ int File<TIO>::_open(const ConstConfig &props)
 		if (_io.init(this->_log, _block_size, IOBase::Read))
 			return this->_log.fail(EINVAL, "Failed to init io");
 
+		if (auto r = index_load(filename, _io.fd, _block_size, _index); r == 0)
+			this->_log.info("Loaded block index with {} entries", _index.size());
+		else if (r != ENOENT)
+			this->_log.warning("Failed to load block index for {}: {}", filename, strerror(r));
+
 		if (_compression == Compression::LZ4) {
 			if (auto r = _lz4_init(_block_size); r)
 				return r;
@@ -322,6 +352,33 @@ int File<TIO>::_open(const ConstConfig &props)
 			if (auto r = _seek_start(); r)
 				return this->_log.fail(EINVAL, "Failed to seek to first message");
 		}
+
+		_decoded_fail = -1;
+		if (_block_cache_size) {
+			BlockCache::Key key;
+			if (auto r = BlockCache::key(_io.fd, key); r)
+				return this->_log.fail(EINVAL, "Failed to get file info: {}", strerror(r));
+			_file_dev = key.dev;
+			_file_ino = key.ino;
+			_file_id = key.id;
+
+			_block_cache = &BlockCache::instance();
+			_block_cache->reserve(_block_cache_size);
+			this->_log.info("Use shared block cache, budget {}", util::Size { _block_cache->budget() });
+
+			_block_decoder.reset(new BlockDecoder(&this->_log));
+			if (_block_decoder->init(_block_size, _compression, { _lz4_dict.data(), _lz4_dict.size() }))
+				return this->_log.fail(EINVAL, "Failed to init block decoder");
+		}
+
+		if (_readahead_depth) {
+			this->_log.info("Decode up to {} blocks ahead in helper thread", _readahead_depth);
+			_readahead.reset(new Readahead);
+			if (_block_cache)
+				_readahead->cache(_block_cache, { _file_dev, _file_ino, _file_id, 0 });
+			if (_readahead->start(_io.fd, _block_size, _compression, { _lz4_dict.data(), _lz4_dict.size() }, _readahead_depth, _io.offset))
+				return this->_log.fail(EINVAL, "Failed to start readahead thread");
+		}
 		this->_update_dcaps(dcaps::Process | dcaps::Pending);
 	} else {
 		auto overwrite = reader.getT("overwrite", false);
@@ -406,6 +463,15 @@ int File<TIO>::_open(const ConstConfig &props)
 template <typename TIO>
 int File<TIO>::_close()
 {
+	_readahead.reset();
+	_decoded_block.reset();
+	_block_decoder.reset();
+	if (_block_cache)
+		_block_cache->release(_block_cache_size);
+	_block_cache = nullptr;
+	_lookup_decoder.reset();
+	_lookup_block.reset();
+
 	if (_io.fd != -1)
 		::close(_io.fd);
 	_io.reset();
@@ -467,8 +533,10 @@ int File<TIO>::_read_meta()
 	buf.resize(buf.size() - 1);
 
 	auto meta = file_scheme::Meta::bind(buf);
-	if (buf.size() < meta.meta_size())
-		return this->_log.fail(EINVAL, "Invalid meta size: {} less then minimum {}", buf.size(), meta.meta_size());
+	if (buf.size() < meta_size_min)
+		return this->_log.fail(EINVAL, "Invalid meta size: {} less then minimum {}", buf.size(), meta_size_min);
+	if (buf.size() < meta.get_meta_size())
+		return this->_log.fail(EINVAL, "Invalid meta size: {} less then declared {}", buf.size(), meta.get_meta_size());
 
 	_block_size = meta.get_block();
 	auto comp = meta.get_compression();
@@ -486,6 +554,18 @@ int File<TIO>::_read_meta()
 
 	this->_log.info("Meta info: block size {}, compression {}", _block_size, _compression);
 
+	_lz4_dict.clear();
+	if (meta.get_meta_size() >= file_scheme::Meta::offset_dictionary + sizeof(tll_scheme_offset_ptr_t)) {
+		auto dict = meta.get_dictionary();
+		if (dict.size()) {
+			if (_compression != Compression::LZ4)
+				return this->_log.fail(EINVAL, "Dictionary is present in uncompressed file");
+			auto ptr = (const char *) &*dict.begin();
+			_lz4_dict.assign(ptr, ptr + dict.size());
+			this->_log.info("Meta info: lz4 dictionary size {}", _lz4_dict.size());
+		}
+	}
+
 	std::string_view scheme = meta.get_scheme();
 	if (this->_scheme) {
 		if (scheme.size())
@@ -510,8 +590,10 @@ int File<TIO>::_write_meta()
 
 	auto view = tll::make_view(buf, sizeof(full_frame_t));
 	auto meta = file_scheme::Meta::bind(view);
-	view.resize(meta.meta_size());
-	meta.set_meta_size(meta.meta_size());
+	// Keep old meta layout if there is no dictionary so file can be read by older versions
+	const size_t meta_size = _lz4_dict.size() ? meta.meta_size() : meta_size_min;
+	view.resize(meta_size);
+	meta.set_meta_size(meta_size);
 	meta.set_block(_block_size);
 	meta.set_compression((file_scheme::Meta::Compression)_compression);
 
@@ -522,9 +604,18 @@ int File<TIO>::_write_meta()
 		meta.set_scheme(*s);
 	}
 
+	if (_lz4_dict.size()) {
+		auto dict = meta.get_dictionary();
+		dict.resize(_lz4_dict.size());
+		memcpy(&*dict.begin(), _lz4_dict.data(), _lz4_dict.size());
+	}
+
 	buf.push_back(0x80u);
 
-	this->_log.info("Write {} bytes of metadata ({})", buf.size(), meta.meta_size());
+	if (buf.size() > _block_size)
+		return this->_log.fail(EINVAL, "Metadata size {} is larger then block size {}", buf.size(), _block_size);
+
+	this->_log.info("Write {} bytes of metadata ({})", buf.size(), meta_size);
 
 	view = tll::make_view(buf);
 	*view.dataT<frame_size_t>() = buf.size();
@@ -660,6 +751,9 @@ int File<TIO>::_seek_start()
 template <typename TIO>
 int File<TIO>::_seek(long long seq)
 {
+	_decoded_block.reset();
+	_decoded_fail = -1;
+
 	auto size = _file_size();
 	if (size < 0)
 		return EINVAL;
@@ -667,42 +761,50 @@ int File<TIO>::_seek(long long seq)
 	tll_msg_t msg;
 
 	size_t first = 0;
-	size_t last = (size + _block_size - 1) / _block_size - 1;
+	if (_index.size()) {
+		auto it = std::upper_bound(_index.begin(), _index.end(), seq, [](long long seq, const index_entry_t &e) { return seq < e.seq; });
+		if (it != _index.begin())
+			it--;
+		first = it->offset / _block_size;
+		this->_log.debug("Block {} from index for seq {}", first, seq);
+	} else {
+		size_t last = (size + _block_size - 1) / _block_size - 1;
 
-	for (; last > 0; last--) {
-		auto r = _block_seq(last, &msg);
-		if (r == 0) {
-			this->_log.trace("Found data in block {}: seq {}", last, msg.seq);
-			break;
-		} else if (r != EAGAIN)
-			return this->_log.fail(EINVAL, "Failed to read seq of block {}", last);
-	}
-	++last;
+		for (; last > 0; last--) {
+			auto r = _block_seq(last, &msg);
+			if (r == 0) {
+				this->_log.trace("Found data in block {}: seq {}", last, msg.seq);
+				break;
+			} else if (r != EAGAIN)
+				return this->_log.fail(EINVAL, "Failed to read seq of block {}", last);
+		}
+		++last;
 
-	if (auto r = _block_seq(0, &msg); r)
-		return r; // Error or empty file
+		if (auto r = _block_seq(0, &msg); r)
+			return r; // Error or empty file
 
-	first = _io.block_end / _block_size - 1; // Meta fill first block
+		first = _io.block_end / _block_size - 1; // Meta fill first block
 
-	//if (*seq < msg.seq)
-	//	return this->_log.warning(EINVAL, "Seek seq {} failed: first data seq is {}", seq, msg->seq);
+		//if (*seq < msg.seq)
+		//	return this->_log.warning(EINVAL, "Seek seq {} failed: first data seq is {}", seq, msg->seq);
 
-	while (first + 1 < last) {
-		this->_log.debug("Bisect blocks {} and {}", first, last);
-		auto mid = (first + last) / 2;
-		auto r = _block_seq(mid, &msg);
-		if (r == EAGAIN) { // Empty block
-			last = mid;
-			continue;
-		} else if (r)
-			return r;
-		this->_log.trace("Block {} seq: {}", mid, msg.seq);
-		if (msg.seq == seq)
-			return 0;
-		if (msg.seq > seq)
-			last = mid;
-		else
-			first = mid;
+		while (first + 1 < last) {
+			this->_log.debug("Bisect blocks {} and {}", first, last);
+			auto mid = (first + last) / 2;
+			auto r = _block_seq(mid, &msg);
+			if (r == EAGAIN) { // Empty block
+				last = mid;
+				continue;
+			} else if (r)
+				return r;
+			this->_log.trace("Block {} seq: {}", mid, msg.seq);
+			if (msg.seq == seq)
+				return 0;
+			if (msg.seq > seq)
+				last = mid;
+			else
+				first = mid;
+		}
 	}
 
 	if (auto r = _shift_block(first * _block_size); r)
@@ -739,6 +841,87 @@ int File<TIO>::_seek(long long seq)
 	return 0;
 }
 
+template <typename TIO>
+int File<TIO>::_lookup(const tll_msg_t *req)
+{
+	const auto seq = req->seq;
+
+	if (!_lookup_decoder) {
+		_lookup_decoder.reset(new BlockDecoder(&this->_log));
+		if (_lookup_decoder->init(_block_size, _compression, { _lz4_dict.data(), _lz4_dict.size() }))
+			return this->_log.fail(EINVAL, "Failed to init lookup decoder");
+	}
+
+	auto size = _file_size();
+	if (size < 0)
+		return EINVAL;
+
+	size_t block = 0;
+	if (_index.size()) {
+		auto it = std::upper_bound(_index.begin(), _index.end(), seq, [](long long seq, const index_entry_t &e) { return seq < e.seq; });
+		if (it != _index.begin())
+			it--;
+		block = it->offset / _block_size;
+	} else {
+		// Find last block with first seq not greater then requested, only tail blocks can be empty
+		size_t last = (size + _block_size - 1) / _block_size;
+		while (block + 1 < last) {
+			auto mid = (block + last) / 2;
+			long long first;
+			auto r = _lookup_decoder->first(_io.fd, mid * _block_size, first);
+			if (r == EAGAIN) {
+				last = mid;
+				continue;
+			} else if (r)
+				return this->_log.fail(EINVAL, "Failed to read first seq of block {}", mid);
+			if (first <= seq)
+				block = mid;
+			else
+				last = mid;
+		}
+	}
+
+	auto data = _lookup_get(block * _block_size);
+	if (!data)
+		return this->_log.fail(EINVAL, "Failed to decode block {}", block);
+
+	auto it = std::lower_bound(data->messages.begin(), data->messages.end(), seq, [](const Block::Message &m, long long seq) { return m.seq < seq; });
+	if (it == data->messages.end() || it->seq != seq) {
+		this->_log.debug("Lookup seq {}: not found", seq);
+		return ENOENT;
+	}
+
+	tll_msg_t msg = { TLL_MESSAGE_DATA };
+	msg.msgid = it->msgid;
+	msg.seq = it->seq;
+	msg.data = data->body(*it);
+	msg.size = it->size;
+	msg.addr = req->addr;
+	this->_callback_data(&msg);
+	return 0;
+}
+
+template <typename TIO>
+std::shared_ptr<const Block> File<TIO>::_lookup_get(size_t offset)
+{
+	if (_lookup_block && _lookup_block->offset == offset && _lookup_block->complete)
+		return _lookup_block;
+
+	const BlockCache::Key key = { _file_dev, _file_ino, _file_id, offset };
+	if (_block_cache) {
+		if (auto block = _block_cache->get(key); block)
+			return _lookup_block = block;
+	}
+
+	auto block = std::make_shared<Block>();
+	auto r = _lookup_decoder->decode(_io.fd, offset, *block);
+	if (r && r != EAGAIN)
+		return nullptr;
+	if (!r && _block_cache)
+		_block_cache->put(key, block);
+	return _lookup_block = block;
+}
+
 template <typename TIO>
 int File<TIO>::_block_seq(size_t block, tll_msg_t *msg)
 {
@@ -801,7 +984,8 @@ int File<TIO>::_post(const tll_msg_t *msg, int flags)
 						this->_log.info("Requested seq {} not available in file", msg->seq);
 					return r;
 				}
-			}
+			} else if (msg->msgid == control_lookup_msgid)
+				return _lookup(msg);
 			return 0;
 		}
 		return ENOSYS;
@@ -1019,12 +1203,115 @@ int File<TIO>::_read_data(size_t size, tll_msg_t *msg)
 	return 0;
 }
 
+template <typename TIO>
+std::shared_ptr<const Block> File<TIO>::_decoded_get(size_t offset)
+{
+	std::shared_ptr<const Block> block;
+	if (_block_cache) {
+		block = _block_cache->get({ _file_dev, _file_ino, _file_id, offset });
+		if (block) {
+			this->_log.trace("Use cached block at 0x{:x}", offset);
+			if (this->_stat_enable) {
+				auto page = stat()->acquire();
+				if (page) {
+					page->cache_hit = 1;
+					stat()->release(page);
+				}
+			}
+		}
+	}
+
+	// Readahead window is moved even if block is taken from cache
+	auto decoded = _readahead ? _readahead->get(offset) : nullptr;
+	if (block)
+		return block;
+
+	if (!_block_cache)
+		return decoded;
+
+	if (!decoded) {
+		auto b = std::make_shared<Block>();
+		if (auto r = _block_decoder->decode(_io.fd, offset, *b); r) // Block is not finished or broken
+			return nullptr;
+		decoded = std::move(b);
+	}
+
+	_block_cache->put({ _file_dev, _file_ino, _file_id, offset }, decoded);
+	if (this->_stat_enable) {
+		auto page = stat()->acquire();
+		if (page) {
+			page->cache_miss = 1;
+			stat()->release(page);
+		}
+	}
+	return decoded;
+}
+
+template <typename TIO>
+int File<TIO>::_process_decoded()
+{
+	if (!_decoded_block) {
+		size_t offset = _io.block_end;
+		if (_io.offset + sizeof(full_frame_t) + 1 <= _io.block_end) {
+			// Current block is not finished, it can be taken from cache after seek
+			if (!_block_cache)
+				return EAGAIN;
+			offset = _io.block_end - _block_size;
+		}
+		if (offset == _decoded_fail)
+			return EAGAIN; // Continue inline reading
+		_decoded_block = _decoded_get(offset);
+		if (!_decoded_block) {
+			_decoded_fail = offset;
+			return EAGAIN;
+		}
+		this->_log.trace("Use decoded block at 0x{:x}", _decoded_block->offset);
+		_decoded_index = 0;
+		auto & messages = _decoded_block->messages;
+		while (_decoded_index < messages.size() && messages[_decoded_index].offset < _io.offset)
+			_decoded_index++;
+		// IO is not moved to new block, it is done on fallback in _read_frame
+		_io.block_end = _decoded_block->offset + _block_size;
+		_io.offset = std::max(_io.offset, _decoded_block->offset);
+	}
+
+	auto block = _decoded_block;
+	if (_decoded_index == block->messages.size()) {
+		_decoded_block.reset();
+		_shift_skip();
+		return _process_decoded();
+	}
+
+	auto & m = block->messages[_decoded_index++];
+	_io.offset = m.offset + m.frame;
+	if (_decoded_index == block->messages.size()) {
+		// Block is complete, next message is in the following block
+		_decoded_block.reset();
+		_shift_skip();
+	}
+
+	tll_msg_t msg = { TLL_MESSAGE_DATA };
+	msg.msgid = m.msgid;
+	msg.seq = m.seq;
+	msg.data = block->body(m);
+	msg.size = m.size;
+
+	this->_dcaps_pending(true);
+	this->_callback_data(&msg);
+	return 0;
+}
+
 template <typename TIO>
 int File<TIO>::_process(long timeout, int flags)
 {
 	tll_msg_t msg = { TLL_MESSAGE_DATA };
 	frame_size_t frame;
 
+	if (_readahead || _block_cache) {
+		if (auto r = _process_decoded(); r != EAGAIN)
+			return r;
+	}
+
 	if (_io.offset + _io.block_size == _io.block_end) {
 		frame_size_t frame;
 		if (auto r = _read_frame_nocheck(&frame); r)
@@ -13,6 +13,10 @@
 #include "tll/util/lz4block.h"
 #include "tll/util/memoryview.h"
 
+#include <memory>
+
+#include <sys/types.h>
+
 struct iovec;
 
 namespace tll::file {
@@ -28,8 +32,36 @@ struct __attribute__((packed)) frame_t
 	int64_t seq = 0;
 };
 
+struct __attribute__((packed)) full_frame_t
+{
+	frame_size_t size = 0;
+	frame_t frame;
+};
+
 enum class Compression : uint8_t { None = 0, LZ4 = 1};
 
+/// Header of block index file, stored next to data file with additional ``.idx`` suffix
+struct __attribute__((packed)) index_header_t
+{
+	char magic[4] = {'T', 'L', 'L', 'I'};
+	uint32_t version = 1;
+	uint64_t block = 0; ///< Block size of data file
+	uint64_t size = 0; ///< Size of data file
+	uint64_t inode = 0; ///< Inode of data file, it is not changed by rename so stale index is detected
+};
+
+/// Index entry: seq of first message in the block and block offset
+struct __attribute__((packed)) index_entry_t
+{
+	int64_t seq;
+	uint64_t offset;
+};
+
+struct Block;
+class BlockCache;
+class BlockDecoder;
+class Readahead;
+
 template <typename TIO>
 class File : public tll::channel::AutoSeq<File<TIO>>
 {
@@ -54,14 +86,45 @@ class File : public tll::channel::AutoSeq<File<TIO>>
 	ssize_t _lz4_decode_offset = -1;
 	tll::lz4::StreamEncode _lz4_encode;
 	std::vector<char> _lz4_buf;
+	std::vector<char> _lz4_dict, _lz4_dict_init; ///< Preset dictionary from meta and from init parameters
+
+	size_t _readahead_depth = 0;
+	std::unique_ptr<Readahead> _readahead;
+
+	size_t _block_cache_size = 0;
+	BlockCache * _block_cache = nullptr;
+	std::unique_ptr<BlockDecoder> _block_decoder;
+	dev_t _file_dev = 0;
+	ino_t _file_ino = 0;
+	uint64_t _file_id = 0; ///< File identity in block cache, see BlockCache::key
+
+	std::vector<index_entry_t> _index; ///< Block index loaded from sidecar file
+
+	std::unique_ptr<BlockDecoder> _lookup_decoder;
+	std::shared_ptr<const Block> _lookup_block; ///< Last block used for lookup
+
+	std::shared_ptr<const Block> _decoded_block; ///< Block from readahead thread or cache
+	size_t _decoded_index = 0;
+	size_t _decoded_fail = -1; ///< Block that is not available in decoded form, read inline
 
 	long long _delta_seq_base = 0;
 	Compression _compression, _compression_init;
+	int _compression_level = 0; ///< LZ4 HC level, 0 for default fast mode
 	bool _autoclose = true;
 	bool _end_of_data = false;
 	unsigned _access_mode = 0644;
 
 public:
+	struct StatType : public Base::StatType
+	{
+		tll::stat::Integer<tll::stat::Sum, tll::stat::Unknown, 'c', 'h', 'i', 't'> cache_hit;
+		tll::stat::Integer<tll::stat::Sum, tll::stat::Unknown, 'c', 'm', 'i', 's', 's'> cache_miss;
+	};
+	tll::stat::BlockT<StatType> * stat() { return static_cast<tll::stat::BlockT<StatType> *>(this->internal.stat); }
+
+	File();
+	~File();
+
 	static constexpr std::string_view channel_protocol() { return IO::protocol(); }
 	static constexpr std::string_view param_prefix() { return "file"; }
 	static constexpr auto process_policy() { return Base::ProcessPolicy::Custom; }
@@ -77,6 +140,8 @@ private:
 	int _read_frame(frame_size_t *);
 	int _read_frame_nocheck(frame_size_t *);
 	int _read_data(size_t size, tll_msg_t *msg);
+	int _process_decoded();
+	std::shared_ptr<const Block> _decoded_get(size_t offset);
 
 	size_t _data_size(frame_size_t frame) { return frame - sizeof(frame) - 1; }
 
@@ -107,10 +172,10 @@ private:
 	{
 		if (this->internal.caps & caps::Output) {
 			_lz4_buf.resize(LZ4_compressBound(block));
-			if (_lz4_encode.init(block))
+			if (_lz4_encode.init(block, tll::const_memory { _lz4_dict.data(), _lz4_dict.size() }, _compression_level))
 				return this->_log.fail(EINVAL, "Failed to init lz4 encoder with block size {}", block);
 		}
-		if (_lz4_decode.init(block))
+		if (_lz4_decode.init(block, tll::const_memory { _lz4_dict.data(), _lz4_dict.size() }))
 			return this->_log.fail(EINVAL, "Failed to init lz4 decoder with block size {}", block);
 		_lz4_decode_offset = -1;
 		_lz4_decode_last = {};
@@ -131,6 +196,8 @@ private:
 	ssize_t _file_size();
 
 	int _seek(long long seq);
+	int _lookup(const tll_msg_t *msg);
+	std::shared_ptr<const Block> _lookup_get(size_t offset);
 	int _seek_start();
 	int _block_seq(size_t block, tll_msg_t *msg);
 	int _read_seq(frame_size_t frame, tll_msg_t *msg);
@@ -0,0 +1,512 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Pavel Shramov <shramov@mexmat.net>
+
+#include "channel/lvc.h"
+#include "channel/blocks.scheme.h"
+
+#include "tll/util/size.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace tll::channel;
+using namespace tll::channel::lvc;
+
+TLL_DEFINE_IMPL(LastValue);
+
+namespace {
+/// FNV-1a hash, stable between runs since table is persistent
+uint64_t key_hash(const char * data, size_t size)
+{
+	uint64_t h = 0xcbf29ce484222325ull;
+	for (auto end = data + size; data != end; data++) {
+		h ^= (uint8_t) *data;
+		h *= 0x100000001b3ull;
+	}
+	return h | 1; // Zero is reserved for empty slot
+}
+}
+
+int Mapping::map(int fd, size_t size, bool write)
+{
+	reset();
+	if (size == 0)
+		return 0;
+	auto r = mmap(nullptr, size, PROT_READ | (write ? PROT_WRITE : 0), MAP_SHARED, fd, 0);
+	if (r == MAP_FAILED)
+		return errno;
+	data = (char *) r;
+	this->size = size;
+	return 0;
+}
+
+void Mapping::reset()
+{
+	if (data)
+		munmap(data, size);
+	data = nullptr;
+	size = 0;
+}
+
+int LastValue::_init(const tll::Channel::Url &url, tll::Channel *master)
+{
+	if ((internal.caps & caps::InOut) == 0) // Defaults to input
+		internal.caps |= caps::Input;
+
+	if (internal.caps & caps::Output) {
+		_scheme_control.reset(context().scheme_load(blocks_scheme::scheme_string));
+		if (!_scheme_control.get())
+			return _log.fail(EINVAL, "Failed to load control scheme");
+	}
+
+	if (master) {
+		_master = tll::channel_cast<LastValue>(master);
+		if (!_master)
+			return _log.fail(EINVAL, "Need lvc:// master, got invalid channel {}", master->name());
+		if ((internal.caps & caps::InOut) != caps::Input)
+			return _log.fail(EINVAL, "Slave channel can be only created in input mode for reading");
+		return 0;
+	}
+
+	if ((internal.caps & caps::InOut) == caps::InOut)
+		return _log.fail(EINVAL, "lvc:// can be either read-only or write-only, need proper dir in parameters");
+
+	auto reader = channel_props_reader(url);
+	_default_type = reader.getT<std::string>("default-type", "default");
+	_key_field = reader.getT<std::string>("key", "");
+	_data_size = reader.getT<tll::util::Size>("data-size", 256);
+	_capacity = reader.getT<unsigned>("capacity", 1024);
+	if (!reader)
+		return _log.fail(EINVAL, "Invalid parameters: {}", reader.error());
+
+	_directory = url.host();
+	if (!_directory.size())
+		return _log.fail(EINVAL, "Empty lvc directory");
+	if (_capacity == 0)
+		return _log.fail(EINVAL, "Zero table capacity");
+	_data_size = (_data_size + 7) & ~7ul;
+
+	return 0;
+}
+
+int LastValue::_open(const tll::ConstConfig &cfg)
+{
+	_seq = -1;
+
+	if (auto r = Base::_open(cfg); r)
+		return r;
+
+	if (internal.caps & caps::Input)
+		return _open_input(cfg);
+	return _open_output();
+}
+
+int LastValue::_open_output()
+{
+	_keys.clear();
+	size_t key_size = 0;
+	if (_key_field.size()) {
+		if (!_scheme)
+			return _log.fail(EINVAL, "Key field '{}' requires scheme", _key_field);
+		for (auto m = _scheme->messages; m; m = m->next) {
+			auto f = m->lookup(_key_field);
+			if (!f || !m->msgid)
+				continue;
+			if (f->type == f->Pointer)
+				return _log.fail(EINVAL, "Key field '{}' in message {} is not fixed size", _key_field, m->name);
+			_keys[m->msgid] = Key { f->offset, f->size };
+			key_size = std::max<size_t>(key_size, f->size);
+		}
+		if (_keys.empty())
+			return _log.fail(EINVAL, "Key field '{}' not found in any message", _key_field);
+	}
+	_key_size = (sizeof(int32_t) + key_size + 7) & ~7ul;
+	_key.resize(_key_size);
+
+	std::error_code ec;
+	std::filesystem::create_directories(_directory, ec);
+	if (ec)
+		return _log.fail(EINVAL, "Failed to create directory {}: {}", _directory, ec.message());
+
+	if (_load_blocks())
+		return _log.fail(EINVAL, "Failed to load list of blocks");
+	if (_table_open())
+		return _log.fail(EINVAL, "Failed to open hash table");
+
+	config_info().set_ptr("seq", &_seq);
+	config_info().set("seq-begin", "-1");
+
+	state(state::Active);
+	return 0;
+}
+
+int LastValue::_load_blocks()
+{
+	_blocks.clear();
+
+	std::error_code ec;
+	for (auto & e : std::filesystem::directory_iterator(_directory, ec)) {
+		auto name = e.path().filename().string();
+		if (e.path().extension() != ".lvc")
+			continue;
+		name.resize(name.size() - 4);
+		auto sep = name.rfind('.');
+		if (sep == name.npos || sep == 0)
+			continue;
+		auto seq = conv::to_any<long long>(std::string_view(name).substr(sep + 1));
+		if (!seq)
+			continue;
+		_blocks[name.substr(0, sep)].push_back(*seq);
+	}
+	if (ec)
+		return _log.fail(EINVAL, "Failed to list directory {}: {}", _directory, ec.message());
+
+	for (auto & [k, v] : _blocks) {
+		v.sort();
+		_log.debug("Loaded {} '{}' blocks", v.size(), k);
+	}
+	return 0;
+}
+
+int LastValue::_table_open()
+{
+	auto filename = _directory + "/table.dat";
+	_fd = ::open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+	if (_fd == -1)
+		return _log.fail(EINVAL, "Failed to open table file {}: {}", filename, strerror(errno));
+
+	struct stat s;
+	if (fstat(_fd, &s))
+		return _log.fail(EINVAL, "Failed to get table file size: {}", strerror(errno));
+	if (s.st_size == 0) {
+		_log.info("Create new table in {}, capacity {}", filename, _capacity);
+		return _table_init(_capacity);
+	}
+
+	table_header_t header;
+	if (pread(_fd, &header, sizeof(header), 0) != sizeof(header))
+		return _log.fail(EINVAL, "Failed to read table header: {}", strerror(errno));
+	if (header.magic != table_magic || header.version != version)
+		return _log.fail(EINVAL, "Invalid table header in {}: magic 0x{:x}, version {}", filename, header.magic, header.version);
+	if (header.key_size != _key_size || header.data_size != _data_size)
+		return _log.fail(EINVAL, "Table {} is created with different key or data size: {}/{}, need {}/{}",
+			filename, header.key_size, header.data_size, _key_size, _data_size);
+	auto size = sizeof(header) + header.capacity * _slot_size();
+	if ((size_t) s.st_size < size)
+		return _log.fail(EINVAL, "Table file {} is truncated: {} < {}", filename, s.st_size, size);
+	if (auto r = _table.map(_fd, size, true); r)
+		return _log.fail(EINVAL, "Failed to map table file {}: {}", filename, strerror(r));
+	_seq = header.seq;
+	_log.info("Loaded table with {} entries, last seq {}", header.count, _seq);
+	return 0;
+}
+
+int LastValue::_table_init(size_t capacity)
+{
+	_table.reset();
+	auto size = sizeof(table_header_t) + capacity * _slot_size();
+	if (ftruncate(_fd, 0) || ftruncate(_fd, size))
+		return _log.fail(EINVAL, "Failed to resize table file to {}: {}", size, strerror(errno));
+	if (auto r = _table.map(_fd, size, true); r)
+		return _log.fail(EINVAL, "Failed to map table file: {}", strerror(r));
+	auto header = _header();
+	header->magic = table_magic;
+	header->version = version;
+	header->key_size = _key_size;
+	header->data_size = _data_size;
+	header->capacity = capacity;
+	header->count = 0;
+	header->seq = _seq;
+	return 0;
+}
+
+int LastValue::_table_grow()
+{
+	auto header = _header();
+	auto capacity = header->capacity * 2;
+	_log.info("Grow table from {} to {} slots", header->capacity, capacity);
+
+	// Build larger table next to current one and replace it only when it is complete
+	auto filename = _directory + "/table.dat";
+	auto tmp = filename + ".tmp";
+	auto fd = ::open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1)
+		return _log.fail(EINVAL, "Failed to create table file {}: {}", tmp, strerror(errno));
+
+	auto r = _table_rehash(fd, capacity);
+	if (!r && fsync(fd))
+		r = _log.fail(EINVAL, "Failed to sync table file {}: {}", tmp, strerror(errno));
+	if (!r && rename(tmp.c_str(), filename.c_str()))
+		r = _log.fail(EINVAL, "Failed to rename table file {}: {}", tmp, strerror(errno));
+	if (r) {
+		::close(fd);
+		unlink(tmp.c_str());
+		return r;
+	}
+
+	::close(_fd);
+	_fd = fd;
+	_table.reset();
+	auto size = sizeof(table_header_t) + capacity * _slot_size();
+	if (auto r = _table.map(_fd, size, true); r)
+		return _log.fail(EINVAL, "Failed to map table file {}: {}", filename, strerror(r));
+	return 0;
+}
+
+int LastValue::_table_rehash(int fd, size_t capacity)
+{
+	lvc::Mapping table;
+	auto size = sizeof(table_header_t) + capacity * _slot_size();
+	if (ftruncate(fd, size))
+		return _log.fail(EINVAL, "Failed to resize table file to {}: {}", size, strerror(errno));
+	if (auto r = table.map(fd, size, true); r)
+		return _log.fail(EINVAL, "Failed to map table file: {}", strerror(r));
+
+	auto header = (table_header_t *) table.data;
+	*header = *_header();
+	header->capacity = capacity;
+
+	for (size_t i = 0; i < _header()->capacity; i++) {
+		auto from = _slot(_table.data, i);
+		if (!from->hash)
+			continue;
+		auto slot = _table_lookup(table.data, from->hash, (const char *) (from + 1));
+		if (!slot)
+			return _log.fail(EINVAL, "No free slot while rehashing table, capacity {}", capacity);
+		if (slot->hash)
+			return _log.fail(EINVAL, "Duplicate key in table, slot {} seq {}", i, from->seq);
+		memcpy((void *) slot, from, _slot_size());
+	}
+	return 0;
+}
+
+slot_header_t * LastValue::_table_lookup(char * table, uint64_t hash, const char * key)
+{
+	auto capacity = ((const table_header_t *) table)->capacity;
+	auto idx = hash % capacity;
+	for (size_t i = 0; i < capacity; i++, idx = (idx + 1) % capacity) {
+		auto slot = _slot(table, idx);
+		if (slot->hash == 0)
+			return slot;
+		if (slot->hash == hash && !memcmp(slot + 1, key, _key_size))
+			return slot;
+	}
+	return nullptr;
+}
+
+int LastValue::_key_fill(const tll_msg_t *msg)
+{
+	memset(_key.data(), 0, _key.size());
+	memcpy(_key.data(), &msg->msgid, sizeof(msg->msgid));
+	auto it = _keys.find(msg->msgid);
+	if (it == _keys.end())
+		return 0;
+	auto & key = it->second;
+	if (msg->size < key.offset + key.size)
+		return _log.fail(EMSGSIZE, "Message {} size {} is less then key field end {}", msg->msgid, msg->size, key.offset + key.size);
+	memcpy(_key.data() + sizeof(msg->msgid), ((const char *) msg->data) + key.offset, key.size);
+	return 0;
+}
+
+int LastValue::_open_input(const tll::ConstConfig &cfg)
+{
+	auto reader = tll::make_props_reader(cfg);
+	auto block = reader.getT<unsigned>("block");
+	auto type = reader.getT<std::string>("block-type", (_master ? _master : this)->_default_type);
+	if (!reader)
+		return _log.fail(EINVAL, "Invalid open parameters: {}", reader.error());
+
+	if (!_master) {
+		if (_load_blocks())
+			return _log.fail(EINVAL, "Failed to load list of blocks");
+	}
+	auto self = _master ? _master : this;
+	auto & blocks = self->_blocks;
+
+	auto it = blocks.find(type);
+	if (it == blocks.end())
+		return _log.fail(EINVAL, "Unknown block type '{}'", type);
+	ssize_t size = it->second.size();
+	if (size == 0)
+		return _log.fail(EINVAL, "No known blocks of type '{}'", type);
+	if (block >= size)
+		return _log.fail(EINVAL, "Requested block '{}' too large: {} > max {}", type, block, size - 1);
+	auto i = it->second.rbegin();
+	std::advance(i, block);
+	_seq = *i;
+
+	auto filename = self->_snapshot_path(type, _seq);
+	auto fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd == -1)
+		return _log.fail(EINVAL, "Failed to open snapshot {}: {}", filename, strerror(errno));
+	struct stat s;
+	if (fstat(fd, &s)) {
+		::close(fd);
+		return _log.fail(EINVAL, "Failed to get snapshot size: {}", strerror(errno));
+	}
+	auto r = _snapshot.map(fd, s.st_size, false);
+	::close(fd);
+	if (r)
+		return _log.fail(EINVAL, "Failed to map snapshot {}: {}", filename, strerror(r));
+
+	auto header = (const snapshot_header_t *) _snapshot.data;
+	if (_snapshot.size < sizeof(*header) || header->magic != snapshot_magic || header->version != version)
+		return _log.fail(EINVAL, "Invalid snapshot file {}", filename);
+	_offset = sizeof(*header);
+
+	long long begin = -1;
+	if (header->count) {
+		if (_snapshot.size < _offset + sizeof(entry_header_t))
+			return _log.fail(EINVAL, "Truncated snapshot file {}", filename);
+		begin = ((const entry_header_t *) (_snapshot.data + _offset))->seq;
+	}
+
+	_log.info("Translated block type '{}' number {} to seq {}, {} messages from seq {}", type, block, _seq, header->count, begin);
+	config_info().setT("seq", _seq);
+	config_info().setT("seq-begin", begin);
+
+	if (!header->count)
+		return close();
+
+	state(state::Active);
+	_update_dcaps(dcaps::Process | dcaps::Pending);
+	return 0;
+}
+
+int LastValue::_close()
+{
+	config_info().setT("seq", _seq);
+	_snapshot.reset();
+	_table.reset();
+	if (_fd != -1)
+		::close(_fd);
+	_fd = -1;
+	return Base::_close();
+}
+
+int LastValue::_process(long timeout, int flags)
+{
+	if (_offset + sizeof(entry_header_t) > _snapshot.size) {
+		_log.info("All messages processed. Closing");
+		close();
+		return EAGAIN;
+	}
+
+	auto entry = (const entry_header_t *) (_snapshot.data + _offset);
+	if (_offset + sizeof(*entry) + entry->size > _snapshot.size)
+		return state_fail(EINVAL, "Truncated entry at offset {}: size {}", _offset, entry->size);
+	_offset += sizeof(*entry) + entry->size;
+
+	tll_msg_t msg = { TLL_MESSAGE_DATA };
+	msg.msgid = entry->msgid;
+	msg.seq = entry->seq;
+	msg.size = entry->size;
+	msg.data = entry + 1;
+	_callback_data(&msg);
+	return 0;
+}
+
+int LastValue::_post(const tll_msg_t *msg, int flags)
+{
+	if (msg->type == TLL_MESSAGE_DATA) {
+		if (msg->seq <= _seq)
+			return _log.fail(EINVAL, "Non monotonic seq: {} <= last seq {}", msg->seq, _seq);
+		if (msg->size > _data_size)
+			return _log.fail(EMSGSIZE, "Message {} size {} is larger then data-size {}", msg->seq, msg->size, _data_size);
+		if (_key_fill(msg))
+			return EINVAL;
+		auto hash = key_hash(_key.data(), _key.size());
+		auto slot = _table_lookup(hash, _key.data());
+		if (!slot || !slot->hash) {
+			auto header = _header();
+			if ((header->count + 1) * 4 > header->capacity * 3) {
+				if (_table_grow())
+					return _log.fail(EINVAL, "Failed to grow table");
+				slot = _table_lookup(hash, _key.data());
+			}
+			if (!slot)
+				return _log.fail(EINVAL, "Table is full, capacity {}", _header()->capacity);
+			_header()->count++;
+			slot->hash = hash;
+			memcpy(slot + 1, _key.data(), _key.size());
+		}
+		slot->seq = msg->seq;
+		slot->msgid = msg->msgid;
+		slot->size = msg->size;
+		memcpy(((char *) (slot + 1)) + _key_size, msg->data, msg->size);
+		_seq = msg->seq;
+		_header()->seq = _seq;
+		return 0;
+	} else if (msg->type != TLL_MESSAGE_CONTROL)
+		return 0;
+
+	if (msg->msgid != blocks_scheme::Block::meta_id())
+		return _log.fail(EINVAL, "Invalid control message {}", msg->msgid);
+	if (_seq < 0)
+		return _log.fail(EINVAL, "Failed to make block: no data in storage");
+
+	auto data = blocks_scheme::Block::bind(*msg);
+	if (data.meta_size() > msg->size)
+		return _log.fail(EMSGSIZE, "Invalid Blocks message: size {} < min size {}", msg->size, data.meta_size());
+
+	auto block = data.get_type();
+	if (block.size() == 0) {
+		if (_default_type.empty())
+			return _log.fail(EINVAL, "Empty block name");
+		block = _default_type;
+	}
+
+	if (block.find('/') != block.npos)
+		return _log.fail(EINVAL, "Invalid block name '{}'", block);
+
+	return _snapshot_write(block);
+}
+
+int LastValue::_snapshot_write(std::string_view type)
+{
+	auto header = _header();
+	std::vector<const slot_header_t *> slots;
+	slots.reserve(header->count);
+	for (size_t i = 0; i < header->capacity; i++) {
+		auto slot = _slot(i);
+		if (slot->hash)
+			slots.push_back(slot);
+	}
+	std::sort(slots.begin(), slots.end(), [](auto l, auto r) { return l->seq < r->seq; });
+
+	std::vector<char> buf;
+	snapshot_header_t sheader = { snapshot_magic, version, slots.size(), _seq };
+	buf.insert(buf.end(), (const char *) &sheader, (const char *) (&sheader + 1));
+	for (auto slot : slots) {
+		entry_header_t entry = { slot->seq, slot->msgid, slot->size };
+		buf.insert(buf.end(), (const char *) &entry, (const char *) (&entry + 1));
+		auto data = ((const char *) (slot + 1)) + _key_size;
+		buf.insert(buf.end(), data, data + slot->size);
+	}
+
+	auto filename = _snapshot_path(type, _seq);
+	auto tmp = filename + ".tmp";
+	auto fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1)
+		return _log.fail(EINVAL, "Failed to create snapshot file {}: {}", tmp, strerror(errno));
+	auto r = write(fd, buf.data(), buf.size());
+	::close(fd);
+	if (r != (ssize_t) buf.size())
+		return _log.fail(EINVAL, "Failed to write snapshot file {}: {}", tmp, strerror(errno));
+	if (rename(tmp.c_str(), filename.c_str()))
+		return _log.fail(EINVAL, "Failed to rename snapshot file {}: {}", tmp, strerror(errno));
+
+	_log.info("Store block type {} at {}, {} messages", type, _seq, slots.size());
+	auto it = _blocks.find(type);
+	if (it == _blocks.end())
+		it = _blocks.emplace(type, std::list<long long>{}).first;
+	if (it->second.empty() || it->second.back() != _seq)
+		it->second.push_back(_seq);
+	return 0;
+}
@@ -0,0 +1,163 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Pavel Shramov <shramov@mexmat.net>
+
+#ifndef _TLL_CHANNEL_LVC_H
+#define _TLL_CHANNEL_LVC_H
+
+#include "tll/channel/base.h"
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace tll::channel {
+
+namespace lvc {
+
+static constexpr uint32_t table_magic = 0x43564c54; // "TLVC"
+static constexpr uint32_t snapshot_magic = 0x53564c54; // "TLVS"
+static constexpr uint32_t version = 1;
+
+/// Header of hash table file, followed by ``capacity`` slots
+struct table_header_t
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t key_size;
+	uint32_t data_size;
+	uint64_t capacity;
+	uint64_t count;
+	int64_t seq; ///< Last posted seq
+};
+
+/// Slot header, followed by ``key_size`` bytes of key and ``data_size`` bytes of data
+struct slot_header_t
+{
+	uint64_t hash; ///< Zero for empty slot
+	int64_t seq;
+	int32_t msgid;
+	uint32_t size;
+};
+
+/// Header of snapshot file, followed by ``count`` entries ordered by seq
+struct snapshot_header_t
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t count;
+	int64_t seq; ///< Seq of the block
+};
+
+/// Snapshot entry header, followed by ``size`` bytes of message data
+struct entry_header_t
+{
+	int64_t seq;
+	int32_t msgid;
+	uint32_t size;
+};
+
+static_assert(sizeof(table_header_t) == 40);
+static_assert(sizeof(slot_header_t) == 24);
+static_assert(sizeof(snapshot_header_t) == 24);
+static_assert(sizeof(entry_header_t) == 16);
+
+/// Read-only or shared writable file mapping
+struct Mapping
+{
+	char * data = nullptr;
+	size_t size = 0;
+
+	Mapping() = default;
+	Mapping(const Mapping &) = delete;
+	~Mapping() { reset(); }
+
+	int map(int fd, size_t size, bool write);
+	void reset();
+};
+
+} // namespace lvc
+
+/**
+ * Last value cache implementing blocks protocol
+ *
+ * Writer keeps last message for each key in hash table stored in memory mapped file, key is
+ * message id and value of configured field. On ``Block`` control message table is dumped into
+ * snapshot file, reader produces messages from selected snapshot in seq order.
+ */
+class LastValue : public tll::channel::Base<LastValue>
+{
+	using Base = tll::channel::Base<LastValue>;
+
+	/// Key field location in message
+	struct Key
+	{
+		size_t offset = 0;
+		size_t size = 0;
+	};
+
+	LastValue * _master = nullptr;
+
+	std::string _directory;
+	std::string _default_type;
+	std::string _key_field;
+	size_t _key_size = 16;
+	size_t _data_size = 256;
+	size_t _capacity = 1024;
+
+	std::map<int, Key> _keys; ///< Key fields of messages, messages without field are keyed by msgid
+
+	int _fd = -1;
+	lvc::Mapping _table;
+	long long _seq = -1;
+
+	std::map<std::string, std::list<long long>, std::less<>> _blocks;
+
+	lvc::Mapping _snapshot;
+	size_t _offset = 0;
+	std::vector<char> _key;
+
+ public:
+	static constexpr std::string_view channel_protocol() { return "lvc"; }
+	static constexpr auto open_policy() { return OpenPolicy::Manual; }
+	static constexpr auto process_policy() { return ProcessPolicy::Custom; }
+
+	int _init(const tll::Channel::Url &url, tll::Channel * master);
+	int _open(const tll::ConstConfig &);
+	int _close();
+
+	int _post(const tll_msg_t *msg, int flags);
+	int _process(long timeout, int flags);
+
+ private:
+	int _open_output();
+	int _open_input(const tll::ConstConfig &);
+
+	int _table_open();
+	int _table_init(size_t capacity);
+	/// Double table capacity and rehash all entries
+	int _table_grow();
+	/// Fill table of given capacity in file from current one
+	int _table_rehash(int fd, size_t capacity);
+	/// Find slot for key, returns empty slot if key is not found or nullptr if table is full
+	lvc::slot_header_t * _table_lookup(uint64_t hash, const char * key) { return _table_lookup(_table.data, hash, key); }
+	lvc::slot_header_t * _table_lookup(char * table, uint64_t hash, const char * key);
+
+	lvc::table_header_t * _header() { return (lvc::table_header_t *) _table.data; }
+	size_t _slot_size() const { return sizeof(lvc::slot_header_t) + _key_size + _data_size; }
+	lvc::slot_header_t * _slot(size_t idx) { return _slot(_table.data, idx); }
+	lvc::slot_header_t * _slot(char * table, size_t idx) { return (lvc::slot_header_t *) (table + sizeof(lvc::table_header_t) + idx * _slot_size()); }
+
+	int _key_fill(const tll_msg_t *msg);
+
+	int _load_blocks();
+	int _snapshot_write(std::string_view type);
+	std::string _snapshot_path(std::string_view type, long long seq) const
+	{
+		return fmt::format("{}/{}.{}.lvc", _directory, type, seq);
+	}
+};
+
+} // namespace tll::channel
+
+#endif//_TLL_CHANNEL_LVC_H
@@ -20,9 +20,27 @@ int ChLZ4::_init(const tll::Channel::Url &url, Channel *parent)
 	auto reader = channel_props_reader(url);
 	_level = reader.getT<int>("level", 1);
 	_max_size = reader.getT("max-size", tll::util::Size { 256 * 1024 });
+	auto dict = reader.getT("dict", std::string());
 	if (!reader)
 		return _log.fail(EINVAL, "Invalid url: {}", reader.error());
 
+	_dict.clear();
+	_dict_stream.reset();
+	_dict_work.reset();
+	if (dict.size()) {
+		if (auto r = tll::lz4::load_dictionary(dict, _dict); r)
+			return _log.fail(EINVAL, "Failed to load dictionary from '{}': {}", dict, strerror(r));
+		if (_dict.size() > tll::lz4::Ring::prefix_size) // Only last 64kb are used
+			_dict.erase(_dict.begin(), _dict.end() - tll::lz4::Ring::prefix_size);
+		_log.info("Loaded {} bytes of dictionary from '{}'", _dict.size(), dict);
+
+		_dict_stream.reset(LZ4_createStream());
+		_dict_work.reset(LZ4_createStream());
+		if (!_dict_stream || !_dict_work)
+			return _log.fail(ENOMEM, "Failed to create lz4 stream");
+		LZ4_loadDict(_dict_stream.get(), _dict.data(), _dict.size());
+	}
+
 	_lz4_enc.resize(LZ4_sizeofState());
 	_buffer_dec.resize(_max_size);
 	return Base::_init(url, parent);
@@ -36,7 +54,13 @@ const tll_msg_t * ChLZ4::_encode(const tll_msg_t *msg)
 		return _log.fail(nullptr, "Message size too large: {} > limit {}", msg->size, _max_size);
 	auto view = make_view(_buffer_enc);
 	view.resize(LZ4_compressBound(msg->size));
-	auto r = LZ4_compress_fast_extState(_lz4_enc.data(), (const char *) msg->data, view.dataT<char>(), msg->size, view.size(), _level);
+	int r = 0;
+	if (_dict_stream) {
+		// Dictionary stream is not modified, start each message from its copy instead of reloading dictionary
+		memcpy(_dict_work.get(), _dict_stream.get(), sizeof(LZ4_stream_t));
+		r = LZ4_compress_fast_continue(_dict_work.get(), (const char *) msg->data, view.dataT<char>(), msg->size, view.size(), _level);
+	} else
+		r = LZ4_compress_fast_extState(_lz4_enc.data(), (const char *) msg->data, view.dataT<char>(), msg->size, view.size(), _level);
 	if (!r)
 		return _log.fail(nullptr, "Failed to compress");
 	_log.trace("Compressed size: {}", r);
@@ -54,7 +78,11 @@ const tll_msg_t * ChLZ4::_decode(const tll_msg_t *msg)
 	auto view = make_view(*msg);
 	tll_msg_copy_info(&_msg_dec, msg);
 	//_buffer_dec.resize(_max_size);
-	auto r = LZ4_decompress_safe(view.dataT<char>(), _buffer_dec.data(), view.size(), _buffer_dec.size());
+	int r = 0;
+	if (_dict.size())
+		r = LZ4_decompress_safe_usingDict(view.dataT<char>(), _buffer_dec.data(), view.size(), _buffer_dec.size(), _dict.data(), _dict.size());
+	else
+		r = LZ4_decompress_safe(view.dataT<char>(), _buffer_dec.data(), view.size(), _buffer_dec.size());
 	if (r < 0)
 		return _log.fail(nullptr, "Failed to decompress");
 	_log.trace("Decompressed size: {}", r);
@@ -10,6 +10,8 @@
 
 #include "tll/channel/codec.h"
 
+#include "tll/util/lz4block.h"
+
 class ChLZ4 : public tll::channel::Codec<ChLZ4>
 {
 	using Base = tll::channel::Codec<ChLZ4>;
@@ -20,6 +22,10 @@ class ChLZ4 : public tll::channel::Codec<ChLZ4>
 	int _level = 0;
 	size_t _max_size = 0;
 
+	std::vector<char> _dict;
+	std::unique_ptr<LZ4_stream_t, tll::lz4::lz4_stream_delete> _dict_stream; ///< Stream with preloaded dictionary
+	std::unique_ptr<LZ4_stream_t, tll::lz4::lz4_stream_delete> _dict_work; ///< Copy of dictionary stream used for compression
+
  public:
 	static constexpr std::string_view channel_protocol() { return "lz4+"; }
 
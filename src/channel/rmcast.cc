@@ -0,0 +1,400 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Pavel Shramov <shramov@mexmat.net>
+
+#include "channel/rmcast.h"
+
+#include "tll/util/size.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace tll::channel;
+using namespace tll::channel::rmcast;
+
+TLL_DEFINE_IMPL(RMcast);
+
+int RMcast::_init(const tll::Channel::Url &url, tll::Channel *master)
+{
+	auto r = Base::_init(url, master);
+	if (r)
+		return _log.fail(r, "Base channel init failed");
+
+	auto reader = channel_props_reader(url);
+	_mode = reader.getT("mode", Mode::Publisher, {{"client", Mode::Publisher}, {"server", Mode::Subscriber}});
+	auto size = reader.getT<util::Size>("size", 1024 * 1024);
+	_heartbeat = reader.getT<tll::duration>("heartbeat", std::chrono::seconds(1));
+	_pending_max = reader.getT("reorder-size", 1024u);
+	_timeout = reader.getT<tll::duration>("request-timeout", std::chrono::milliseconds(100));
+	_request_retry = reader.getT("request-retry", 3u);
+	if (!reader)
+		return _log.fail(EINVAL, "Invalid url: {}", reader.error());
+	if (_mode == Mode::Subscriber && _timeout.count() == 0)
+		return _log.fail(EINVAL, "Zero request-timeout is invalid");
+
+	if (_mode == Mode::Publisher) {
+		_ring.resize(size / 64);
+		_ring.data_resize(size);
+	}
+
+	// Publisher sends heartbeats, subscriber repeats requests and checks for silent feed
+	auto interval = _mode == Mode::Publisher ? _heartbeat : _timeout;
+	if (interval.count()) {
+		auto turl = child_url_parse("timer://;clock=realtime", "timer");
+		if (!turl)
+			return _log.fail(EINVAL, "Failed to parse timer url: {}", turl.error());
+		turl->set("interval", conv::to_string(interval));
+		_timer = context().channel(*turl);
+		if (!_timer)
+			return _log.fail(EINVAL, "Failed to create timer channel");
+		_timer->callback_add<RMcast, &RMcast::_on_timer>(this, TLL_MESSAGE_MASK_DATA);
+		_child_add(_timer.get(), "timer");
+	}
+
+	auto curl = url.getT<tll::Channel::Url>("recovery");
+	if (!curl)
+		return _log.fail(EINVAL, "Failed to get recovery url: {}", curl.error());
+	child_url_fill(*curl, "recovery");
+	// Datagram replies can be reordered or lost relative to Done and udp server answers only last peer
+	std::string_view proto = curl->proto();
+	if (auto sep = proto.rfind('+'); sep != proto.npos)
+		proto = proto.substr(sep + 1);
+	if (proto == "udp" || proto == "mudp")
+		return _log.fail(EINVAL, "Datagram recovery channel is not supported: '{}', use stream one like tcp", curl->proto());
+	if (!curl->has("mode"))
+		curl->set("mode", _mode == Mode::Publisher ? "server" : "client");
+
+	_recovery = context().channel(*curl, master);
+	if (!_recovery)
+		return _log.fail(EINVAL, "Failed to create recovery channel");
+	_recovery->callback_add<RMcast, &RMcast::_on_recovery_state>(this, TLL_MESSAGE_MASK_STATE);
+	_recovery->callback_add<RMcast, &RMcast::_on_recovery_data>(this, TLL_MESSAGE_MASK_DATA);
+	_child_add(_recovery.get(), "recovery");
+
+	return 0;
+}
+
+int RMcast::_open(const tll::ConstConfig &cfg)
+{
+	_ring.clear();
+	_seq_posted = -1;
+	_posted = false;
+
+	_pending.clear();
+	_seq = -1;
+	_seq_last = -1;
+	_request_last = -1;
+	_request_count = 0;
+	_gap_time = {};
+	_received = _silent = false;
+	_recv_time = tll::time::now();
+
+	if (_timer && _timer->open())
+		return _log.fail(EINVAL, "Failed to open timer channel");
+	if (_recovery->open())
+		return _log.fail(EINVAL, "Failed to open recovery channel");
+	return Base::_open(cfg);
+}
+
+int RMcast::_close(bool force)
+{
+	_pending.clear();
+	if (_timer)
+		_timer->close(true);
+	if (_recovery->state() != tll::state::Closed)
+		_recovery->close(force || state() == tll::state::Error);
+	return Base::_close(force || state() == tll::state::Error);
+}
+
+int RMcast::_post(const tll_msg_t *msg, int flags)
+{
+	if (_mode != Mode::Publisher || msg->type != TLL_MESSAGE_DATA)
+		return _child->post(msg, flags);
+
+	if (msg->msgid == heartbeat_msgid)
+		return _log.fail(EINVAL, "Message id {} is reserved for heartbeats", heartbeat_msgid);
+
+	tll_frame_t frame = { (uint32_t) msg->size, msg->msgid, (int64_t) msg->seq };
+	if (sizeof(frame) + msg->size > _ring.data_capacity() / 2)
+		return _log.fail(EMSGSIZE, "Message too large for retransmit buffer {}: {}", _ring.data_capacity(), msg->size);
+
+	if (auto r = _child->post(msg, flags); r)
+		return r;
+	_seq_posted = msg->seq;
+	_posted = true;
+
+	while (_ring.push_back(frame, msg->data, msg->size) == nullptr)
+		_ring.pop_front();
+	return 0;
+}
+
+int RMcast::_on_recovery_state(const tll::Channel *, const tll_msg_t *msg)
+{
+	if (_mode != Mode::Subscriber)
+		return 0;
+	switch ((tll_state_t) msg->msgid) {
+	case tll::state::Active:
+		if (_seq_last > _seq)
+			return _request();
+		break;
+	case tll::state::Error:
+	case tll::state::Closed:
+		_request_last = -1;
+		break;
+	default:
+		break;
+	}
+	return 0;
+}
+
+int RMcast::_on_recovery_data(const tll::Channel *, const tll_msg_t *msg)
+{
+	if (_mode == Mode::Publisher) {
+		if (msg->msgid != (int) Recovery::Request)
+			return 0;
+		return _on_request(msg);
+	}
+
+	switch ((Recovery) msg->msgid) {
+	case Recovery::Data: {
+		if (msg->size < sizeof(tll_frame_t))
+			return _log.fail(EMSGSIZE, "Retransmitted message too small: {} < frame size {}", msg->size, sizeof(tll_frame_t));
+		auto frame = static_cast<const tll_frame_t *>(msg->data);
+		if (sizeof(tll_frame_t) + frame->size > msg->size)
+			return _log.fail(EMSGSIZE, "Retransmitted message {} truncated: {} < {}", frame->seq, msg->size, sizeof(tll_frame_t) + frame->size);
+		_stat_update([](auto page) { page->retrans = 1; });
+		return _on_message(frame, frame + 1, nullptr);
+	}
+	case Recovery::Done:
+		return _on_done(msg->seq);
+	default:
+		_log.debug("Unknown recovery message {}", msg->msgid);
+	}
+	return 0;
+}
+
+int RMcast::_on_request(const tll_msg_t *msg)
+{
+	if (msg->size < sizeof(request_t))
+		return _log.fail(EMSGSIZE, "Request too small: {} < {}", msg->size, sizeof(request_t));
+	auto first = msg->seq;
+	auto last = static_cast<const request_t *>(msg->data)->last;
+	_log.info("Retransmit request for {}..{}", first, last);
+
+	unsigned count = 0;
+	for (auto & e : _ring) {
+		if (e.frame->seq < first)
+			continue;
+		if (e.frame->seq > last)
+			break;
+		if (_post_recovery(Recovery::Data, e.frame->seq, e.begin(), sizeof(tll_frame_t) + e.size, msg->addr)) {
+			_log.error("Failed to retransmit message {}", e.frame->seq);
+			return 0;
+		}
+		count++;
+	}
+
+	if (!_ring.empty() && _ring.front().frame->seq > first)
+		_log.warning("Messages {}..{} are not available for retransmit", first, std::min(last, _ring.front().frame->seq - 1));
+	if (_post_recovery(Recovery::Done, last, nullptr, 0, msg->addr))
+		_log.error("Failed to post reply end for request {}..{}", first, last);
+	_stat_update([count](auto page) { page->request = 1; page->retrans = count; });
+	return 0;
+}
+
+int RMcast::_on_timer(const tll::Channel *, const tll_msg_t *)
+{
+	auto now = tll::time::now();
+	if (_mode == Mode::Publisher) {
+		if (_posted || _seq_posted == -1) {
+			_posted = false;
+			return 0;
+		}
+		tll_msg_t msg = { TLL_MESSAGE_DATA };
+		msg.msgid = heartbeat_msgid;
+		msg.seq = _seq_posted;
+		if (auto r = _child->post(&msg); r)
+			_log.warning("Failed to post heartbeat: {}", strerror(r));
+		return 0;
+	}
+
+	if (_received) {
+		_received = false;
+		_recv_time = now;
+		if (_silent)
+			_log.info("Feed is active again");
+		_silent = false;
+	} else if (_heartbeat.count() && _seq != -1 && !_silent && now - _recv_time > 3 * _heartbeat) {
+		_log.warning("No messages or heartbeats for {}ms, last seq {}", std::chrono::duration_cast<std::chrono::milliseconds>(now - _recv_time).count(), _seq);
+		_silent = true;
+	}
+
+	if (_seq_last <= _seq)
+		return 0;
+	if (_request_last != -1 && now - _request_time < _timeout)
+		return 0;
+
+	if (++_request_count > _request_retry) {
+		_log.error("No reply for retransmit request in {} attempts", _request_retry);
+		_request_last = -1;
+		_request_count = 0;
+		_skip(_gap_end());
+		if (auto r = _drain(); r)
+			return r;
+		return _request();
+	}
+	if (_request_last != -1)
+		_log.info("Retransmit request timed out, repeat");
+	return _request();
+}
+
+int RMcast::_on_data(const tll_msg_t *msg)
+{
+	if (_mode == Mode::Publisher)
+		return _callback_data(msg);
+
+	_received = true;
+	if (msg->msgid == heartbeat_msgid)
+		return _on_heartbeat(msg->seq);
+
+	if (msg->msgid == heartbeat_msgid)
+		return _log.fail(EINVAL, "Message id {} is reserved for heartbeats", heartbeat_msgid);
+
+	tll_frame_t frame = { (uint32_t) msg->size, msg->msgid, (int64_t) msg->seq };
+	return _on_message(&frame, msg->data, msg);
+}
+
+int RMcast::_on_message(const tll_frame_t *frame, const void *data, const tll_msg_t *orig)
+{
+	auto seq = frame->seq;
+	if (_seq == -1 || seq == _seq + 1) {
+		if (auto r = _deliver(frame, data, orig); r)
+			return r;
+		return _drain();
+	}
+
+	if (seq <= _seq) {
+		_log.trace("Drop duplicate message {}, last seq {}", seq, _seq);
+		return 0;
+	}
+
+	_gap_start(seq);
+
+	auto [it, inserted] = _pending.emplace(seq, std::vector<char>());
+	if (!inserted)
+		return 0;
+	it->second.resize(sizeof(tll_frame_t) + frame->size);
+	memcpy(it->second.data(), frame, sizeof(tll_frame_t));
+	memcpy(it->second.data() + sizeof(tll_frame_t), data, frame->size);
+
+	if (_pending.size() > _pending_max) {
+		_log.error("Too many out of order messages: {}, skip gap", _pending.size());
+		_skip(_pending.begin()->first - 1);
+		return _drain();
+	}
+
+	if (_request_last == -1)
+		return _request();
+	return 0;
+}
+
+int RMcast::_on_heartbeat(long long seq)
+{
+	if (_seq == -1) { // Stream starts after heartbeat
+		_log.debug("Start stream from heartbeat seq {}", seq);
+		_seq = _seq_last = seq;
+		return 0;
+	}
+	if (seq <= _seq_last)
+		return 0;
+
+	_gap_start(seq);
+	if (_request_last == -1)
+		return _request();
+	return 0;
+}
+
+void RMcast::_gap_start(long long seq)
+{
+	if (seq > _seq_last) {
+		if (_seq_last <= _seq) {
+			_log.info("Gap in stream: {} -> {}", _seq + 1, seq);
+			_gap_time = tll::time::now();
+			_stat_update([](auto page) { page->gap = 1; });
+		}
+		_seq_last = seq;
+	}
+}
+
+int RMcast::_drain()
+{
+	while (!_pending.empty()) {
+		auto it = _pending.begin();
+		if (it->first > _seq + 1)
+			break;
+		auto seq = it->first;
+		auto data = std::move(it->second); // Callback can close channel and clear pending map
+		_pending.erase(it);
+		if (seq <= _seq)
+			continue;
+
+		auto frame = (const tll_frame_t *) data.data();
+		if (auto r = _deliver(frame, frame + 1, nullptr); r)
+			return r;
+	}
+
+	if (_seq_last <= _seq && _gap_time != tll::time_point {}) {
+		auto dt = tll::time::now() - _gap_time;
+		_gap_time = {};
+		_log.debug("Gap closed in {}ns", dt.count());
+		_stat_update([dt](auto page) { page->recover = dt.count(); });
+	}
+	return 0;
+}
+
+void RMcast::_skip(long long seq)
+{
+	if (seq <= _seq)
+		return;
+	_log.error("Lost messages {}..{}", _seq + 1, seq);
+	_stat_update([n = seq - _seq](auto page) { page->lost = n; });
+	_seq = seq;
+}
+
+int RMcast::_request()
+{
+	if (_seq_last <= _seq)
+		return 0;
+	if (_recovery->state() != tll::state::Active) {
+		_log.debug("Recovery channel is not active, delay request");
+		return 0;
+	}
+
+	auto first = _seq + 1;
+	request_t request = { _gap_end() };
+	_log.info("Request retransmit of {}..{}", first, request.last);
+	_request_last = request.last;
+	_request_time = tll::time::now();
+	if (_post_recovery(Recovery::Request, first, &request, sizeof(request), {})) {
+		_log.error("Failed to post retransmit request");
+		_request_last = -1;
+		return 0;
+	}
+	_stat_update([](auto page) { page->request = 1; });
+	return 0;
+}
+
+int RMcast::_on_done(long long last)
+{
+	_log.debug("Retransmit of messages up to {} finished", last);
+	if (last == _request_last) {
+		_request_last = -1;
+		_request_count = 0;
+	}
+	if (last > _seq)
+		_skip(std::min(last, _gap_end()));
+	if (auto r = _drain(); r)
+		return r;
+	if (_request_last == -1 && _seq_last > _seq)
+		return _request();
+	return 0;
+}
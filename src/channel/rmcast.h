@@ -0,0 +1,180 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: Pavel Shramov <shramov@mexmat.net>
+
+#ifndef _TLL_CHANNEL_RMCAST_H
+#define _TLL_CHANNEL_RMCAST_H
+
+#include "tll/channel/frame.h"
+#include "tll/channel/prefix.h"
+#include "tll/util/cppring.h"
+#include "tll/util/time.h"
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+namespace tll::channel {
+
+namespace rmcast {
+
+/// Message ids used in recovery channel
+enum class Recovery : int
+{
+	Request = 1, ///< Request retransmit, seq is first missing seq, body is request_t
+	Data = 2, ///< Retransmitted message, seq is message seq, body is tll_frame_t and message data
+	Done = 3, ///< Reply is finished, seq is last requested seq
+};
+
+/// Msgid of publisher heartbeat in data channel, seq is last posted seq, body is empty. Reserved, not allowed in post
+static constexpr int heartbeat_msgid = -1;
+
+#pragma pack(push, 1)
+struct request_t
+{
+	int64_t last; ///< Last missing seq, inclusive
+};
+#pragma pack(pop)
+
+} // namespace rmcast
+
+/**
+ * Reliable multicast on top of datagram channel
+ *
+ * Publisher keeps ring of last posted messages and serves retransmit requests from recovery
+ * channel. Subscriber detects gaps in seq, buffers out of order messages and requests missing
+ * ones, user receives ordered stream without duplicates. Publisher sends heartbeats with last seq
+ * when there are no messages so loss of last messages is detected.
+ */
+class RMcast : public tll::channel::Prefix<RMcast>
+{
+	using Base = tll::channel::Prefix<RMcast>;
+
+	enum class Mode { Publisher, Subscriber };
+	Mode _mode = Mode::Subscriber;
+
+	std::unique_ptr<Channel> _recovery;
+	std::unique_ptr<Channel> _timer;
+
+	tll::duration _heartbeat = std::chrono::seconds(1);
+
+	/// Publisher: last posted messages, frame is followed by message data
+	tll::util::DataRing<tll_frame_t> _ring;
+	long long _seq_posted = -1; ///< Last posted seq, -1 if nothing was posted
+	bool _posted = false; ///< Messages were posted since last timer tick
+
+	/// Subscriber: out of order messages, tll_frame_t followed by data
+	std::map<long long, std::vector<char>> _pending;
+	size_t _pending_max = 1024;
+	long long _seq = -1; ///< Last delivered seq
+	long long _seq_last = -1; ///< Last seq known to be published, from messages or heartbeats
+	long long _request_last = -1; ///< Last seq of request in flight, -1 if there is no request
+	unsigned _request_count = 0; ///< Number of attempts for current gap
+	unsigned _request_retry = 3;
+	tll::time_point _request_time = {};
+	tll::time_point _gap_time = {}; ///< Time when current gap was detected
+	tll::duration _timeout = std::chrono::milliseconds(100);
+	bool _received = false; ///< Messages or heartbeats were received since last timer tick
+	bool _silent = false; ///< Feed silence is reported
+	tll::time_point _recv_time = {}; ///< Time of last timer tick with received messages
+
+ public:
+	static constexpr std::string_view channel_protocol() { return "rmcast+"; }
+
+	struct StatType : public Base::StatType
+	{
+		tll::stat::Integer<tll::stat::Sum, tll::stat::Unknown, 'g', 'a', 'p'> gap;
+		tll::stat::Integer<tll::stat::Sum, tll::stat::Unknown, 'l', 'o', 's', 't'> lost;
+		tll::stat::Integer<tll::stat::Sum, tll::stat::Unknown, 'r', 'e', 'q', 'u', 'e', 's', 't'> request;
+		tll::stat::Integer<tll::stat::Sum, tll::stat::Unknown, 'r', 'e', 't', 'r', 'a', 'n', 's'> retrans;
+		tll::stat::IntegerGroup<tll::stat::Ns, 'r', 'e', 'c', 'o', 'v', 'e', 'r'> recover;
+	};
+
+	tll::stat::BlockT<StatType> * stat() { return static_cast<tll::stat::BlockT<StatType> *>(this->internal.stat); }
+
+	int _init(const tll::Channel::Url &url, tll::Channel *master);
+	void _free()
+	{
+		_recovery.reset();
+		_timer.reset();
+		return Base::_free();
+	}
+
+	int _open(const tll::ConstConfig &cfg);
+	int _close(bool force);
+
+	int _post(const tll_msg_t *msg, int flags);
+
+	int _on_init(tll::Channel::Url &curl, const tll::Channel::Url &url, const tll::Channel * master)
+	{
+		curl.unlink("recovery");
+		return 0;
+	}
+
+	int _on_data(const tll_msg_t *msg);
+
+ private:
+	int _on_recovery_state(const tll::Channel *, const tll_msg_t *msg);
+	int _on_recovery_data(const tll::Channel *, const tll_msg_t *msg);
+	int _on_timer(const tll::Channel *, const tll_msg_t *msg);
+
+	/// Publisher: send requested messages from the ring
+	int _on_request(const tll_msg_t *msg);
+
+	/// Subscriber: handle message from data or recovery channel
+	int _on_message(const tll_frame_t *frame, const void *data, const tll_msg_t *orig);
+	/// Subscriber: handle publisher heartbeat
+	int _on_heartbeat(long long seq);
+	/// Register new gap if stream had no missing messages before
+	void _gap_start(long long seq);
+	/// Last seq that is missing before next buffered message or end of the stream
+	long long _gap_end() const { return _pending.empty() ? _seq_last : _pending.begin()->first - 1; }
+	/// Deliver pending messages that are in order
+	int _drain();
+	/// Skip missing messages up to seq, inclusive
+	void _skip(long long seq);
+	/// Request missing messages before first pending one or up to last known seq
+	int _request();
+	/// Recovery channel is finished with request
+	int _on_done(long long last);
+
+	template <typename F>
+	void _stat_update(F func)
+	{
+		if (!_stat_enable)
+			return;
+		auto page = stat()->acquire();
+		if (!page)
+			return;
+		func(page);
+		stat()->release(page);
+	}
+
+	int _deliver(const tll_frame_t *frame, const void *data, const tll_msg_t *orig)
+	{
+		tll_msg_t msg = { TLL_MESSAGE_DATA };
+		if (orig)
+			msg = *orig;
+		msg.msgid = frame->msgid;
+		msg.seq = frame->seq;
+		msg.size = frame->size;
+		msg.data = data;
+		_seq = frame->seq;
+		_seq_last = std::max(_seq_last, _seq);
+		return _callback_data(&msg);
+	}
+
+	int _post_recovery(rmcast::Recovery id, long long seq, const void *data, size_t size, const tll_addr_t &addr)
+	{
+		tll_msg_t msg = { TLL_MESSAGE_DATA };
+		msg.msgid = (int) id;
+		msg.seq = seq;
+		msg.data = data;
+		msg.size = size;
+		msg.addr = addr;
+		return _recovery->post(&msg);
+	}
+};
+
+} // namespace tll::channel
+
+#endif//_TLL_CHANNEL_RMCAST_H
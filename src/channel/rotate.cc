@@ -7,11 +7,28 @@
 
 #include "tll/scheme/merge.h"
 #include "channel/rotate.h"
+#include "channel/file-block.h"
 
 #include <filesystem>
 
+#include <fcntl.h>
+#include <unistd.h>
+
 using namespace tll::channel;
 
+namespace {
+/// Flush file or directory to disk, return errno value on failure
+int fsync_path(const std::string &path, int flags = 0)
+{
+	auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | flags);
+	if (fd == -1)
+		return errno;
+	auto r = fsync(fd) ? errno : 0;
+	::close(fd);
+	return r;
+}
+}
+
 static constexpr std::string_view control_scheme_read = R"(yamls://
 - name: Seek
   id: 10
@@ -55,9 +72,17 @@ int Rotate::_on_init(tll::Channel::Url &curl, const tll::Channel::Url &url, tll:
 	_autoclose = reader.getT("autoclose", true);
 	_convert_enable = reader.getT("convert", false);
 	auto key_first = reader.getT("filename-key", true, {{"first", true}, {"last", false}});
+	_archive_enable = reader.getT("archive", false);
+	_archive_level = reader.getT("archive-level", LZ4HC_CLEVEL_DEFAULT);
+	_prefetch = reader.getT("prefetch", 0.);
 	if (!reader)
 		return this->_log.fail(EINVAL, "Invalid url: {}", reader.error());
 
+	if (_archive_level < 0 || _archive_level > LZ4HC_CLEVEL_MAX)
+		return _log.fail(EINVAL, "Invalid archive-level {}: must be in range [0, {}]", _archive_level, LZ4HC_CLEVEL_MAX);
+	if (_prefetch < 0 || _prefetch > 1)
+		return _log.fail(EINVAL, "Invalid prefetch {}: must be in range [0, 1]", _prefetch);
+
 	_filename_key = key_first ? "info.seq-begin" : "info.seq";
 
 	auto path = std::filesystem::path(curl.host());
@@ -97,6 +122,7 @@ int Rotate::_open(const tll::ConstConfig &cfg)
 	_end_of_data = false;
 	_seq_first = -1;
 	_seq_last = -1;
+	_prefetch_seq = -1;
 	_open_cfg = tll::Config();
 	_state = State::Closed;
 	_convert.reset();
@@ -142,6 +168,17 @@ int Rotate::_open(const tll::ConstConfig &cfg)
 		if (!_scheme)
 			_scheme.reset(scheme->ref());
 
+		if (_prefetch > 0 && !_prefetch_child) {
+			auto cfg = _child->config().sub("init");
+			if (!cfg)
+				return _log.fail(EINVAL, "Can not create prefetch channel: child init parameters not available");
+			auto url = tll::Channel::Url(*cfg);
+			child_url_fill(url, "prefetch");
+			_prefetch_child = context().channel(url);
+			if (!_prefetch_child)
+				return _log.fail(EINVAL, "Can not create prefetch channel");
+		}
+
 		auto seq = reader.getT<long long>("seq", -1);
 		if (!reader)
 			return _log.fail(EINVAL, "Invalid params: {}", reader.error());
@@ -159,6 +196,13 @@ int Rotate::_open(const tll::ConstConfig &cfg)
 	} else {
 		_open_cfg.set("filename", _last_filename);
 		_state = State::Write;
+
+		if (_archive_enable) {
+			_log.info("Recompress rotated files in background with level {}", _archive_level);
+			_archive.reset(new Archive);
+			_archive->level = _archive_level;
+			_archive->start();
+		}
 	}
 
 	if ((internal.caps & caps::Output) && _scheme_url) {
@@ -187,6 +231,19 @@ int Rotate::_open(const tll::ConstConfig &cfg)
 
 int Rotate::_close(bool force)
 {
+	_prefetch_close();
+
+	if (_archive) {
+		{
+			std::unique_lock<std::mutex> lock(_archive->lock);
+			if (_archive->queue.size())
+				_log.warning("Cancel recompression of {} rotated files", _archive->queue.size());
+		}
+		_archive->shutdown();
+		_archive_report();
+		_archive.reset();
+	}
+
 	if (_files) {
 		config_info().setT("seq-begin", *_files->seq_first);
 		config_info().setT("seq", *_files->seq_last);
@@ -205,6 +262,12 @@ int Rotate::_close(bool force)
 	return 0;
 }
 
+void Rotate::_free()
+{
+	_prefetch_child.reset();
+	return Base::_free();
+}
+
 int Rotate::_post_rotate(const tll_msg_t *msg)
 {
 	if (internal.caps & caps::Input)
@@ -240,6 +303,11 @@ int Rotate::_rotate()
 	_current_empty = true;
 	_child->open(_open_cfg);
 
+	if (_archive) {
+		_archive_report();
+		_archive->push(next);
+	}
+
 	auto s = _child->scheme();
 	{
 		auto lock = _files->lock();
@@ -248,6 +316,96 @@ int Rotate::_rotate()
 	return 0;
 }
 
+void Rotate::_archive_report()
+{
+	std::list<std::string> done, errors;
+	{
+		std::unique_lock<std::mutex> lock(_archive->lock);
+		std::swap(done, _archive->done);
+		std::swap(errors, _archive->errors);
+	}
+	for (auto & f : done)
+		_log.info("Recompressed rotated file {}", f);
+	for (auto & e : errors)
+		_log.warning("Failed to recompress rotated file: {}", e);
+}
+
+void Rotate::Archive::push(const std::string &filename)
+{
+	{
+		std::unique_lock<std::mutex> l(lock);
+		queue.push_back(filename);
+	}
+	cond.notify_one();
+}
+
+void Rotate::Archive::shutdown()
+{
+	{
+		std::unique_lock<std::mutex> l(lock);
+		stop = true;
+	}
+	cond.notify_one();
+	if (thread.joinable())
+		thread.join();
+	thread = {};
+}
+
+void Rotate::Archive::run()
+{
+	std::unique_lock<std::mutex> l(lock);
+	while (!stop) {
+		if (queue.empty()) {
+			cond.wait(l);
+			continue;
+		}
+
+		auto filename = queue.front();
+		queue.pop_front();
+		l.unlock();
+
+		// Thread does not log, main thread can wait for it with logger locked
+		auto tmp = filename + ".tmp";
+		std::string error;
+		auto r = tll::file::archive(filename, tmp, level, error, &stop);
+		if (!r) {
+			// Both files are persisted before rename, otherwise index can refer to lost data
+			for (auto & f : { tmp, tmp + ".idx" }) {
+				if (auto e = fsync_path(f); e) {
+					error = fmt::format("failed to sync {}: {}", f, strerror(e));
+					r = EINVAL;
+					break;
+				}
+			}
+		}
+		if (!r) {
+			if (::rename((tmp + ".idx").c_str(), (filename + ".idx").c_str()) || ::rename(tmp.c_str(), filename.c_str())) {
+				error = fmt::format("failed to rename {} to {}: {}", tmp, filename, strerror(errno));
+				r = EINVAL;
+			}
+		}
+		std::string dir_error;
+		if (!r) { // Files are already replaced, failure is only reported
+			auto dir = std::filesystem::path(filename).parent_path().string();
+			if (auto e = fsync_path(dir.empty() ? "." : dir, O_DIRECTORY); e)
+				dir_error = fmt::format("{}: failed to sync directory {}: {}", filename, dir, strerror(e));
+		}
+		if (r) {
+			::unlink(tmp.c_str());
+			::unlink((tmp + ".idx").c_str());
+			::unlink((filename + ".idx").c_str());
+		}
+
+		l.lock();
+		if (dir_error.size())
+			errors.push_back(dir_error);
+		if (r)
+			errors.push_back(fmt::format("{}: {}", filename, error));
+		else
+			done.push_back(filename);
+	}
+}
+
 int Rotate::_seek(long long seq)
 {
 	if (internal.caps & caps::Output)
@@ -267,6 +425,7 @@ int Rotate::_seek(long long seq)
 	}
 
 	_state = State::Seek;
+	_prefetch_close();
 	if (_child->state() != tll::state::Closed)
 		_child->close(true);
 	_current_file = it;
@@ -276,6 +435,62 @@ int Rotate::_seek(long long seq)
 	return _child->open(_open_cfg);
 }
 
+int Rotate::_prefetch_open()
+{
+	_prefetch_seq = -1;
+	_prefetch_close();
+
+	std::string filename;
+	{
+		auto lock = _files->lock();
+		if (_current_file == --_files->files.end())
+			return 0;
+		_prefetch_file = std::next(_current_file);
+		filename = _prefetch_file->second.filename;
+	}
+
+	_log.debug("Prefetch next file {}", filename);
+	auto cfg = _open_cfg.copy();
+	cfg.set("filename", filename);
+	cfg.set("seq", conv::to_string(_prefetch_file->first));
+	if (_prefetch_child->open(cfg) || _prefetch_child->state() != tll::state::Active) {
+		// Not an error, file is opened again when switching to it and real error is reported there
+		_log.warning("Failed to prefetch file {}", filename);
+		_prefetch_close();
+	}
+	return 0;
+}
+
+void Rotate::_prefetch_close()
+{
+	if (_prefetch_child && _prefetch_child->state() != tll::state::Closed)
+		_prefetch_child->close(true);
+}
+
+int Rotate::_prefetch_swap()
+{
+	{
+		// Keep open parameters in sync with active child, they are used for logs and reopen
+		auto lock = _files->lock();
+		_open_cfg.set("filename", _prefetch_file->second.filename);
+		_open_cfg.set("seq", conv::to_string(_prefetch_file->first));
+	}
+	_log.debug("Switch to prefetched file {}", _open_cfg.get("filename").value_or(""));
+	auto self = static_cast<Base *>(this); // Callback is registered by Prefix with its own type
+	_child->callback_del(self, TLL_MESSAGE_MASK_ALL);
+	_child_del(_child.get(), "child");
+
+	std::swap(_child, _prefetch_child);
+
+	_child->callback_add(self, TLL_MESSAGE_MASK_ALL);
+	_child_add(_child.get(), "child");
+
+	// Child is already active, state message was not seen by this channel
+	if (auto r = _on_active(); r)
+		return state_fail(r, "Active hook failed");
+	return 0;
+}
+
 int Rotate::_post(const tll_msg_t *msg, int flags)
 {
 	if (msg->type == TLL_MESSAGE_CONTROL) {
@@ -304,6 +519,15 @@ int Rotate::_post(const tll_msg_t *msg, int flags)
 
 int Rotate::_on_active()
 {
+	if (_state == State::Read && _prefetch_child) {
+		auto lock = _files->lock();
+		_prefetch_seq = -1;
+		if (_current_file != --_files->files.end()) {
+			auto first = _current_file->first;
+			_prefetch_seq = first + (long long) (_prefetch * (_current_file->second.last - first));
+		}
+	}
+
 	if (_state == State::Read && _convert_enable) {
 		if (auto scheme = _child->scheme(); scheme) {
 			if (auto r = _convert.init(_log, scheme, _scheme.get()); r)
@@ -363,6 +587,8 @@ int Rotate::_on_data(const tll_msg_t *msg)
 	if (_state != State::Read)
 		return 0;
 	_seq_last = msg->seq;
+	if (_prefetch_seq != -1 && _seq_last >= _prefetch_seq)
+		_prefetch_open();
 	if (_convert.scheme_from) {
 		_log.debug("Try convert");
 		if (auto m = _convert.convert(msg); m)
@@ -495,8 +721,11 @@ int Rotate::_build_map()
 int Rotate::_process(long timeout, int flags)
 {
 	_update_dcaps(0, dcaps::Process | dcaps::Pending);
-	if (_child->state() == state::Closed)
+	if (_child->state() == state::Closed) {
+		if (_prefetch_child && _prefetch_child->state() == state::Active && _prefetch_file == _current_file)
+			return _prefetch_swap();
 		return _child->open(_open_cfg);
+	}
 	{
 		auto lock = _files->lock();
 		if (_seq_last < _current_file->second.last)
@@ -11,7 +11,11 @@
 #include "tll/channel/convert-buf.h"
 #include "tll/channel/prefix.h"
 
+#include <atomic>
+#include <condition_variable>
+#include <list>
 #include <mutex>
+#include <thread>
 
 namespace tll::channel {
 
@@ -60,6 +64,39 @@ class Rotate : public Prefix<Rotate>
 	tll::Config _open_cfg;
 	int _control_eod_msgid = 0;
 
+	/// Background job that recompresses rotated files and builds block index for them
+	struct Archive
+	{
+		int level = 0;
+
+		std::thread thread;
+		std::mutex lock;
+		std::condition_variable cond;
+		std::atomic<bool> stop = false;
+
+		std::list<std::string> queue;
+		std::list<std::string> done; ///< Finished and failed jobs, reported from main thread
+		std::list<std::string> errors;
+
+		~Archive() { shutdown(); }
+
+		void start() { thread = std::thread(&Archive::run, this); }
+		void shutdown();
+		void push(const std::string &filename);
+
+	 private:
+		void run();
+	};
+
+	bool _archive_enable = false;
+	int _archive_level = 0;
+	std::unique_ptr<Archive> _archive;
+
+	double _prefetch = 0; ///< Fraction of current file after which next one is opened in advance
+	std::unique_ptr<tll::Channel> _prefetch_child;
+	Files::Map::const_iterator _prefetch_file;
+	long long _prefetch_seq = -1; ///< Seq in current file that triggers prefetch, -1 if disabled
+
 	enum class State { Closed, Build, Seek, Read, Write } _state = State::Closed;
 
  public:
@@ -83,6 +120,7 @@ class Rotate : public Prefix<Rotate>
 	int _on_init(tll::Channel::Url &curl, const tll::Channel::Url &, tll::Channel *master);
 	int _open(const tll::ConstConfig &params);
 	int _close(bool force = false);
+	void _free();
 
 	int _post(const tll_msg_t *msg, int flags);
 	int _process(long timeout, int flags);
@@ -113,6 +151,12 @@ class Rotate : public Prefix<Rotate>
 	int _rotate();
 	int _seek(long long seq);
 
+	void _archive_report();
+
+	int _prefetch_open();
+	void _prefetch_close();
+	int _prefetch_swap();
+
 	bool _current_last()
 	{
 		auto lock = _files->lock();
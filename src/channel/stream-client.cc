@@ -11,6 +11,12 @@
 
 #include "tll/util/size.h"
 
+#include <filesystem>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
 using namespace tll;
 using namespace tll::channel;
 
@@ -24,6 +30,7 @@ struct tll::conv::dump<StreamClient::State> : public tll::conv::to_string_from_s
         {
 		switch (v) {
 		case StreamClient::State::Closed: return "Closed";
+		case StreamClient::State::Local: return "Local";
 		case StreamClient::State::Opening: return "Opening";
 		case StreamClient::State::Connected: return "Connected";
 		case StreamClient::State::Overlapped: return "Overlapped";
@@ -44,10 +51,23 @@ int StreamClient::_init(const Channel::Url &url, tll::Channel *master)
 	auto size = reader.getT<util::Size>("size", 128 * 1024);
 	_peer = reader.getT<std::string>("peer", "");
 	_report_block_end = reader.getT("report-block-end", true);
+	_spill.enable = reader.getT("spill", false);
+	_spill.dir = reader.getT<std::string>("spill-dir", "");
+	auto chunks = reader.getT<unsigned>("chunks", 1);
+	_chunk_min = reader.getT<unsigned>("chunk-min-size", 10000);
+	auto chunk_hosts = reader.getT("chunk-hosts", std::vector<std::string> {});
+	_compression = reader.getT("compression", Compression::None, {{"none", Compression::None}, {"lz4", Compression::LZ4}});
 
 	if (!reader)
 		return _log.fail(EINVAL, "Invalid url: {}", reader.error());
 
+	if (_spill.enable && _spill.dir.empty()) {
+		std::error_code ec;
+		_spill.dir = std::filesystem::temp_directory_path(ec).string();
+		if (ec)
+			return _log.fail(EINVAL, "Failed to get temporary directory for spill files: {}", ec.message());
+	}
+
 	_log.debug("Data buffer size: {}, messages {}", size, size / 64);
 	_ring.resize(size / 64);
 	_ring.data_resize(size);
@@ -64,6 +84,12 @@ int StreamClient::_init(const Channel::Url &url, tll::Channel *master)
 	_request->callback_add<StreamClient, &StreamClient::_on_request_data>(this, TLL_MESSAGE_MASK_DATA);
 	_child_add(_request.get(), "request");
 
+	if (auto r = _init_storage(url, master); r)
+		return r;
+
+	if (auto r = _init_chunks(url, master, chunks, chunk_hosts); r)
+		return r;
+
 	_scheme_control.reset(context().scheme_load(stream_control_scheme::scheme_string));
 	if (!_scheme_control.get())
 		return _log.fail(EINVAL, "Failed to load control scheme");
@@ -71,10 +97,67 @@ int StreamClient::_init(const Channel::Url &url, tll::Channel *master)
 	return 0;
 }
 
+int StreamClient::_init_storage(const tll::Channel::Url &url, tll::Channel *master)
+{
+	if (!url.sub("storage"))
+		return 0;
+	auto curl = url.getT<tll::Channel::Url>("storage");
+	if (!curl)
+		return _log.fail(EINVAL, "Failed to get storage url: {}", curl.error());
+	if (curl->proto().empty()) // Only parameters for server storage, like storage.dump
+		return 0;
+
+	child_url_fill(*curl, "storage");
+	curl->set("dir", "w");
+	if (_scheme_url)
+		curl->set("scheme", *_scheme_url);
+
+	_storage = context().channel(*curl, master);
+	if (!_storage)
+		return _log.fail(EINVAL, "Failed to create storage channel");
+	_child_add(_storage.get(), "storage");
+
+	curl->remove("scheme");
+	_storage_url = *curl;
+	_storage_url.set("dir", "r");
+	_storage_url.set("name", fmt::format("{}/storage/load", name));
+	_storage_url.set("autoclose", "yes");
+	return 0;
+}
+
+int StreamClient::_init_chunks(const tll::Channel::Url &url, tll::Channel *master, unsigned count, const std::vector<std::string> &hosts)
+{
+	_chunks.clear();
+	for (unsigned i = 1; i < count; i++) {
+		auto curl = url.getT<tll::Channel::Url>("request");
+		if (!curl)
+			return _log.fail(EINVAL, "Failed to get request url: {}", curl.error());
+		if (hosts.size())
+			curl->host(hosts[(i - 1) % hosts.size()]);
+		child_url_fill(*curl, fmt::format("request/{}", i));
+
+		auto c = std::make_unique<Chunk>();
+		c->parent = this;
+		c->channel = context().channel(*curl, master);
+		if (!c->channel)
+			return _log.fail(EINVAL, "Failed to create request channel for chunk {}", i);
+		c->channel->callback_add([](const tll_channel_t *, const tll_msg_t * msg, void * user) {
+				return static_cast<Chunk *>(user)->on_state(msg);
+			}, c.get(), TLL_MESSAGE_MASK_STATE);
+		c->channel->callback_add([](const tll_channel_t *, const tll_msg_t * msg, void * user) {
+				return static_cast<Chunk *>(user)->on_data(msg);
+			}, c.get(), TLL_MESSAGE_MASK_DATA);
+		_child_add(c->channel.get(), "request");
+		_chunks.push_back(std::move(c));
+	}
+	return 0;
+}
+
 int StreamClient::_open(const ConstConfig &url)
 {
 	_state = State::Closed;
 	_ring.clear();
+	_spill_reset();
 	_open_seq = {};
 	_seq = _server_seq = _block_end = -1;
 
@@ -85,6 +168,10 @@ int StreamClient::_open(const ConstConfig &url)
 	else
 		_request_open = tll::Config();
 
+	_storage_seq = -1;
+	_storage_write = false;
+	_local_seq.reset();
+
 	auto reader = channel_props_reader(url);
 
 	auto r = stream_scheme::Request::bind_reset(_request_buf);
@@ -95,10 +182,17 @@ int StreamClient::_open(const ConstConfig &url)
 
 	enum Mode { Undefined, Online, Seq, SeqData, Block };
 	auto mode = reader.getT("mode", Undefined, {{"online", Online}, {"seq", Seq}, {"seq-data", SeqData}, {"block", Block}});
+	_msgid_include_list = reader.getT("msgid-include", std::list<std::string> {});
+	_msgid_exclude_list = reader.getT("msgid-exclude", std::list<std::string> {});
 
 	if (!reader)
 		return _log.fail(EINVAL, "Invalid open parameters: {}", reader.error());
 
+	if (_msgid_include_list.size() && _msgid_exclude_list.size())
+		return _log.fail(EINVAL, "msgid-include and msgid-exclude can not be used together");
+	_msgid_include.clear();
+	_msgid_exclude.clear();
+
 	if (mode == Undefined) {
 		return _log.fail(EINVAL, "Need mode=online/seq/block parameter");
 	} else if (mode == Online) {
@@ -116,6 +210,7 @@ int StreamClient::_open(const ConstConfig &url)
 
 		_reopen_cfg.set("mode", "seq");
 		_reopen_cfg.set("seq", _config_seq, this);
+		_storage_write = _storage != nullptr;
 	}  else if (mode == Block) {
 		auto block = reader.getT<unsigned>("block");
 		auto type = reader.getT<std::string>("block-type", "default");
@@ -130,14 +225,121 @@ int StreamClient::_open(const ConstConfig &url)
 	config_info().set("reopen", _reopen_cfg);
 	config_info().set_ptr("seq", &_seq);
 
+	if (_compression == Compression::LZ4 && _request_buf.size()) {
+		auto attributes = r.get_attributes();
+		attributes.resize(attributes.size() + 1);
+		auto a = *(attributes.begin() + (attributes.size() - 1));
+		a.set_attribute("compression");
+		a.set_value("lz4");
+	}
+
 	if (!reader)
 		return _log.fail(EINVAL, "Invalid open parameters: {}", reader.error());
 
+	if (_storage) {
+		Config sopen;
+		if (auto sub = url.sub("storage"); sub)
+			sopen = sub->copy();
+		if (_storage->open(sopen))
+			return _log.fail(EINVAL, "Failed to open local storage channel");
+		if (_storage->state() != tll::state::Active)
+			return _log.fail(EINVAL, "Long opening local storage is not supported");
+		auto last = _storage->config().getT<long long>("info.seq", -1);
+		if (!last)
+			return _log.fail(EINVAL, "Local storage has invalid 'seq' config value: {}", last.error());
+		auto begin = _storage->config().getT<long long>("info.seq-begin", -1);
+		if (!begin)
+			return _log.fail(EINVAL, "Local storage has invalid 'seq-begin' config value: {}", begin.error());
+		_storage_seq = *last;
+		_log.info("Local storage has data from seq {} to {}", *begin, _storage_seq);
+
+		if (_storage_write && _msgid_include_list.size() + _msgid_exclude_list.size()) {
+			_log.info("Msgid filter is set, local storage is read-only");
+			_storage_write = false;
+		} else if (_storage_write && _storage_seq >= 0 && *_open_seq > _storage_seq + 1) {
+			_log.warning("Requested seq {} is after last stored seq {}, local storage is read-only", *_open_seq, _storage_seq);
+			_storage_write = false;
+		}
+
+		if (_open_seq && *begin >= 0 && *begin <= *_open_seq && *_open_seq <= _storage_seq) {
+			_log.info("Read seq {} to {} from local storage, request rest from server", *_open_seq, _storage_seq);
+			_local_seq = *_open_seq;
+			r.set_seq(_storage_seq + 1);
+		}
+	}
+
 	return Base::_open(url);
 }
 
+int StreamClient::_msgid_filter_init()
+{
+	_msgid_include.clear();
+	_msgid_exclude.clear();
+	if (_parse_msgid_list(_msgid_include, _msgid_include_list))
+		return _log.fail(EINVAL, "Invalid msgid-include list");
+	if (_parse_msgid_list(_msgid_exclude, _msgid_exclude_list))
+		return _log.fail(EINVAL, "Invalid msgid-exclude list");
+
+	auto r = stream_scheme::Request::bind(_request_buf);
+	for (auto & [key, list] : { std::make_pair("msgid-include", &_msgid_include), std::make_pair("msgid-exclude", &_msgid_exclude) }) {
+		if (list->empty())
+			continue;
+		std::string value;
+		for (auto id : *list)
+			value += (value.empty() ? "" : ",") + conv::to_string(id);
+		_log.info("Filter messages with {}: {}", key, value);
+		_reopen_cfg.set(key, value);
+
+		if (!_request_buf.size()) // Online mode, no request
+			continue;
+		auto attributes = r.get_attributes();
+		attributes.resize(attributes.size() + 1);
+		auto a = *(attributes.begin() + (attributes.size() - 1));
+		a.set_attribute(key);
+		a.set_value(value);
+	}
+	return 0;
+}
+
+int StreamClient::_parse_msgid_list(std::set<int> &result, const std::list<std::string> &list)
+{
+	for (auto & i : list) {
+		if (auto id = conv::to_any<int>(i); id) {
+			result.insert(*id);
+			continue;
+		}
+		auto s = scheme(TLL_MESSAGE_DATA);
+		if (!s)
+			return _log.fail(EINVAL, "Message '{}' is not a number and no scheme available", i);
+		auto m = s->lookup(i);
+		if (!m)
+			return _log.fail(EINVAL, "Message '{}' not found in scheme", i);
+		if (!m->msgid)
+			return _log.fail(EINVAL, "Message '{}' has no msgid", i);
+		result.insert(m->msgid);
+	}
+	return 0;
+}
+
 int StreamClient::_close(bool force)
 {
+	if (_state == State::Local)
+		_child_del(_storage_load.get());
+	_storage_load.reset();
+	if (_storage && _storage->state() != tll::state::Closed)
+		_storage->close(force);
+	_spill_reset();
+
+	for (auto & c : _chunks) {
+		if (c->channel->state() != tll::state::Closed)
+			c->channel->close(force || state() == tll::state::Error);
+		_chunk_release(c->channel.get(), c->data, c->data_size, c->suspended);
+		c->lz4.reset();
+	}
+	_chunk_release(_request.get(), _chunk_pending, _chunk_pending_size, _chunk_suspended);
+	_lz4.reset();
+	_chunks_active = _chunk_head = 0;
+
 	_state = State::Closed;
 	_reset_config_cb(config_info(), "reopen.seq");
 	config_info().setT("seq", _seq);
@@ -192,6 +394,9 @@ int StreamClient::_post_done(long long seq)
 
 int StreamClient::_on_active()
 {
+	if (_msgid_filter_init()) // Scheme is available only when online channel is active
+		return state_fail(EINVAL, "Failed to initialize msgid filter");
+
 	if (!_request_buf.size()) {
 		_log.debug("Stream channel active, skip request channel in online-only mode");
 		_state = State::Online;
@@ -212,9 +417,232 @@ int StreamClient::_on_active()
 		_log.info("Online child does not report last seq");
 	}
 
+	if (_local_seq)
+		return _local_open();
+	return _request_start();
+}
+
+int StreamClient::_request_start()
+{
+	_chunks_active = _chunk_head = 0;
+	_chunk_release(_request.get(), _chunk_pending, _chunk_pending_size, _chunk_suspended);
+	_lz4.reset();
+
+	if (_chunks.size() && _open_seq && _server_seq >= *_open_seq) {
+		long long count = _chunks.size() + 1;
+		auto step = (_server_seq + 1 - *_open_seq) / count;
+		if (step > 0 && step >= _chunk_min) {
+			_log.info("Split history from seq {} to {} into {} chunks", *_open_seq, _server_seq, count);
+			auto seq = *_open_seq;
+			for (auto & c : _chunks) {
+				c->begin = seq;
+				c->end = seq + step;
+				c->reply = c->done = false;
+				_chunk_release(c->channel.get(), c->data, c->data_size, c->suspended);
+				c->lz4.reset();
+				c->request = _request_buf;
+				stream_scheme::Request::bind(c->request).set_seq(c->begin);
+				seq += step;
+			}
+			// Main request channel downloads last chunk and continues to online data
+			stream_scheme::Request::bind(_request_buf).set_seq(seq);
+			_chunks_active = _chunks.size();
+
+			for (auto & c : _chunks) {
+				if (c->channel->open(_request_open))
+					return state_fail(EINVAL, "Failed to open request channel for chunk from seq {}", c->begin);
+			}
+		}
+	}
+
 	return _request->open(_request_open);
 }
 
+void StreamClient::_chunk_push(std::list<std::vector<char>> &list, const tll_msg_t *msg)
+{
+	tll_frame_t frame = { (uint32_t) msg->size, msg->msgid, (int64_t) msg->seq };
+	auto & data = list.emplace_back(sizeof(frame) + msg->size);
+	memcpy(data.data(), &frame, sizeof(frame));
+	memcpy(data.data() + sizeof(frame), msg->data, msg->size);
+}
+
+tll_msg_t StreamClient::_chunk_msg(const std::vector<char> &data)
+{
+	auto frame = (const tll_frame_t *) data.data();
+	tll_msg_t msg = { TLL_MESSAGE_DATA };
+	msg.msgid = frame->msgid;
+	msg.seq = frame->seq;
+	msg.size = frame->size;
+	msg.data = data.data() + sizeof(*frame);
+	return msg;
+}
+
+int StreamClient::_chunk_deliver(const tll_msg_t *msg)
+{
+	if (msg->seq <= _seq)
+		return 0;
+	_seq = msg->seq;
+	if (_filtered(msg->msgid))
+		return 0;
+	if (auto r = _store(msg); r)
+		return r;
+	return _callback_data(msg);
+}
+
+int StreamClient::_chunk_flush()
+{
+	if (_state != State::Connected) // Data is delivered only after main request is connected
+		return 0;
+
+	while (_chunk_head < _chunks_active) {
+		auto & c = *_chunks[_chunk_head];
+		for (auto & m : c.data) {
+			auto msg = _chunk_msg(m);
+			if (auto r = _chunk_deliver(&msg); r)
+				return r;
+		}
+		_chunk_release(c.channel.get(), c.data, c.data_size, c.suspended);
+		if (!c.done)
+			return 0;
+		_log.info("Chunk from seq {} to {} is processed", c.begin, c.end - 1);
+		_chunk_head++;
+	}
+
+	if (_chunk_pending.empty())
+		return 0;
+	_log.info("All chunks are processed, forward {} buffered messages", _chunk_pending.size());
+	auto list = std::move(_chunk_pending);
+	_chunk_release(_request.get(), _chunk_pending, _chunk_pending_size, _chunk_suspended);
+	for (auto & m : list) {
+		auto msg = _chunk_msg(m);
+		_on_request_message(&msg);
+	}
+	return 0;
+}
+
+int StreamClient::Chunk::on_state(const tll_msg_t *msg)
+{
+	switch ((tll_state_t) msg->msgid) {
+	case tll::state::Active: {
+		tll_msg_t m = { TLL_MESSAGE_DATA };
+		m.msgid = stream_scheme::Request::meta_id();
+		m.data = request.data();
+		m.size = request.size();
+		if (auto r = channel->post(&m); r)
+			return parent->state_fail(EINVAL, "Failed to post request for chunk from seq {}", begin);
+		parent->_log.info("Posted request for chunk from seq {} to {}", begin, end - 1);
+		return 0;
+	}
+	case tll::state::Error:
+		if (!done)
+			return parent->state_fail(0, "Request channel for chunk from seq {} failed", begin);
+		return 0;
+	case tll::state::Closed:
+		if (!done && parent->state() == tll::state::Active)
+			return parent->state_fail(0, "Request channel for chunk from seq {} closed", begin);
+		return 0;
+	default:
+		return 0;
+	}
+}
+
+int StreamClient::Chunk::on_data(const tll_msg_t *msg)
+{
+	if (done)
+		return 0;
+	if (!reply) {
+		if (msg->msgid == stream_scheme::Error::meta_id()) {
+			auto data = stream_scheme::Error::bind(*msg);
+			if (data.meta_size() > msg->size)
+				return parent->state_fail(0, "Invalid Error message size: {} < min {}", msg->size, data.meta_size());
+			return parent->state_fail(0, "Server error for chunk from seq {}: {}", begin, data.get_error());
+		} else if (msg->msgid != stream_scheme::Reply::meta_id())
+			return parent->state_fail(0, "Unknown message from server: {}", msg->msgid);
+		if (msg->size < stream_scheme::Reply::meta_size() - sizeof(tll_scheme_offset_ptr_t))
+			return parent->state_fail(0, "Invalid reply size: {}", msg->size);
+		if (parent->_reply_compression(msg, lz4))
+			return parent->state_fail(0, "Failed to initialize decompression for chunk from seq {}", begin);
+		reply = true;
+		return 0;
+	}
+
+	if (msg->seq >= end) {
+		done = true;
+		auto data = stream_scheme::ClientDone::bind_reset(request);
+		data.set_seq(msg->seq);
+		tll_msg_t m = { TLL_MESSAGE_DATA };
+		m.msgid = data.meta_id();
+		m.data = data.view().data();
+		m.size = data.view().size();
+		channel->post(&m); // Server closes connection itself, errors are not important
+		channel->close();
+		return parent->_chunk_flush();
+	}
+
+	tll_msg_t decoded;
+	if (lz4) {
+		msg = parent->_decompress(lz4.get(), msg, decoded);
+		if (!msg)
+			return 0;
+	}
+
+	if (parent->_state == State::Connected && parent->_chunks[parent->_chunk_head].get() == this)
+		return parent->_chunk_deliver(msg);
+	parent->_chunk_hold(channel.get(), data, data_size, suspended, msg);
+	return 0;
+}
+
+int StreamClient::_local_open()
+{
+	_storage_load = context().channel(_storage_url, _storage.get());
+	if (!_storage_load)
+		return state_fail(EINVAL, "Failed to create local storage reader");
+	_storage_load->callback_add([](const tll_channel_t *, const tll_msg_t * msg, void * user) {
+			return static_cast<StreamClient *>(user)->_on_storage_load(msg);
+		}, this);
+
+	tll::Config cfg;
+	cfg.setT("seq", *_local_seq);
+	if (_storage_load->open(cfg))
+		return state_fail(EINVAL, "Failed to open local storage from seq {}", *_local_seq);
+	_child_add(_storage_load.get(), "storage");
+	_state = State::Local;
+	state(tll::state::Active);
+	return 0;
+}
+
+int StreamClient::_on_storage_load(const tll_msg_t *msg)
+{
+	if (msg->type == TLL_MESSAGE_DATA) {
+		if (msg->seq <= _seq)
+			return 0;
+		_seq = msg->seq;
+		if (!_filtered(msg->msgid))
+			_callback_data(msg);
+		return 0;
+	} else if (msg->type != TLL_MESSAGE_STATE)
+		return 0;
+
+	switch ((tll_state_t) msg->msgid) {
+	case tll::state::Closed:
+		if (_state != State::Local)
+			return 0;
+		_log.info("Local storage processed up to seq {}, request data from server", _seq);
+		_child_del(_storage_load.get()); // Can not destroy in callback
+		_local_seq.reset();
+		_open_seq = _storage_seq + 1;
+		_state = State::Closed;
+		if (_request_start())
+			return state_fail(0, "Failed to open request channel");
+		return 0;
+	case tll::state::Error:
+		return state_fail(0, "Local storage reader failed");
+	default:
+		break;
+	}
+	return 0;
+}
+
 int StreamClient::_on_request_error()
 {
 	switch (_state) {
@@ -259,15 +687,30 @@ int StreamClient::_on_data(const tll_msg_t *msg)
 		if (msg->seq <= _seq)
 			return _log.fail(EINVAL, "Message seq in the past: {}, last was {}", msg->seq, _seq);
 		_seq = msg->seq;
+		if (_filtered(msg->msgid))
+			return 0;
+		if (auto r = _store(msg); r)
+			return r;
 		return _callback_data(msg);
 	} else if (_state == State::Drain) {
 		if (msg->seq <= _seq)
 			return 0;
 		_log.debug("Drained old data from online channel, switching to normal mode");
 		_state = State::Online;
+		_seq = msg->seq;
+		if (_filtered(msg->msgid))
+			return 0;
+		if (auto r = _store(msg); r)
+			return r;
 		return _callback_data(msg);
 	}
 
+	if (_filtered(msg->msgid)) // Buffer only messages that are requested from server
+		return 0;
+
+	if (_spill.active()) // Keep order, all following messages are spilled until file is drained
+		return _spill_write(msg);
+
 	tll_frame_t frame = { (uint32_t) msg->size, msg->msgid, (int64_t) msg->seq };
 	if (sizeof(frame) + msg->size > _ring.data_capacity() / 2)
 		return _log.fail(EMSGSIZE, "Message too large for buffer {}: {}", _ring.data_size(), msg->size);
@@ -275,19 +718,183 @@ int StreamClient::_on_data(const tll_msg_t *msg)
 	do {
 		if (_ring.push_back(frame, msg->data, msg->size) != nullptr)
 			break;
+		if (_spill.enable)
+			return _spill_write(msg);
 		_ring.pop_front();
 	} while (true);
 
+	if (_stat_enable) {
+		auto page = stat()->acquire();
+		if (page) {
+			page->overlap = _ring.size();
+			page->overlap_bytes = _ring.data_size();
+			stat()->release(page);
+		}
+	}
+
+	return 0;
+}
+
+int StreamClient::_spill_write(const tll_msg_t *msg)
+{
+	if (!_spill.writer) {
+		std::string filename = _spill.dir + "/tll-stream-spill.XXXXXX";
+		auto fd = mkstemp(filename.data());
+		if (fd == -1)
+			return state_fail(EINVAL, "Failed to create spill file in {}: {}", _spill.dir, strerror(errno));
+		::close(fd);
+		_spill.filename = filename;
+
+		_log.info("Online buffer is full on seq {}, spill data into {}", msg->seq, filename);
+		_spill.writer = context().channel(fmt::format("file://{};dir=w;name={}/spill", filename, name));
+		if (!_spill.writer)
+			return state_fail(EINVAL, "Failed to create spill writer");
+		if (_spill.writer->open() || _spill.writer->state() != tll::state::Active)
+			return state_fail(EINVAL, "Failed to open spill file {}", filename);
+	}
+
+	if (auto r = _spill.writer->post(msg); r)
+		return state_fail(r, "Failed to write message {} into spill file", msg->seq);
+	_spill.count++;
+
+	if (_stat_enable) {
+		auto page = stat()->acquire();
+		if (page) {
+			page->overlap = _ring.size() + _spill.count;
+			page->overlap_bytes = _ring.data_size();
+			page->spill = 1;
+			page->spill_bytes = msg->size;
+			stat()->release(page);
+		}
+	}
+	return 0;
+}
+
+int StreamClient::_spill_process()
+{
+	if (!_spill.reader) {
+		_log.info("Online buffer drained, read {} messages from spill file", _spill.count);
+		_spill.reader = context().channel(fmt::format("file://{};dir=r;autoclose=no;name={}/spill/read", _spill.filename, name));
+		if (!_spill.reader)
+			return state_fail(EINVAL, "Failed to create spill reader");
+		_spill.reader->callback_add([](const tll_channel_t *, const tll_msg_t * msg, void * user) {
+				return static_cast<StreamClient *>(user)->_on_spill_data(msg);
+			}, this, TLL_MESSAGE_MASK_DATA);
+		if (_spill.reader->open() || _spill.reader->state() != tll::state::Active)
+			return state_fail(EINVAL, "Failed to open spill file {}", _spill.filename);
+	}
+
+	// Writer and reader are in the same thread, end of file means that all spilled data is processed
+	if (auto r = _spill.reader->process(); r != EAGAIN)
+		return r;
+	_log.info("Spill file processed up to seq {}", _seq);
+	_spill_reset();
+	return EAGAIN;
+}
+
+int StreamClient::_on_spill_data(const tll_msg_t *msg)
+{
+	if (msg->seq <= _seq) // Skip already processed message
+		return 0;
+	_seq = msg->seq;
+	if (auto r = _store(msg); r)
+		return r;
+	return _callback_data(msg);
+}
+
+void StreamClient::_spill_reset()
+{
+	_spill.reader.reset();
+	_spill.writer.reset();
+	_spill.count = 0;
+	if (_spill.filename.size()) {
+		std::error_code ec;
+		std::filesystem::remove(_spill.filename, ec);
+		_spill.filename.clear();
+	}
+}
+
+int StreamClient::_reply_compression(const tll_msg_t *msg, std::unique_ptr<tll::lz4::StreamDecode> &lz4)
+{
+	lz4.reset();
+
+	auto data = stream_scheme::Reply::bind(*msg);
+	std::string_view compression;
+	size_t block = 0;
+	if (msg->size >= data.meta_size()) { // Old servers send reply without attributes
+		for (auto a : data.get_attributes()) {
+			if (a.get_attribute() == "compression") {
+				compression = a.get_value();
+			} else if (a.get_attribute() == "compression-block") {
+				auto r = conv::to_any<size_t>(a.get_value());
+				if (!r)
+					return _log.fail(EINVAL, "Invalid compression-block attribute '{}': {}", a.get_value(), r.error());
+				block = *r;
+			}
+		}
+	}
+
+	if (compression.empty()) {
+		if (_compression != Compression::None)
+			_log.info("Server does not support compression, history data is not compressed");
+		return 0;
+	}
+	if (compression != "lz4")
+		return _log.fail(EINVAL, "Unsupported compression in server reply: '{}'", compression);
+	if (block == 0)
+		return _log.fail(EINVAL, "Missing or zero compression-block in server reply");
+
+	lz4.reset(new tll::lz4::StreamDecode);
+	if (lz4->init(block))
+		return _log.fail(EINVAL, "Failed to initialize lz4 decoder with block {}", block);
+	_log.debug("History data is compressed with lz4, block {}", block);
 	return 0;
 }
 
+const tll_msg_t * StreamClient::_decompress(tll::lz4::StreamDecode * lz4, const tll_msg_t *msg, tll_msg_t &result)
+{
+	if (msg->size == 0)
+		return state_fail<const tll_msg_t *>(nullptr, "Compressed message {} at seq {} without encoding byte", msg->msgid, msg->seq);
+	result = *msg;
+	result.size = msg->size - 1;
+	auto encoding = (stream_scheme::Encoding) static_cast<const char *>(msg->data)[result.size];
+	if (encoding == stream_scheme::Encoding::Raw) // Message larger then compression block
+		return &result;
+	if (encoding != stream_scheme::Encoding::LZ4)
+		return state_fail<const tll_msg_t *>(nullptr, "Unknown encoding {} of message {} at seq {}", (int) encoding, msg->msgid, msg->seq);
+
+	auto data = lz4->decompress(msg->data, result.size);
+	if (!data.data)
+		return state_fail<const tll_msg_t *>(nullptr, "Failed to decompress message {} at seq {}", msg->msgid, msg->seq);
+	result.data = data.data;
+	result.size = data.size;
+	return &result;
+}
+
 int StreamClient::_on_request_data(const tll::Channel *, const tll_msg_t *msg)
+{
+	tll_msg_t decoded;
+	if (_lz4 && _state != State::Opening) {
+		msg = _decompress(_lz4.get(), msg, decoded);
+		if (!msg)
+			return 0;
+	}
+	return _on_request_message(msg);
+}
+
+int StreamClient::_on_request_message(const tll_msg_t *msg)
 {
 	_log.debug("Seq {}, state {}, ring {}", msg->seq, (int) _state, _ring.empty());
 	if (_state == State::Connected) {
+		if (_chunk_head < _chunks_active) { // Previous part of history is not received yet
+			_chunk_hold(_request.get(), _chunk_pending, _chunk_pending_size, _chunk_suspended, msg);
+			return 0;
+		}
+
 		if (_seq < _block_end && msg->seq >= _block_end) {
 			_seq = msg->seq;
-			_reopen_cfg = tll::Config();
+			_reopen_cfg.unlink("block"); // Keep msgid filters
+			_reopen_cfg.unlink("block-type");
 			_reopen_cfg.set("mode", "seq");
 			_reopen_cfg.set("seq", _config_seq, this);
 			config_info().set("reopen", _reopen_cfg);
@@ -295,7 +902,11 @@ int StreamClient::_on_request_data(const tll::Channel *, const tll_msg_t *msg)
 		}
 
 		_seq = msg->seq;
-		_callback_data(msg);
+		if (!_filtered(msg->msgid)) { // Server sends filtered messages without body after last seq
+			if (_store(msg))
+				return 0;
+			_callback_data(msg);
+		}
 		if (_seq == _server_seq && _ring.empty()) {
 			_log.info("Reached reported server seq {}, no online data", _server_seq);
 			_post_done(msg->seq);
@@ -331,8 +942,10 @@ int StreamClient::_on_request_data(const tll::Channel *, const tll_msg_t *msg)
 		} else if (msg->msgid != stream_scheme::Reply::meta_id())
 			return state_fail(0, "Unknown message from server: {}", msg->msgid);
 		auto data = stream_scheme::Reply::bind(*msg);
-		if (msg->size < data.meta_size())
-			return state_fail(0, "Invalid reply size: {} < minimum {}", msg->size, data.meta_size());
+		if (auto min = data.meta_size() - sizeof(tll_scheme_offset_ptr_t); msg->size < min) // Attributes are optional
+			return state_fail(0, "Invalid reply size: {} < minimum {}", msg->size, min);
+		if (_reply_compression(msg, _lz4))
+			return state_fail(0, "Failed to initialize decompression of history data");
 		_server_seq = std::max<long long>(_server_seq, data.get_last_seq());
 		_block_end = data.get_block_seq();
 		_log.info("Server seq: {}, block end seq: {}", _server_seq, data.get_block_seq());
@@ -348,7 +961,8 @@ int StreamClient::_on_request_data(const tll::Channel *, const tll_msg_t *msg)
 			_log.info("Server has no old data for us, channel is online (seq {})", _server_seq);
 			_seq = _server_seq;
 
-			_reopen_cfg = tll::Config();
+			_reopen_cfg.unlink("block"); // Keep msgid filters
+			_reopen_cfg.unlink("block-type");
 			_reopen_cfg.set("mode", "seq");
 			_reopen_cfg.set("seq", _config_seq, this);
 			config_info().set("reopen", _reopen_cfg);
@@ -360,18 +974,29 @@ int StreamClient::_on_request_data(const tll::Channel *, const tll_msg_t *msg)
 		} else if (_server_seq < *_open_seq) {
 			return state_fail(0, "Invalid server seq: {} < requested {}", _server_seq, *_open_seq);
 		}
+		if (_chunks_active)
+			return _chunk_flush();
 		return 0;
 	} else if (_state != State::Overlapped)
 		return 0;
 	if (msg->seq <= _seq) // Message already forwarded to client
 		return 0;
 	_seq = msg->seq;
-	_callback_data(msg);
+	if (!_filtered(msg->msgid)) {
+		if (_store(msg))
+			return 0;
+		_callback_data(msg);
+	}
 	return 0;
 }
 
 int StreamClient::_process(long timeout, int flags)
 {
+	if (_state == State::Overlapped && _ring.empty() && _spill.active()) {
+		if (auto r = _spill_process(); r != EAGAIN)
+			return r;
+	}
+
 	if (_state != State::Overlapped || _ring.empty()) {
 		_report_online();
 		_update_dcaps(0, dcaps::Process | dcaps::Pending);
@@ -391,6 +1016,8 @@ int StreamClient::_process(long timeout, int flags)
 		return 0;
 
 	_seq = msg.seq;
+	if (auto r = _store(&msg); r)
+		return r;
 	_callback_data(&msg);
 
 	return 0;
@@ -12,15 +12,17 @@
 #include "tll/channel/lastseq.h"
 #include "tll/channel/prefix.h"
 #include "tll/util/cppring.h"
+#include "tll/util/lz4block.h"
 
 #include <list>
+#include <set>
 
 namespace tll::channel {
 
 class StreamClient : public tll::channel::LastSeqRx<StreamClient, tll::channel::Prefix<StreamClient>>
 {
  public:
-	enum class State { Closed, Opening, Connected, Overlapped, Drain, Online };
+	enum class State { Closed, Local, Opening, Connected, Overlapped, Drain, Online };
 
  private:
 	using Base = LastSeqRx<StreamClient, Prefix<StreamClient>>;
@@ -31,6 +33,55 @@ class StreamClient : public tll::channel::LastSeqRx<StreamClient, tll::channel::
 	std::vector<char> _request_buf;
 	tll::Config _request_open;
 
+	std::unique_ptr<Channel> _storage; ///< Local storage, written in seq mode
+	std::unique_ptr<Channel> _storage_load; ///< Reader of local storage
+	tll::Channel::Url _storage_url;
+	long long _storage_seq = -1; ///< Last seq in local storage
+	bool _storage_write = false;
+	std::optional<long long> _local_seq; ///< Seq to start reading local storage from
+
+	/// Overflow file for online data that does not fit into buffer
+	struct Spill {
+		bool enable = false;
+		std::string dir;
+		std::string filename;
+		std::unique_ptr<Channel> writer;
+		std::unique_ptr<Channel> reader;
+		size_t count = 0; ///< Number of messages in spill file
+
+		bool active() const { return writer != nullptr; }
+	} _spill;
+
+	/// Additional request connection that downloads part of history
+	struct Chunk {
+		StreamClient * parent = nullptr;
+		std::unique_ptr<Channel> channel;
+		std::vector<char> request;
+		long long begin = 0; ///< First requested seq
+		long long end = 0; ///< First seq of the next chunk
+		bool reply = false;
+		bool done = false;
+		std::list<std::vector<char>> data; ///< Messages waiting for previous chunks
+		size_t data_size = 0; ///< Size of buffered messages
+		bool suspended = false; ///< Channel is suspended until buffered data is delivered
+		std::unique_ptr<tll::lz4::StreamDecode> lz4; ///< Decoder of compressed history data
+
+		int on_data(const tll_msg_t *msg);
+		int on_state(const tll_msg_t *msg);
+	};
+
+	std::vector<std::unique_ptr<Chunk>> _chunks;
+	size_t _chunks_active = 0; ///< Number of chunks used in current recovery
+	size_t _chunk_head = 0; ///< First chunk that is not delivered to user
+	long long _chunk_min = 0;
+	std::list<std::vector<char>> _chunk_pending; ///< Request channel data waiting for chunks
+	size_t _chunk_pending_size = 0;
+	bool _chunk_suspended = false; ///< Request channel is suspended until chunks are processed
+
+	enum class Compression { None, LZ4 };
+	Compression _compression = Compression::None; ///< Requested compression of history data
+	std::unique_ptr<tll::lz4::StreamDecode> _lz4; ///< Decoder of main request channel data
+
 	State _state;
 
 	long long _seq = -1;
@@ -42,13 +93,32 @@ class StreamClient : public tll::channel::LastSeqRx<StreamClient, tll::channel::
 	tll::Config _reopen_cfg;
 	bool _report_block_end = true;
 
+	std::list<std::string> _msgid_include_list;
+	std::list<std::string> _msgid_exclude_list;
+	std::set<int> _msgid_include; ///< Receive only these messages, if not empty
+	std::set<int> _msgid_exclude; ///< Drop these messages
+
  public:
 	static constexpr std::string_view channel_protocol() { return "stream+"; }
 	static constexpr auto prefix_config_policy() { return PrefixConfigPolicy::Manual; }
 
+	struct StatType : public lastseq::Stat<LastSeqMode::Rx, Base::StatType>
+	{
+		tll::stat::Integer<tll::stat::Max, tll::stat::Unknown, 'o', 'v', 'e', 'r', 'l', 'a', 'p'> overlap;
+		tll::stat::Integer<tll::stat::Max, tll::stat::Bytes, 'o', 'v', 'e', 'r', 'l', 'a', 'p'> overlap_bytes;
+		tll::stat::Integer<tll::stat::Sum, tll::stat::Unknown, 's', 'p', 'i', 'l', 'l'> spill;
+		tll::stat::Integer<tll::stat::Sum, tll::stat::Bytes, 's', 'p', 'i', 'l', 'l'> spill_bytes;
+	};
+
+	tll::stat::BlockT<StatType> * stat() { return static_cast<tll::stat::BlockT<StatType> *>(this->internal.stat); }
+
 	int _init(const tll::Channel::Url &url, tll::Channel *master);
 	void _free()
 	{
+		_spill_reset();
+		_chunks.clear();
+		_storage_load.reset();
+		_storage.reset();
 		_request.reset();
 		return Base::_free();
 	}
@@ -96,15 +166,89 @@ class StreamClient : public tll::channel::LastSeqRx<StreamClient, tll::channel::
 	}
 
 	inline int _on_request_data(const tll::Channel *, const tll_msg_t *msg);
+	/// Handle decompressed message from request channel
+	int _on_request_message(const tll_msg_t *msg);
 	int _on_request_active();
 	int _on_request_error();
 	int _on_request_closing() { return 0; }
 	int _on_request_closed();
 
+	int _init_storage(const tll::Channel::Url &url, tll::Channel *master);
+	int _init_chunks(const tll::Channel::Url &url, tll::Channel *master, unsigned count, const std::vector<std::string> &hosts);
+
+	/// Split history into chunks and open request channels
+	int _request_start();
+	/// Deliver buffered chunk data in order, returns when head chunk is not finished
+	int _chunk_flush();
+	/// Deliver history message from chunk
+	int _chunk_deliver(const tll_msg_t *msg);
+	static void _chunk_push(std::list<std::vector<char>> &list, const tll_msg_t *msg);
+	static tll_msg_t _chunk_msg(const std::vector<char> &data);
+
+	/// Buffer message, suspend channel when buffered data is larger then online buffer
+	void _chunk_hold(tll::Channel * channel, std::list<std::vector<char>> &list, size_t &size, bool &suspended, const tll_msg_t *msg)
+	{
+		_chunk_push(list, msg);
+		size += list.back().size();
+		if (suspended || size <= _ring.data_capacity())
+			return;
+		_log.info("Buffered {} bytes from {}, suspend it until previous chunks are processed", size, channel->name());
+		suspended = true;
+		channel->suspend();
+	}
+
+	/// Drop buffered data and resume channel
+	static void _chunk_release(tll::Channel * channel, std::list<std::vector<char>> &list, size_t &size, bool &suspended)
+	{
+		list.clear();
+		size = 0;
+		if (suspended)
+			channel->resume();
+		suspended = false;
+	}
+
+	/// Initialize decoder from Reply message attributes, old servers send Reply without them
+	int _reply_compression(const tll_msg_t *msg, std::unique_ptr<tll::lz4::StreamDecode> &lz4);
+	/// Decompress message body in place of original message, return null on error
+	const tll_msg_t * _decompress(tll::lz4::StreamDecode * lz4, const tll_msg_t *msg, tll_msg_t &result);
+	int _local_open();
+	int _on_storage_load(const tll_msg_t *msg);
+
+	/// Write message into local storage
+	int _store(const tll_msg_t *msg)
+	{
+		if (!_storage_write || msg->seq <= _storage_seq)
+			return 0;
+		if (auto r = _storage->post(msg); r)
+			return state_fail(r, "Failed to write message {} into local storage", msg->seq);
+		_storage_seq = msg->seq;
+		return 0;
+	}
+
+	/// Write online message into spill file when buffer is full
+	int _spill_write(const tll_msg_t *msg);
+	/// Deliver next message from spill file, return EAGAIN when it is drained
+	int _spill_process();
+	int _on_spill_data(const tll_msg_t *msg);
+	void _spill_reset();
+
 	int _report_online();
 	int _report_block();
 	int _post_done(long long seq);
 
+	/// Check if message is dropped by msgid filter
+	bool _filtered(int msgid) const
+	{
+		if (_msgid_include.size())
+			return _msgid_include.find(msgid) == _msgid_include.end();
+		return _msgid_exclude.find(msgid) != _msgid_exclude.end();
+	}
+
+	/// Fill msgid filters from open parameters and add them to request
+	int _msgid_filter_init();
+	/// Parse list of message names or ids
+	int _parse_msgid_list(std::set<int> &result, const std::list<std::string> &list);
+
 	void _reset_config_cb(tll::Config cfg, std::string_view path)
 	{
 		if (auto v = cfg.get(path); v)
@@ -5,7 +5,13 @@
 
 namespace stream_scheme {
 
-static constexpr std::string_view scheme_string = R"(yamls+gz://eJyNkb0OgjAUhXef4m5NjCSihoHNqC/g4GpQrqaxFrxtTYzh3S0/hYggbKR8OaffqQcyumMIjE0AUJq7Cu0HADsgKZ5IFsJbv1JLcKn9YFYw9oxtDBFKbf/7WTbxXMxaa+InozHPu3AUcRXowbtCohqZQRnNlD2RV5a1yGckTBdVt+3xYVDpvIvH9iZ+b+mz0qnDnF+7U+GjgaxzsPpBzoLn5kO3P4nkfBuk6jVUg06bFb9kU/Fyqot5r6qIlD6O0KByPIzHwIXMGFAh2a3/PdqOKCHnsez3wIIb2m+4b1M81zaR6EpX/aWdhh/vwfAV)";
+static constexpr std::string_view scheme_string = R"(yamls+gz://eJytkT1rwzAQhvf+Cm2CYkPcmlC8lTRbpwwdugRFvraisqRIckow/u89+ZOmMfaQzaDn7n2fc0wUKyAjlN4Roo0XWrmMVJQbE4cXZxgHiu/OW2DF3vEvKIDWSIMqC5fhByF0q7jOhfpEsvJngwtLofxT1EBh3+t7im9JROiO/eDXqq7byTewDkPHQZxL1uPgprQWlA/DOBL3dZ+9t+JQegi9PwTIvKsSk6pD2IBEpF0dJELJ+oI8MVleo4a0HRxLcD5kiRybJJOhp05nWNb7XWY6OI4QOq/TfwiXIpjPtT9Izb9nqeEabkTvxyv+kTXy3Ks+rCZVJXN+v0DDtseDfAncyCwBHVi89Q21t9Zq22s/TmtDw83lTtYb8jbN333RCvrQdDr06kF+AWTiH+s=)";
+
+enum class Encoding: uint8_t
+{
+	Raw = 0,
+	LZ4 = 1,
+};
 
 enum class Version: int16_t
 {
@@ -84,7 +90,7 @@ struct Request
 
 struct Reply
 {
-	static constexpr size_t meta_size() { return 32; }
+	static constexpr size_t meta_size() { return 40; }
 	static constexpr std::string_view meta_name() { return "Reply"; }
 	static constexpr int meta_id() { return 20; }
 
@@ -112,6 +118,10 @@ struct Reply
 
 		std::string_view get_server() const { return this->template _get_string<tll_scheme_offset_ptr_t>(24); }
 		void set_server(std::string_view v) { return this->template _set_string<tll_scheme_offset_ptr_t>(24, v); }
+
+		using type_attributes = tll::scheme::binder::List<Buf, Attribute::binder_type<Buf>, tll_scheme_offset_ptr_t>;
+		const type_attributes get_attributes() const { return this->template _get_binder<type_attributes>(32); }
+		type_attributes get_attributes() { return this->template _get_binder<type_attributes>(32); }
 	};
 
 	template <typename Buf>
@@ -181,6 +191,21 @@ struct ClientDone
 
 } // namespace stream_scheme
 
+template <>
+struct tll::conv::dump<stream_scheme::Encoding> : public to_string_from_string_buf<stream_scheme::Encoding>
+{
+	template <typename Buf>
+	static inline std::string_view to_string_buf(const stream_scheme::Encoding &v, Buf &buf)
+	{
+		switch (v) {
+		case stream_scheme::Encoding::LZ4: return "LZ4";
+		case stream_scheme::Encoding::Raw: return "Raw";
+		default: break;
+		}
+		return tll::conv::to_string_buf<uint8_t, Buf>((uint8_t) v, buf);
+	}
+};
+
 template <>
 struct tll::conv::dump<stream_scheme::Version> : public to_string_from_string_buf<stream_scheme::Version>
 {
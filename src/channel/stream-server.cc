@@ -13,9 +13,14 @@
 #include "channel/blocks.scheme.h"
 
 #include "tll/util/size.h"
+#include "tll/util/string.h"
+#include "tll/util/time.h"
 #include "tll/scheme/encoder.h"
 #include "tll/scheme/merge.h"
 
+#include "tll/scheme/channel/timer.h"
+
+#include <sys/eventfd.h>
 #include <sys/fcntl.h>
 #include <unistd.h>
 
@@ -55,9 +60,29 @@ int StreamServer::_init(const Channel::Url &url, tll::Channel *master)
 	_rotate_on_block = reader.getT("rotate-on-block", std::string());
 	_init_config = url.sub("init-message-data").value_or(_init_config);
 
+	_replay.messages = reader.getT<unsigned>("replay-messages", 0);
+	_replay.bytes = reader.getT<util::Size>("replay-bytes", 0);
+	auto replay_rate = reader.getT<util::SizeT<double>>("replay-rate", 0);
+	_replay.online_priority = reader.getT("replay-online-priority", true);
+	_replay_threads = reader.getT<unsigned>("replay-threads", 0);
+	_replay_ring = reader.getT<util::Size>("replay-ring", 1024 * 1024);
+	_compression = reader.getT("compression", true);
+	_compression_block = reader.getT<util::Size>("compression-block", 64 * 1024);
+
 	if (!reader)
 		return _log.fail(EINVAL, "Invalid url: {}", reader.error());
 
+	if (replay_rate < 0)
+		return _log.fail(EINVAL, "Negative replay rate: {}", (double) replay_rate);
+	if (replay_rate > 0) {
+		rate::Settings conf;
+		conf.speed = replay_rate;
+		conf.limit = std::max<long long>(replay_rate, 1);
+		conf.initial = conf.limit;
+		_replay.rate = conf;
+	}
+	_replay.enable = _replay.messages || _replay.bytes || _replay.rate;
+
 	//if (_blocks_filename.empty())
 	//	return _log.fail(EINVAL, "Need non-empty filename for data blocks");
 
@@ -142,6 +167,22 @@ int StreamServer::_init(const Channel::Url &url, tll::Channel *master)
 	if (_blocks)
 		_child_add(_blocks.get(), "blocks");
 
+	if (_replay.rate) {
+		auto curl = child_url_parse("timer://;clock=realtime", "replay-timer");
+		if (!curl)
+			return _log.fail(EINVAL, "Failed to parse timer url: {}", curl.error());
+		_replay_timer = context().channel(*curl);
+		if (!_replay_timer)
+			return _log.fail(EINVAL, "Failed to create replay timer channel");
+		_replay_timer->callback_add([](auto * c, auto * m, void * user) {
+				auto self = static_cast<StreamServer *>(user);
+				self->_replay.timer = false;
+				self->_update_dcaps(dcaps::Process | dcaps::Pending);
+				return 0;
+			}, this, TLL_MESSAGE_MASK_DATA);
+		_child_add(_replay_timer.get(), "replay-timer");
+	}
+
 	return 0;
 }
 
@@ -149,6 +190,28 @@ int StreamServer::_open(const ConstConfig &url)
 {
 	_seq = -1;
 
+	_replay.bucket.reset();
+	_replay.last = 0;
+	_replay.online = _replay.skipped = _replay.timer = false;
+	if (_replay_timer && _replay_timer->open())
+		return _log.fail(EINVAL, "Failed to open replay timer channel");
+
+	if (_replay_threads) {
+		auto fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (fd == -1)
+			return _log.fail(EINVAL, "Failed to create eventfd: {}", strerror(errno));
+		_update_fd(fd);
+		_dcaps_poll(dcaps::CPOLLIN);
+		_update_dcaps(dcaps::Process);
+
+		_log.info("Start {} replay threads", _replay_threads);
+		for (auto i = 0u; i < _replay_threads; i++) {
+			auto & w = _workers.emplace_back(new Worker);
+			w->notify = fd;
+			w->start();
+		}
+	}
+
 	Config sopen;
 	if (auto sub = url.sub("storage"); sub)
 		sopen = sub->copy();
@@ -274,10 +337,22 @@ int StreamServer::_close(bool force)
 	config_info().setT("seq", _seq);
 	_config.remove("client");
 
-	for (auto & [_, p] : _clients) {
+	_workers.clear(); // Threads are stopped, clients are not used by them anymore
+	_workers_next = 0;
+
+	for (auto & [addr, p] : _clients) {
+		_config.unlink(fmt::format("info.replay.{}", addr));
 		p.reset();
 	}
 	_clients.clear();
+	for (auto & n : _clients_retired)
+		n.mapped().reset();
+	_clients_retired.clear();
+	if (auto fd = _update_fd(-1); fd != -1)
+		::close(fd);
+
+	if (_replay_timer)
+		_replay_timer->close(true);
 
 	if (_request->state() != tll::state::Closed)
 		_request->close(force);
@@ -385,14 +460,15 @@ int StreamServer::_on_request_control(const tll_msg_t *msg)
 		return 0;
 	if (msg->msgid == _control_msgid_disconnect) {
 		_log.info("Client {} disconnected", it->second.name);
-		it->second.reset();
-		_clients.erase(it);
+		_client_drop(it);
 	} else if (msg->msgid == _control_msgid_full) {
 		_log.debug("Suspend storage channel");
-		it->second.storage->suspend();
+		it->second.full = true;
+		it->second.suspend_update();
 	} else if (msg->msgid == _control_msgid_ready) {
 		_log.debug("Resume storage channel");
-		it->second.storage->resume();
+		it->second.full = false;
+		it->second.suspend_update();
 	}
 	return 0;
 }
@@ -407,15 +483,19 @@ int StreamServer::_on_request_data(const tll_msg_t *msg)
 		it->second.state = Client::State::Closed;
 		_log.info("Drop client '{}' (addr {})", it->second.name, msg->addr.u64);
 		std::string name = std::move(it->second.name);
-		it->second.reset();
-		_clients.erase(it);
+		_client_drop(it);
 		_request_disconnect(name, msg->addr);
 		return 0;
 	} else if (msg->msgid != stream_scheme::Request::meta_id())
 		return _log.fail(0, "Invalid message from client: {}", msg->msgid);
 
-	auto r = _clients.emplace(msg->addr.u64, this);
-	auto & client = r.first->second;
+	if (auto it = _clients.find(msg->addr.u64); it != _clients.end() && it->second.worker) {
+		_log.info("New request from client '{}' (addr {}), drop old one", it->second.name, msg->addr.u64);
+		_client_drop(it);
+	}
+
+	auto emplace = _clients.emplace(msg->addr.u64, this);
+	auto & client = emplace.first->second;
 	client.msg = {};
 	client.msg.addr = msg->addr;
 
@@ -434,12 +514,31 @@ int StreamServer::_on_request_data(const tll_msg_t *msg)
 			_log.error("Failed to post error message");
 
 		std::string name = std::move(client.name);
-		client.reset();
-		_clients.erase(msg->addr.u64);
+		_client_drop(emplace.first);
 		_request_disconnect(name, msg->addr);
 		return 0;
 	}
-	_child_add(client.storage.get());
+
+	auto prefix = fmt::format("replay.{}", msg->addr.u64);
+	config_info().setT(prefix + ".name", client.name);
+	config_info().set_ptr(prefix + ".seq", &client.replay_seq);
+	config_info().set_ptr(prefix + ".lag", &client.lag);
+
+	if (_workers.size()) {
+		client.ring.reset(new Ring(_replay_ring));
+		client.worker = _workers[_workers_next++ % _workers.size()].get();
+	}
+
+	if (_replay.enable) { // Wait for next scheduler step
+		client.throttled = true;
+		client.suspend_update();
+		_update_dcaps(dcaps::Process | dcaps::Pending);
+	}
+
+	if (client.worker)
+		client.worker->add(&client);
+	else
+		_child_add(client.storage.get());
 	return 0;
 }
 
@@ -460,12 +559,47 @@ tll::result_t<int> StreamServer::Client::init(const tll_msg_t *msg)
 
 	name = req.get_client();
 	seq = req.get_seq();
+	replay_seq = -1;
+	lag = parent->_seq - seq + 1;
 	auto block = req.get_block();
 	_log.info("Request from client '{}' (addr {}) for seq {}, block '{}'", name, msg->addr.u64, seq, block);
 
 	if (seq < 0)
 		return error(fmt::format("Negative seq: {}", seq));
 
+	msgid_include.clear();
+	msgid_exclude.clear();
+	lz4.reset();
+	for (auto a : req.get_attributes()) {
+		std::set<int> * list = nullptr;
+		if (a.get_attribute() == "compression") {
+			if (a.get_value() != "lz4")
+				return error(fmt::format("Unsupported compression '{}'", a.get_value()));
+			if (!parent->_compression) {
+				parent->_log.info("Client '{}' requested compression, but it is disabled", name);
+				continue;
+			}
+			lz4.reset(new tll::lz4::StreamEncode);
+			if (lz4->init(parent->_compression_block))
+				return error("Failed to initialize lz4 encoder");
+			lz4_buf.resize(LZ4_compressBound(parent->_compression_block) + 1); // Trailing encoding byte
+			parent->_log.info("Client '{}' replay is compressed with lz4, block {}", name, parent->_compression_block);
+			continue;
+		} else if (a.get_attribute() == "msgid-include")
+			list = &msgid_include;
+		else if (a.get_attribute() == "msgid-exclude")
+			list = &msgid_exclude;
+		else
+			continue;
+		for (auto i : tll::split<','>(a.get_value())) {
+			auto id = conv::to_any<int>(i);
+			if (!id)
+				return error(fmt::format("Invalid msgid '{}' in {}: {}", i, a.get_attribute(), id.error()));
+			list->insert(*id);
+		}
+		_log.info("Client '{}' {}: {}", name, a.get_attribute(), a.get_value());
+	}
+
 	if (block.size()) {
 		if (!parent->_blocks)
 			return error("Requested block, but no block storage configured");
@@ -525,9 +659,18 @@ tll::result_t<int> StreamServer::Client::init(const tll_msg_t *msg)
 	auto r = stream_scheme::Reply::bind(data);
 	r.view().resize(r.meta_size());
 
+	reply_seq = parent->_seq;
 	r.set_last_seq(parent->_seq);
 	r.set_block_seq(block_end);
 	r.set_requested_seq(seq);
+	if (lz4) {
+		auto attributes = r.get_attributes();
+		attributes.resize(2);
+		(*attributes.begin()).set_attribute("compression");
+		(*attributes.begin()).set_value("lz4");
+		(*(attributes.begin() + 1)).set_attribute("compression-block");
+		(*(attributes.begin() + 1)).set_value(conv::to_string(parent->_compression_block));
+	}
 
 	this->msg.msgid = r.meta_id();
 	this->msg.data = r.view().data();
@@ -541,29 +684,96 @@ tll::result_t<int> StreamServer::Client::init(const tll_msg_t *msg)
 void StreamServer::Client::reset()
 {
 	state = State::Closed;
+	worker = nullptr; // Worker already released client or is stopped
 	storage.reset();
 	storage_next.reset();
+	ring.reset();
+	pending.clear();
+	lz4.reset();
+}
+
+void StreamServer::_client_drop(std::map<uint64_t, Client>::iterator it)
+{
+	_config.unlink(fmt::format("info.replay.{}", it->first));
+	auto & client = it->second;
+	if (client.worker) { // Worker thread can be in the middle of processing client storage
+		client.worker->remove(&client);
+		_clients_retired.push_back(_clients.extract(it));
+		return;
+	}
+	client.reset();
+	_clients.erase(it);
 }
 
 int StreamServer::Client::on_storage(const tll_msg_t * m)
 {
+	if (worker)
+		return on_storage_worker(m);
 	if (m->type != TLL_MESSAGE_DATA) {
 		if (m->type == TLL_MESSAGE_STATE)
 			return on_storage_state((tll_state_t) m->msgid);
 		return 0;
 	}
+	switch (filter(m)) {
+	case Filter::Pass:
+		return on_replay(m);
+	case Filter::Drop:
+		return 0;
+	case Filter::Empty: {
+		auto copy = *m;
+		copy.size = 0;
+		return on_replay(&copy);
+	}
+	}
+	return 0;
+}
+
+int StreamServer::Client::on_replay(const tll_msg_t * m)
+{
 	msg.type = m->type;
 	msg.msgid = m->msgid;
 	msg.seq = m->seq;
 	msg.flags = m->flags;
 	msg.data = m->data;
 	msg.size = m->size;
-	if (auto r = parent->_request->post(&msg, 0); r) {
+
+	int r = 0;
+	if (lz4) { // Compress message body, header is sent as is, body is followed by encoding byte
+		if (m->size > lz4->ring.block) { // Does not fit into compression ring, send as is
+			if (lz4_buf.size() < m->size + 1)
+				lz4_buf.resize(m->size + 1);
+			memcpy(lz4_buf.data(), m->data, m->size);
+			lz4_buf[m->size] = (char) stream_scheme::Encoding::Raw;
+			msg.data = lz4_buf.data();
+			msg.size = m->size + 1;
+		} else {
+			memcpy(lz4->view().data(), m->data, m->size);
+			auto data = lz4->compress(lz4_buf, m->size, 1);
+			if (!data.data) {
+				parent->_log.error("Failed to compress message");
+				r = EINVAL;
+			} else
+				lz4_buf[data.size] = (char) stream_scheme::Encoding::LZ4;
+			msg.data = data.data;
+			msg.size = data.size + 1;
+		}
+	}
+
+	if (!r)
+		r = parent->_request->post(&msg, 0);
+	if (r) {
 		parent->_log.error("Failed to post data for client '{}': seq {}", name, msg.seq);
 		state = State::Error;
-		storage->close();
+		if (worker) { // Storage is owned by worker thread
+			parent->_clients_drop.push_back(msg.addr);
+			parent->_update_dcaps(dcaps::Process | dcaps::Pending);
+		} else
+			storage->close();
 		return 0;
 	}
+	replay_seq = m->seq;
+	lag = parent->_seq - m->seq;
+	parent->_replay_account(*this, m);
 	return 0;
 }
 
@@ -584,9 +794,10 @@ int StreamServer::Client::on_storage_state(tll_state_t s)
 	case TLL_STATE_CLOSING:
 		break;
 	case TLL_STATE_CLOSED:
-		if (storage_next && storage_next->state() == tll::state::Active) {
+		if (!worker && storage_next && storage_next->state() == tll::state::Active) {
 			parent->_child_del(storage.get());
 			std::swap(storage, storage_next); // Can not destroy in callback
+			suspend_update();
 			parent->_child_add(storage.get());
 			return 0;
 		}
@@ -602,6 +813,221 @@ int StreamServer::Client::on_storage_state(tll_state_t s)
 	return 0;
 }
 
+int StreamServer::Client::on_storage_worker(const tll_msg_t * m)
+{
+	// Called from worker thread, only storage channels and ring can be used here
+	if (m->type == TLL_MESSAGE_DATA) {
+		switch (filter(m)) {
+		case Filter::Pass:
+			push(m->type, m->msgid, m->seq, m->data, m->size);
+			break;
+		case Filter::Drop:
+			break;
+		case Filter::Empty:
+			push(m->type, m->msgid, m->seq, nullptr, 0);
+			break;
+		}
+		return 0;
+	} else if (m->type != TLL_MESSAGE_STATE)
+		return 0;
+
+	switch ((tll_state_t) m->msgid) {
+	case TLL_STATE_CLOSED:
+		if (storage_next && storage_next->state() == tll::state::Active) {
+			std::swap(storage, storage_next); // Can not destroy in callback
+			return 0;
+		}
+		break;
+	case TLL_STATE_ERROR:
+		break;
+	default:
+		return 0;
+	}
+	push(m->type, m->msgid, 0, nullptr, 0);
+	return 0;
+}
+
+void StreamServer::Client::push(short type, int msgid, long long seq, const void * data, size_t size)
+{
+	const Frame frame = { type, msgid, seq };
+	if (pending.empty()) {
+		void * ptr = nullptr;
+		auto r = ring_write_begin(&ring->ring, &ptr, sizeof(frame) + size);
+		if (r == 0) {
+			memcpy(ptr, &frame, sizeof(frame));
+			memcpy(static_cast<char *>(ptr) + sizeof(frame), data, size);
+			ring_write_end(&ring->ring, ptr, sizeof(frame) + size);
+			pushed = true;
+			return;
+		} else if (r == ERANGE) { // Message can never fit into ring, report storage error instead
+			push(TLL_MESSAGE_STATE, TLL_STATE_ERROR, 0, nullptr, 0);
+			return;
+		}
+	}
+
+	auto & buf = pending.emplace_back(sizeof(frame) + size);
+	memcpy(buf.data(), &frame, sizeof(frame));
+	memcpy(buf.data() + sizeof(frame), data, size);
+}
+
+bool StreamServer::Client::flush()
+{
+	while (pending.size()) {
+		auto & buf = pending.front();
+		if (ring_write(&ring->ring, buf.data(), buf.size()))
+			return false;
+		pending.pop_front();
+		pushed = true;
+	}
+	return true;
+}
+
+void StreamServer::Client::drain()
+{
+	bool shifted = false;
+	while (state == State::Active && !throttled && !full) {
+		const void * data = nullptr;
+		size_t size = 0;
+		if (ring_read(&ring->ring, &data, &size))
+			break;
+
+		Frame frame;
+		memcpy(&frame, data, sizeof(frame));
+		if (frame.type == TLL_MESSAGE_DATA) {
+			tll_msg_t m = { TLL_MESSAGE_DATA };
+			m.msgid = frame.msgid;
+			m.seq = frame.seq;
+			m.data = static_cast<const char *>(data) + sizeof(frame);
+			m.size = size - sizeof(frame);
+			on_replay(&m);
+		} else
+			on_storage_state((tll_state_t) frame.msgid);
+		ring_shift(&ring->ring);
+		shifted = true;
+	}
+
+	if (shifted && worker) // Worker may wait for free space
+		worker->wake();
+}
+
+void StreamServer::Worker::add(Client * client)
+{
+	{
+		std::unique_lock<std::mutex> l(lock);
+		clients.push_back(client);
+	}
+	wake();
+}
+
+void StreamServer::Worker::wake()
+{
+	events++;
+	if (!waiting)
+		return;
+	{
+		// Lock is needed to avoid lost wakeup between event check and wait in worker thread
+		std::unique_lock<std::mutex> l(lock);
+	}
+	cond.notify_one();
+}
+
+void StreamServer::Worker::remove(Client * client)
+{
+	{
+		std::unique_lock<std::mutex> l(lock);
+		removed.push_back(client);
+	}
+	wake();
+}
+
+std::list<StreamServer::Client *> StreamServer::Worker::collect()
+{
+	std::unique_lock<std::mutex> l(lock);
+	return std::move(released);
+}
+
+void StreamServer::Worker::shutdown()
+{
+	{
+		std::unique_lock<std::mutex> l(lock);
+		stop = true;
+	}
+	cond.notify_one();
+	if (thread.joinable())
+		thread.join();
+	thread = {};
+}
+
+void StreamServer::Worker::run()
+{
+	std::vector<Client *> pass;
+	std::unique_lock<std::mutex> l(lock);
+	while (!stop) {
+		// Clients are removed only between passes, lock is not held while storage is processed
+		bool release = removed.size();
+		for (auto c : removed)
+			clients.remove(c);
+		released.splice(released.end(), removed);
+		pass.assign(clients.begin(), clients.end());
+		const unsigned seen = events;
+		l.unlock();
+
+		bool progress = false;
+		bool pushed = false;
+		for (auto c : pass) {
+			for (auto i = 0u; i < batch; i++) {
+				if (!c->flush()) // Ring is full, wait until main thread reads from it
+					break;
+				if (c->storage->process(0, 0)) {
+					// Channel may have more work without new data, for example next file to open
+					progress |= (c->storage->dcaps() & dcaps::Pending) != 0;
+					break;
+				}
+				progress = true;
+			}
+			pushed |= c->pushed;
+			c->pushed = false;
+		}
+
+		if (pushed || release) {
+			int64_t w = 1;
+			auto r = write(notify, &w, sizeof(w));
+			(void) r; // Eventfd counter can not overflow, write never fails
+		}
+
+		l.lock();
+		if (progress || removed.size())
+			continue;
+		// Sleep until new data is stored, ring is drained or client list is changed
+		waiting = true;
+		if (!stop && events == seen)
+			cond.wait(l);
+		waiting = false;
+	}
+}
+
+void StreamServer::_replay_drain()
+{
+	int64_t w = 0;
+	if (read(fd(), &w, sizeof(w)) != sizeof(w) && errno != EAGAIN)
+		_log.error("Failed to read from eventfd: {}", strerror(errno));
+
+	for (auto & [_, c] : _clients) {
+		if (c.ring)
+			c.drain();
+	}
+
+	for (auto & w : _workers) {
+		for (auto c : w->collect()) {
+			auto it = std::find_if(_clients_retired.begin(), _clients_retired.end(), [c](auto & n) { return &n.mapped() == c; });
+			if (it == _clients_retired.end())
+				continue;
+			it->mapped().reset();
+			_clients_retired.erase(it);
+		}
+	}
+}
+
 int StreamServer::_try_rotate_on_block(const tll::scheme::Message * message, const tll_msg_t * msg)
 {
 	if (_rotate_on_block.empty())
@@ -674,6 +1100,9 @@ int StreamServer::_post(const tll_msg_t * msg, int flags)
 		return _log.fail(r, "Failed to store message {}", msg->seq);
 	_seq = msg->seq;
 	_last_seq_tx(msg->seq);
+	_replay.online = true;
+	for (auto & w : _workers) // Clients waiting at the end of storage can read new message
+		w->wake();
 	return _child->post(msg);
 }
 
@@ -701,11 +1130,125 @@ int StreamServer::_process(long timeout, int flags)
 		}
 
 		std::string name = std::move(it->second.name);
-		it->second.reset();
-		_clients.erase(it);
+		_client_drop(it);
 		_request_disconnect(name, addr);
 	}
 	_clients_drop.clear();
-	_update_dcaps(0, dcaps::Process | dcaps::Pending);
+	if (_workers.size()) {
+		_update_dcaps(0, dcaps::Pending);
+		_replay_drain();
+	} else
+		_update_dcaps(0, dcaps::Process | dcaps::Pending);
+	if (_replay.enable)
+		return _replay_step();
+	return 0;
+}
+
+void StreamServer::_replay_account(Client &client, const tll_msg_t * msg)
+{
+	if (_stat_enable) {
+		auto page = stat()->acquire();
+		if (page) {
+			page->replay = 1;
+			page->replay_bytes = msg->size;
+			page->lag = client.lag;
+			stat()->release(page);
+		}
+	}
+
+	if (!_replay.enable)
+		return;
+
+	bool exhausted = false;
+	if (client.budget_msg > 0 && --client.budget_msg == 0)
+		exhausted = true;
+	if (client.budget_bytes > 0 && (client.budget_bytes -= msg->size) <= 0)
+		exhausted = true;
+	if (_replay.rate) {
+		_replay.bucket.consume(msg->size);
+		if (_replay.bucket.empty())
+			exhausted = true;
+	}
+	if (!exhausted)
+		return;
+
+	client.throttled = true;
+	client.suspend_update();
+	if (_stat_enable) {
+		auto page = stat()->acquire();
+		if (page) {
+			page->throttle = 1;
+			stat()->release(page);
+		}
+	}
+	if (!_replay.timer)
+		_update_dcaps(dcaps::Process | dcaps::Pending);
+}
+
+int StreamServer::_replay_step()
+{
+	if (_replay.online_priority && _replay.online && !_replay.skipped) {
+		// Let online data go first, but do not skip two steps in a row to avoid replay starvation
+		_replay.online = false;
+		_replay.skipped = true;
+		_update_dcaps(dcaps::Process | dcaps::Pending);
+		return 0;
+	}
+	_replay.online = false;
+	_replay.skipped = false;
+
+	size_t waiting = 0;
+	for (auto & [_, c] : _clients) {
+		if (c.state == Client::State::Active && c.throttled)
+			waiting++;
+	}
+	if (!waiting)
+		return 0;
+
+	long long tickets = 0;
+	if (_replay.rate) {
+		auto now = tll::time::now();
+		_replay.bucket.update(*_replay.rate, now);
+		if (_replay.bucket.empty())
+			return _replay_rearm(_replay.bucket.next(*_replay.rate, now));
+		tickets = _replay.bucket.tickets;
+	}
+
+	auto it = _clients.upper_bound(_replay.last);
+	for (size_t i = 0; i < _clients.size(); i++, it++) {
+		if (it == _clients.end())
+			it = _clients.begin();
+		auto & c = it->second;
+		if (c.state != Client::State::Active || !c.throttled)
+			continue;
+
+		c.budget_msg = _replay.messages;
+		c.budget_bytes = _replay.bytes;
+		if (_replay.rate) {
+			if (tickets <= 0) // Remaining clients are first on next step
+				break;
+			auto share = std::max<long long>(tickets / waiting, 1);
+			if (c.budget_bytes == 0 || c.budget_bytes > share)
+				c.budget_bytes = share;
+			tickets -= share;
+		}
+
+		c.throttled = false;
+		c.suspend_update();
+		_replay.last = it->first;
+	}
+	return 0;
+}
+
+int StreamServer::_replay_rearm(tll::duration dt)
+{
+	timer_scheme::relative data = { dt };
+	tll_msg_t msg = {};
+	msg.msgid = data.id;
+	msg.data = &data;
+	msg.size = sizeof(data);
+	if (auto r = _replay_timer->post(&msg); r)
+		return _log.fail(r, "Failed to rearm replay timer");
+	_replay.timer = true;
 	return 0;
 }
@@ -12,8 +12,16 @@
 #include "tll/channel/lastseq.h"
 #include "tll/channel/autoseq.h"
 #include "tll/channel/prefix.h"
+#include "tll/channel/rate.h"
+#include "tll/ring.h"
+#include "tll/util/lz4block.h"
 
+#include <atomic>
+#include <condition_variable>
 #include <list>
+#include <mutex>
+#include <set>
+#include <thread>
 
 namespace tll::channel {
 
@@ -30,6 +38,25 @@ class StreamServer : public tll::channel::LastSeqTx<StreamServer, tll::channel::
 
 	long long _seq = -1;
 
+	struct Worker;
+
+	/// Ring used to pass messages from worker thread to main thread
+	struct Ring
+	{
+		ringbuffer_t ring = {};
+
+		Ring(size_t size) { ring_init(&ring, size, 0); }
+		~Ring() { ring_free(&ring); }
+	};
+
+	/// Header of replay frame in the ring, followed by message data
+	struct Frame
+	{
+		short type; ///< Message type, TLL_MESSAGE_DATA or TLL_MESSAGE_STATE
+		int msgid;
+		long long seq;
+	};
+
 	struct Client
 	{
 		Client(StreamServer * s) : parent(s) {}
@@ -38,6 +65,37 @@ class StreamServer : public tll::channel::LastSeqTx<StreamServer, tll::channel::
 
 		long long seq = -1;
 		long long block_end = -1;
+		long long replay_seq = -1; ///< Last seq sent from storage
+		long long lag = 0; ///< Distance between last stored seq and last sent seq
+
+		long long budget_msg = 0; ///< Messages left in current replay step
+		long long budget_bytes = 0; ///< Bytes left in current replay step
+		bool throttled = false; ///< Storage suspended by replay scheduler
+		bool full = false; ///< Storage suspended by request channel
+
+		std::set<int> msgid_include; ///< Send only these messages, if not empty
+		std::set<int> msgid_exclude; ///< Do not send these messages
+		long long reply_seq = -1; ///< Last seq reported to the client
+
+		std::unique_ptr<tll::lz4::StreamEncode> lz4; ///< Replay compression, if requested by client
+		std::vector<char> lz4_buf;
+
+		enum class Filter { Pass, Drop, Empty };
+		/**
+		 * Check message against msgid filter
+		 *
+		 * Filtered messages after last seq reported in Reply are sent without body, so client
+		 * can detect end of history even if last messages are not interesting for it.
+		 */
+		Filter filter(const tll_msg_t * m) const
+		{
+			if (msgid_include.empty() && msgid_exclude.empty())
+				return Filter::Pass;
+			bool skip = msgid_include.size() ? !msgid_include.count(m->msgid) : msgid_exclude.count(m->msgid);
+			if (!skip)
+				return Filter::Pass;
+			return m->seq < reply_seq ? Filter::Drop : Filter::Empty;
+		}
 
 		tll_msg_t msg = {};
 		std::unique_ptr<Channel> storage; ///< Current storage channel
@@ -46,8 +104,40 @@ class StreamServer : public tll::channel::LastSeqTx<StreamServer, tll::channel::
 		StreamServer * parent = nullptr;
 		enum class State { Closed, Opening, Active, Error, Done } state = State::Closed;
 
+		/// Worker thread that owns storage channels, nullptr if they are processed by main loop
+		Worker * worker = nullptr;
+		std::unique_ptr<Ring> ring;
+		std::list<std::vector<char>> pending; ///< Frames that did not fit into ring, used by worker
+		bool pushed = false; ///< New frames were written into ring, used by worker
+
 		int on_storage(const tll_msg_t *);
 		int on_storage_state(tll_state_t);
+		int on_replay(const tll_msg_t *);
+
+		/// Worker thread callback, copy message into ring
+		int on_storage_worker(const tll_msg_t *);
+		/// Write frame into ring or pending list
+		void push(short type, int msgid, long long seq, const void * data, size_t size);
+		/// Move pending frames into ring, return true if all of them are written
+		bool flush();
+		/// Read frames from ring in main thread
+		void drain();
+
+		/// Suspend or resume storage depending on scheduler and request channel state
+		void suspend_update()
+		{
+			if (worker) { // Storage is owned by worker, ring is drained only when client is not suspended
+				if (!throttled && !full)
+					parent->_update_dcaps(dcaps::Process | dcaps::Pending);
+				return;
+			}
+			if (!storage)
+				return;
+			if (throttled || full)
+				storage->suspend();
+			else
+				storage->resume();
+		}
 
 		static int on_storage(const tll_channel_t *, const tll_msg_t * msg, void * user)
 		{
@@ -64,6 +154,66 @@ class StreamServer : public tll::channel::LastSeqTx<StreamServer, tll::channel::
 
 	std::map<uint64_t, Client> _clients;
 	std::list<tll_addr_t> _clients_drop;
+	/// Removed clients that can be still used by worker thread, destroyed when worker releases them
+	std::list<std::map<uint64_t, Client>::node_type> _clients_retired;
+
+	/// Replay scheduler settings and state
+	struct Replay
+	{
+		bool enable = false;
+		long long messages = 0; ///< Per-client message budget for one step, 0 - unlimited
+		long long bytes = 0; ///< Per-client byte budget for one step, 0 - unlimited
+		bool online_priority = true; ///< Skip replay step after online data was posted
+		std::optional<rate::Settings> rate; ///< Global replay bandwidth limit
+
+		rate::Bucket bucket;
+		uint64_t last = 0; ///< Address of last scheduled client, next step starts after it
+		bool online = false; ///< Online data posted since last step
+		bool skipped = false; ///< Last step was skipped in favor of online data
+		bool timer = false; ///< Timer is armed
+	} _replay;
+	std::unique_ptr<Channel> _replay_timer;
+
+	/// Helper thread that processes storage channels of several clients
+	struct Worker
+	{
+		unsigned batch = 64; ///< Maximum number of process calls for one client in one pass
+		int notify = -1; ///< Eventfd of the server, signalled when new frames are available
+
+		std::thread thread;
+		std::mutex lock;
+		std::condition_variable cond;
+		std::atomic<bool> stop = false;
+		std::atomic<bool> waiting = false; ///< Worker is going to sleep or sleeping
+		std::atomic<unsigned> events = 0; ///< Counter of wake up events
+
+		std::list<Client *> clients;
+		std::list<Client *> removed; ///< Clients queued for removal by main thread
+		std::list<Client *> released; ///< Removed clients that are not used by worker anymore
+
+		~Worker() { shutdown(); }
+
+		void start() { thread = std::thread(&Worker::run, this); }
+		void shutdown();
+		void add(Client * client);
+		/// Queue client for removal, it is released after current pass is finished
+		void remove(Client * client);
+		/// Take released clients, called from main thread
+		std::list<Client *> collect();
+		/// Wake up worker thread, called after frames are read from client ring or new data is stored
+		void wake();
+
+	 private:
+		void run();
+	};
+
+	unsigned _replay_threads = 0;
+	size_t _replay_ring = 0;
+
+	bool _compression = true; ///< Allow compression of replayed data
+	size_t _compression_block = 0;
+	std::vector<std::unique_ptr<Worker>> _workers;
+	unsigned _workers_next = 0;
 
 	int _control_msgid_full = 0;
 	int _control_msgid_ready = 0;
@@ -88,6 +238,16 @@ class StreamServer : public tll::channel::LastSeqTx<StreamServer, tll::channel::
 	static constexpr auto process_policy() { return ProcessPolicy::Never; }
 	static constexpr auto prefix_config_policy() { return PrefixConfigPolicy::Manual; }
 
+	struct StatType : public lastseq::Stat<LastSeqMode::Tx, Base::StatType>
+	{
+		tll::stat::Integer<tll::stat::Sum, tll::stat::Unknown, 'r', 'e', 'p', 'l', 'a', 'y'> replay;
+		tll::stat::Integer<tll::stat::Sum, tll::stat::Bytes, 'r', 'e', 'p', 'l', 'a', 'y'> replay_bytes;
+		tll::stat::Integer<tll::stat::Max, tll::stat::Unknown, 'l', 'a', 'g'> lag;
+		tll::stat::Integer<tll::stat::Sum, tll::stat::Unknown, 't', 'h', 'r', 'o', 't', 't', 'l'> throttle;
+	};
+
+	tll::stat::BlockT<StatType> * stat() { return static_cast<tll::stat::BlockT<StatType> *>(this->internal.stat); }
+
 	std::optional<const tll_channel_impl_t *> _init_replace(const tll::Channel::Url &url, tll::Channel *master);
 
 	int _init(const tll::Channel::Url &url, tll::Channel *master);
@@ -95,6 +255,7 @@ class StreamServer : public tll::channel::LastSeqTx<StreamServer, tll::channel::
 	{
 		_request.reset();
 		_storage.reset();
+		_replay_timer.reset();
 		return Base::_free();
 	}
 
@@ -145,6 +306,16 @@ class StreamServer : public tll::channel::LastSeqTx<StreamServer, tll::channel::
 	int _request_disconnect(std::string_view name, const tll_addr_t & addr);
 
 	int _on_storage_load(const tll_msg_t * msg);
+
+	/// Account message replayed to the client, suspend it when budget is exhausted
+	void _replay_account(Client &client, const tll_msg_t * msg);
+	/// Give new budgets to throttled clients in round-robin order
+	int _replay_step();
+	int _replay_rearm(tll::duration dt);
+	/// Read frames produced by worker threads
+	void _replay_drain();
+	/// Remove client, if it is served by worker thread it is destroyed after worker releases it
+	void _client_drop(std::map<uint64_t, Client>::iterator it);
 	int _try_rotate_on_block(const tll::scheme::Message * message, const tll_msg_t * msg);
 };
 
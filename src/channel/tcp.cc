@@ -10,6 +10,7 @@
 #include "tll/channel/frame.h"
 #include "tll/channel/tcp.h"
 #include "tll/channel/tcp.hpp"
+#include "tll/util/time.h"
 
 #include <fcntl.h>
 #include <sys/types.h>
@@ -17,54 +18,155 @@
 
 using namespace tll;
 
+/// Send buffer and processing settings of framed socket, shared by client and server
+struct FramedSettings
+{
+	/// Action when message is posted into full send buffer
+	enum class Policy { EAgain, Drop, Disconnect };
+
+	size_t send_hwm = 0; ///< High watermark, buffer is full when it holds more data
+	size_t send_lwm = 0; ///< Low watermark, WriteReady is reported when buffer drains to this size
+	size_t send_max = 0; ///< Maximum size of buffered data, 0 for no limit
+	Policy send_policy = Policy::EAgain;
+	unsigned process_frames = 256; ///< Maximum number of frames delivered in one process call
+	size_t coalesce_size = 16 * 1024; ///< Flush data posted with TLL_POST_MORE when it reaches this size
+
+	template <typename Reader>
+	int init(Reader &reader, tll::Logger &log, size_t snd_buffer_size)
+	{
+		send_hwm = reader.getT("send-buffer-hwm", tll::util::Size { 0 });
+		send_lwm = reader.getT("send-buffer-lwm", tll::util::Size { 0 });
+		send_max = reader.getT("send-buffer-max", tll::util::Size { 0 });
+		send_policy = reader.getT("send-buffer-policy", Policy::EAgain, {{"eagain", Policy::EAgain}, {"drop", Policy::Drop}, {"disconnect", Policy::Disconnect}});
+		process_frames = reader.getT("process-frames", 256u);
+		coalesce_size = reader.getT("coalesce-size", tll::util::Size { 16 * 1024 });
+		if (!reader)
+			return log.fail(EINVAL, "Invalid url: {}", reader.error());
+		if (send_hwm > snd_buffer_size * 0.8)
+			return log.fail(EINVAL, "Send HWM is too large: {} > 80% of send buffer {}", send_hwm, snd_buffer_size);
+		if (send_lwm && send_lwm >= send_hwm)
+			return log.fail(EINVAL, "Send LWM {} is not less then HWM {}", send_lwm, send_hwm);
+		if (send_max && send_max <= send_hwm)
+			return log.fail(EINVAL, "Send buffer limit {} is not greater then HWM {}", send_max, send_hwm);
+		if (process_frames == 0)
+			return log.fail(EINVAL, "Invalid process-frames parameter: must be non-zero");
+		if (send_hwm)
+			log.debug("Store up to {} of data on blocked connection", send_hwm);
+		return 0;
+	}
+};
+
 template <typename T, typename F>
 class FramedSocket : public tll::channel::TcpSocket<T>
 {
  protected:
-	size_t _send_hwm = 0;
+	FramedSettings _framed;
+	bool _write_full = false; ///< WriteFull is reported and WriteReady is not
+	bool * _alive = nullptr; ///< Cleared in destructor to detect socket destruction from callback
 
  public:
 	using Frame = F;
 	using FrameT = tll::frame::FrameT<Frame>;
 	using Base = tll::channel::TcpSocket<T>;
 
+	~FramedSocket()
+	{
+		if (_alive)
+			*_alive = false;
+	}
+
+	struct StatType : public Base::StatType
+	{
+		tll::stat::IntegerGroup<tll::stat::Bytes, 's', 'e', 'n', 'd'> send; ///< Data sent in one syscall
+		tll::stat::Integer<tll::stat::Max, tll::stat::Bytes, 'p', 'e', 'n', 'd', 'i', 'n', 'g'> pending; ///< Data in send buffer
+		tll::stat::Integer<tll::stat::Sum, tll::stat::Unknown, 'd', 'r', 'o', 'p'> drop;
+		tll::stat::IntegerGroup<tll::stat::Ns, 'r', 'x', 'l', 'a', 't'> rxlat; ///< Receive timestamp to callback delay
+	};
+
+	tll::stat::BlockT<StatType> * stat() { return static_cast<tll::stat::BlockT<StatType> *>(this->internal.stat); }
+
 	static constexpr std::string_view param_prefix() { return "tcp"; }
 
+	int _open(const tll::ConstConfig &cfg)
+	{
+		_write_full = false;
+		return Base::_open(cfg);
+	}
+
 	int _post_data(const tll_msg_t *msg, int flags);
 	int _process(long timeout, int flags);
 
+	void _on_rx_latency(long long time)
+	{
+		auto page = stat()->acquire();
+		if (page) {
+			page->rxlat = tll::time::now().time_since_epoch().count() - time;
+			stat()->release(page);
+		}
+	}
+
+	void _on_send(size_t size)
+	{
+		if (!this->_stat_enable)
+			return;
+		auto page = stat()->acquire();
+		if (page) {
+			page->send = size;
+			stat()->release(page);
+		}
+	}
+
 	void _on_output_full()
 	{
-		if (this->_wbuf.size() > _send_hwm)
+		if (this->_stat_enable) {
+			auto page = stat()->acquire();
+			if (page) {
+				page->pending = this->_wbuf.size();
+				stat()->release(page);
+			}
+		}
+		if (!_write_full && this->_wbuf.size() > _framed.send_hwm) {
+			_write_full = true;
 			Base::_on_output_full();
+		}
 	};
 
-	void send_hwm(size_t hwm)
+	void _on_output_ready()
 	{
-		_send_hwm = hwm;
+		if (_framed.send_lwm && !_write_full) // Already reported on low watermark
+			return;
+		_write_full = false;
+		Base::_on_output_ready();
+	}
+
+	void settings(const FramedSettings &settings)
+	{
+		_framed = settings;
 	}
 
  private:
 	int _pending();
+	/// Handle message that does not fit into send buffer according to policy
+	int _post_full(const tll_msg_t *msg);
 };
 
 template <typename T>
 class FramedSocket<T, void> : public tll::channel::TcpSocket<T>
 {
  protected:
-	size_t _send_hwm = 0;
+	FramedSettings _framed;
 
  public:
 	using Base = tll::channel::TcpSocket<T>;
 	void _on_output_full()
 	{
-		if (this->_wbuf.size() > _send_hwm)
+		if (this->_wbuf.size() > _framed.send_hwm)
 			Base::_on_output_full();
 	};
 
-	void send_hwm(size_t hwm)
+	void settings(const FramedSettings &settings)
 	{
-		_send_hwm = hwm;
+		_framed = settings;
 	}
 };
 
@@ -83,14 +185,10 @@ class ChTcpClient : public tll::channel::TcpClient<ChTcpClient<Frame>, FramedSoc
 			return r;
 
 		auto reader = this->channel_props_reader(url);
-		auto hwm = reader.getT("send-buffer-hwm", tll::util::Size { 0 });
-		if (!reader)
-			return this->_log.fail(EINVAL, "Invalid url: {}", reader.error());
-		if (hwm > this->_settings.snd_buffer_size * 0.8)
-			return this->_log.fail(EINVAL, "Send HWM is too large: {} > 80% of send buffer {}", hwm, this->_settings.snd_buffer_size);
-		if (hwm)
-			this->_log.debug("Store up to {} of data on blocked connection", hwm);
-		this->_send_hwm = hwm;
+		FramedSettings settings;
+		if (auto r = settings.init(reader, this->_log, this->_settings.snd_buffer_size); r)
+			return r;
+		this->settings(settings);
 		return 0;
 	}
 };
@@ -106,13 +204,21 @@ class ChFramedSocket : public FramedSocket<ChFramedSocket<Frame>, Frame>
 template <typename Frame>
 class ChTcpServer : public tll::channel::TcpServer<ChTcpServer<Frame>, ChFramedSocket<Frame>>
 {
-	size_t _send_hwm = 0;
+	FramedSettings _framed;
  public:
 	using Base = tll::channel::TcpServer<ChTcpServer<Frame>, ChFramedSocket<Frame>>;
 	using Socket = ChFramedSocket<Frame>;
 
 	static constexpr std::string_view channel_protocol() { return "tcp"; }
 
+	struct StatType : public Base::StatType
+	{
+		tll::stat::Integer<tll::stat::Max, tll::stat::Bytes, 'u', 's', 'e', 'd'> used; ///< Pool buffers borrowed by sockets
+		tll::stat::Integer<tll::stat::Max, tll::stat::Bytes, 'c', 'a', 'c', 'h', 'e', 'd'> cached; ///< Free pool buffers
+	};
+
+	tll::stat::BlockT<StatType> * stat() { return static_cast<tll::stat::BlockT<StatType> *>(this->internal.stat); }
+
 	int _init(const tll::Channel::Url &url, tll::Channel *master)
 	{
 		if (auto r = Base::_init(url, master))
@@ -123,25 +229,43 @@ class ChTcpServer : public tll::channel::TcpServer<ChTcpServer<Frame>, ChFramedS
 			this->_socket_url.set("frame", tll::frame::FrameT<Frame>::name()[0]);
 		}
 
+		if (this->_pool && this->_stat_enable) {
+			this->_pool->on_update = _on_pool_update;
+			this->_pool->on_update_user = this;
+		}
+
 		auto reader = this->channel_props_reader(url);
-		auto hwm = reader.getT("send-buffer-hwm", tll::util::Size { 0 });
-		if (!reader)
-			return this->_log.fail(EINVAL, "Invalid url: {}", reader.error());
-		if (hwm > this->_settings.snd_buffer_size * 0.8)
-			return this->_log.fail(EINVAL, "Send HWM is too large: {} > 80% of send buffer {}", hwm, this->_settings.snd_buffer_size);
-		if (hwm)
-			this->_log.debug("Store up to {} of data on blocked connection", hwm);
-		this->_send_hwm = hwm;
-		return 0;
+		return _framed.init(reader, this->_log, this->_settings.snd_buffer_size);
+	}
+
+	void _free()
+	{
+		if (this->_pool)
+			this->_pool->on_update = nullptr;
+		Base::_free();
 	}
 
 	int _on_accept(tll::Channel * c) {
 		auto socket = tll::channel_cast<Socket>(c);
 		if (!socket)
 			return this->_log.fail(EINVAL, "Can not cast {} to socket channel", c->name());
-		socket->send_hwm(this->_send_hwm);
+		socket->settings(_framed);
 		return 0;
 	}
+
+ private:
+	static void _on_pool_update(void * user, const tll::channel::BufferPool * pool)
+	{
+		auto self = static_cast<ChTcpServer<Frame> *>(user);
+		if (!self->stat())
+			return;
+		auto page = self->stat()->acquire();
+		if (page) {
+			page->used = pool->used;
+			page->cached = pool->cached;
+			self->stat()->release(page);
+		}
+	}
 };
 
 TLL_DEFINE_IMPL(ChTcp);
@@ -219,9 +343,11 @@ int FramedSocket<T, F>::_post_data(const tll_msg_t *msg, int flags)
 	if (msg->type != TLL_MESSAGE_DATA)
 		return 0;
 
-	if (this->_wbuf.size()) {
-		if (this->_wbuf.size() > _send_hwm)
-			return EAGAIN;
+	if (this->_wbuf.size() && !this->_more) { // Output is blocked
+		if (this->_wbuf.size() > _framed.send_hwm)
+			return _post_full(msg);
+		if (_framed.send_max && this->_wbuf.size() + FrameT::frame_skip_size() + msg->size > _framed.send_max)
+			return _post_full(msg);
 		this->_log.trace("Store {} + {} bytes of data", FrameT::frame_skip_size(), msg->size);
 		if constexpr (FrameT::frame_skip_size() != 0) {
 			Frame frame;
@@ -229,8 +355,23 @@ int FramedSocket<T, F>::_post_data(const tll_msg_t *msg, int flags)
 			this->_store_output(&frame, sizeof(frame));
 		}
 		this->_store_output(msg->data, msg->size);
-		if (this->_wbuf.size() > _send_hwm)
-			_on_output_full();
+		_on_output_full();
+		return 0;
+	}
+
+	if (flags & TLL_POST_MORE) {
+		this->_log.trace("Store {} + {} bytes of data with more flag", FrameT::frame_skip_size(), msg->size);
+		Frame frame;
+		iovec iov[2] = {{ &frame, sizeof(frame) }, { (void *) msg->data, msg->size }};
+		if constexpr (FrameT::frame_skip_size() != 0) {
+			FrameT::write(msg, &frame);
+			this->_store_more(iov, 2);
+		} else
+			this->_store_more(iov + 1, 1);
+		if (this->_wbuf.size() < _framed.coalesce_size)
+			return 0;
+		if (auto r = this->_flush_more(); r)
+			return this->_log.fail(r, "Failed to post data");
 		return 0;
 	}
 
@@ -250,30 +391,74 @@ int FramedSocket<T, F>::_post_data(const tll_msg_t *msg, int flags)
 	return 0;
 }
 
+template <typename T, typename F>
+int FramedSocket<T, F>::_post_full(const tll_msg_t *msg)
+{
+	switch (_framed.send_policy) {
+	case FramedSettings::Policy::EAgain:
+		return EAGAIN;
+	case FramedSettings::Policy::Drop:
+		this->_log.trace("Send buffer is full ({} bytes), drop message {}", this->_wbuf.size(), msg->seq);
+		if (this->_stat_enable) {
+			auto page = stat()->acquire();
+			if (page) {
+				page->drop = 1;
+				stat()->release(page);
+			}
+		}
+		return 0;
+	case FramedSettings::Policy::Disconnect:
+		this->_log.error("Send buffer is full ({} bytes), disconnect slow client", this->_wbuf.size());
+		this->close();
+		return EPIPE;
+	}
+	return EAGAIN;
+}
 
 template <typename T, typename F>
 int FramedSocket<T, F>::_pending()
 {
-	auto frame = this->template rdataT<Frame>();
-	if (!frame)
-		return EAGAIN;
-	// Check for pending data
-	const auto full_size = FrameT::frame_skip_size() + frame->size;
-	if (this->_rbuf.size() < full_size) {
-		if (full_size > this->_rbuf.capacity())
-			return this->_log.fail(EMSGSIZE, "Message size {} too large", full_size);
-		this->_dcaps_pending(false);
-		return EAGAIN;
+	// Deliver all complete frames up to the limit, buffer is compacted only once in next _recv call
+	unsigned count = 0;
+	for (; count < _framed.process_frames; count++) {
+		auto frame = this->template rdataT<Frame>();
+		if (!frame)
+			break;
+		// Check for pending data
+		const auto full_size = FrameT::frame_skip_size() + frame->size;
+		if (this->_rbuf.size() < full_size) {
+			if (full_size > this->_rbuf.capacity())
+				return this->_log.fail(EMSGSIZE, "Message size {} too large", full_size);
+			this->_dcaps_pending(this->_more);
+			return count ? 0 : EAGAIN;
+		}
+
+		tll_msg_t msg = { TLL_MESSAGE_DATA };
+		FrameT::read(&msg, frame);
+		msg.data = this->_rbuf.template dataT<void>(FrameT::frame_skip_size(), 0);
+		msg.addr = this->_msg_addr;
+		msg.time = this->_timestamp.count();
+		this->rdone(full_size);
+		if (this->_stat_enable && this->_timestamping)
+			_on_rx_latency(msg.time);
+
+		bool alive = true;
+		_alive = &alive;
+		this->_callback_data(&msg);
+		if (!alive) // Socket is destroyed from callback, for example server is closed
+			return 0;
+		_alive = nullptr;
+		if (this->state() != tll::state::Active) // Channel is closed from callback
+			return 0;
 	}
 
-	tll_msg_t msg = { TLL_MESSAGE_DATA };
-	FrameT::read(&msg, frame);
-	msg.data = this->_rbuf.template dataT<void>(FrameT::frame_skip_size(), 0);
-	msg.addr = this->_msg_addr;
-	msg.time = this->_timestamp.count();
-	this->rdone(full_size);
-	this->_dcaps_pending(this->template rdataT<Frame>());
-	this->_callback_data(&msg);
+	if (this->_pool)
+		this->_rbuf.give_back(this->_pool.get());
+	if (count == 0) {
+		this->_dcaps_pending(this->_more);
+		return EAGAIN;
+	}
+	this->_dcaps_pending(this->_more || this->template rdataT<Frame>());
 	return 0;
 }
 
@@ -282,6 +467,11 @@ int FramedSocket<T, Frame>::_process(long timeout, int flags)
 {
 	if (auto r = this->_process_output(); r)
 		return r;
+	if (_write_full && _framed.send_lwm && this->_wbuf.size() && this->_wbuf.size() <= _framed.send_lwm) {
+		this->_log.debug("Send buffer drained to {} bytes, below low watermark", this->_wbuf.size());
+		_write_full = false;
+		Base::_on_output_ready();
+	}
 
 	auto r = this->_pending();
 	if (r != EAGAIN)
@@ -290,8 +480,11 @@ int FramedSocket<T, Frame>::_process(long timeout, int flags)
 	auto s = this->_recv();
 	if (!s)
 		return EINVAL;
-	if (!*s)
+	if (!*s) {
+		if (this->_pool)
+			this->_rbuf.give_back(this->_pool.get());
 		return EAGAIN;
+	}
 	this->_log.trace("Got {} bytes of data", *s);
 	return this->_pending();
 }
@@ -40,7 +40,7 @@ class FramedSocket : public tll::channel::udp::Socket<T>
 
  public:
 	int _on_data(const tll::network::sockaddr_any &from, tll_msg_t &msg);
-	int _send(const tll_msg_t *, const tll::network::sockaddr_any &addr);
+	int _send(const tll_msg_t *, const tll::network::sockaddr_any &addr, int flags = 0);
 };
 
 template <typename Frame>
@@ -56,7 +56,7 @@ class UdpClient : public tll::channel::LastSeqTx<UdpClient<Frame>, FramedSocket<
 
 	int _post(const tll_msg_t *msg, int flags)
 	{
-		auto r = udp_socket_t::_send(msg, this->_addr);
+		auto r = udp_socket_t::_send(msg, this->_addr, flags);
 		if (r == 0 && msg->type == TLL_MESSAGE_DATA)
 			this->_last_seq_tx(msg->seq);
 		return r;
@@ -78,7 +78,7 @@ class UdpServer : public tll::channel::LastSeqRx<UdpServer<Frame>, FramedSocket<
 
 	int _post(const tll_msg_t *msg, int flags)
 	{
-		return udp_socket_t::_send(msg, this->_peer);
+		return udp_socket_t::_send(msg, this->_peer, flags);
 	}
 };
 
@@ -135,7 +135,7 @@ std::optional<const tll_channel_impl_t *> ChUdp::_init_replace(const tll::Channe
 }
 
 template <typename T, typename Frame>
-int FramedSocket<T, Frame>::_send(const tll_msg_t * msg, const tll::network::sockaddr_any &addr)
+int FramedSocket<T, Frame>::_send(const tll_msg_t * msg, const tll::network::sockaddr_any &addr, int flags)
 {
 	if (msg->type != TLL_MESSAGE_DATA)
 		return 0;
@@ -143,10 +143,10 @@ int FramedSocket<T, Frame>::_send(const tll_msg_t * msg, const tll::network::soc
 		Frame frame;
 		tll::frame::FrameT<Frame>::write(msg, &frame);
 		iovec iov[2] = {{&frame, frame_size}, {(void *) msg->data, msg->size}};
-		return this->_sendv(msg->seq, iov, 2, addr);
+		return this->_sendv(msg->seq, iov, 2, addr, flags);
 	} else {
 		iovec iov[1] = {{(void *) msg->data, msg->size}};
-		return this->_sendv(msg->seq, iov, 1, addr);
+		return this->_sendv(msg->seq, iov, 1, addr, flags);
 	}
 }
 
@@ -13,8 +13,12 @@
 #include "tll/util/sockaddr.h"
 
 #include <array>
+#include <atomic>
 #include <chrono>
 #include <list>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 struct iovec;
@@ -48,6 +52,9 @@ struct tcp_settings_t {
 	bool keepalive = true;
 	bool nodelay = false;
 	enum Protocol { TCP = 0, MPTCP, SCTP } protocol;
+	bool reuseport = false; ///< Listening socket is shared with other servers, only for server
+	int incoming_cpu = -1; ///< Prefer connections handled by this CPU, only for server
+	size_t zerocopy_size = 0; ///< Send messages of this size or larger with MSG_ZEROCOPY, 0 to disable
 };
 
 struct tcp_connect_t {
@@ -56,6 +63,88 @@ struct tcp_connect_t {
 	sockaddr * addr;
 };
 
+/// Output buffer passed to kernel with MSG_ZEROCOPY, kept until completion notification
+struct tcp_zerocopy_buffer_t
+{
+	uint32_t id;
+	std::vector<char> data;
+};
+
+/**
+ * Pool of socket buffers shared by connections of one server
+ *
+ * Buffers are grouped into power of two size classes, released buffers are kept for reuse
+ * up to ``limit`` bytes.
+ */
+class BufferPool
+{
+	std::vector<std::vector<std::vector<char>>> _free; ///< Free buffers indexed by size class
+
+ public:
+	static constexpr unsigned min_class = 10; ///< Smallest buffer is 1kb
+
+	size_t used = 0; ///< Bytes in buffers borrowed by sockets
+	size_t cached = 0; ///< Bytes in free buffers
+	size_t limit = 0; ///< Maximum size of free buffers
+
+	/// Hook called when pool usage is changed
+	void (*on_update)(void * user, const BufferPool * pool) = nullptr;
+	void * on_update_user = nullptr;
+
+	static unsigned size_class(size_t size)
+	{
+		unsigned c = min_class;
+		while (((size_t) 1 << c) < size)
+			c++;
+		return c;
+	}
+
+	std::vector<char> acquire(size_t size)
+	{
+		auto c = size_class(size);
+		std::vector<char> r;
+		if (c < _free.size() && _free[c].size()) {
+			r = std::move(_free[c].back());
+			_free[c].pop_back();
+			cached -= r.size();
+		} else
+			r.resize((size_t) 1 << c);
+		used += r.size();
+		_notify();
+		return r;
+	}
+
+	/// Buffer is not returned to the pool, only stop accounting it as used
+	void forget(const std::vector<char> &buf)
+	{
+		used -= buf.size();
+		_notify();
+	}
+
+	void release(std::vector<char> &&buf)
+	{
+		if (buf.empty())
+			return;
+		used -= buf.size();
+		if (cached + buf.size() <= limit) {
+			auto c = size_class(buf.size());
+			if (_free.size() <= c)
+				_free.resize(c + 1);
+			cached += buf.size();
+			_free[c].emplace_back(std::move(buf));
+		}
+		buf = {};
+		_notify();
+	}
+
+ private:
+	void _notify()
+	{
+		if (on_update)
+			on_update(on_update_user, this);
+	}
+};
+
 struct PartialBuffer
 {
 	std::vector<char> buf;
@@ -118,6 +207,34 @@ struct PartialBuffer
 		memmove(buf.data(), buf.data() + _offset, _size);
 		_offset = 0;
 	}
+
+	/// Take storage from the pool if buffer has none
+	void borrow(BufferPool * pool, size_t size)
+	{
+		if (buf.empty())
+			buf = pool->acquire(size);
+	}
+
+	/// Return storage to the pool if buffer holds no data
+	void give_back(BufferPool * pool)
+	{
+		if (_size || buf.empty())
+			return;
+		_offset = 0;
+		pool->release(std::move(buf));
+	}
+
+	/// Resize buffer taking storage from the pool, size class is increased and data is copied
+	void resize(BufferPool * pool, size_t size)
+	{
+		if (!pool)
+			return resize(size);
+		auto r = pool->acquire(size);
+		memcpy(r.data(), data(), _size);
+		_offset = 0;
+		std::swap(r, buf);
+		pool->release(std::move(r));
+	}
 };
 
 template <typename T>
@@ -128,6 +245,18 @@ class TcpSocket : public Base<T>
 	PartialBuffer _rbuf;
 	PartialBuffer _wbuf;
 	std::vector<char> _cbuf;
+	bool _timestamping = false; ///< Receive timestamps are enabled
+	bool _more = false; ///< Output buffer holds data posted with TLL_POST_MORE flag, not blocked output
+
+	/// Shared pool, if set buffers are borrowed only while they hold data
+	std::shared_ptr<BufferPool> _pool;
+	size_t _rbuf_size = 0; ///< Size of receive buffer taken from the pool
+	size_t _wbuf_size = 0; ///< Size of send buffer taken from the pool
+
+	size_t _zerocopy_size = 0;
+	uint32_t _zerocopy_id = 0; ///< Id of next zerocopy send, counted by kernel
+	std::list<tcp_zerocopy_buffer_t> _zerocopy_pending;
+	std::list<std::vector<char>> _zerocopy_free;
 
 	tcp_socket_addr_t _msg_addr;
 
@@ -166,6 +295,9 @@ class TcpSocket : public Base<T>
 	void bind(int fd, unsigned seq = 0) { this->_update_fd(fd); _msg_addr = { fd, seq }; }
 	const tcp_socket_addr_t & msg_addr() const { return _msg_addr; }
 
+	/// Use buffers from shared pool, should be called before setup
+	void buffer_pool(std::shared_ptr<BufferPool> pool) { _pool = std::move(pool); }
+
 	int setup(const tcp_settings_t &settings, int af);
 
 	void _on_close()
@@ -179,6 +311,9 @@ class TcpSocket : public Base<T>
 	/// Hook called when output buffer is fully sent
 	void _on_output_ready();
 
+	/// Hook called after each successful send syscall
+	void _on_send(size_t size) {}
+
 	/// Handle send errors
 	int _on_send_error(int error)
 	{
@@ -205,6 +340,8 @@ class TcpSocket : public Base<T>
 	std::optional<size_t> _recv(size_t size);
 	std::optional<size_t> _recv()
 	{
+		if (_pool)
+			_rbuf.borrow(_pool.get(), _rbuf_size);
 		_rbuf.shift();
 		return _recv(_rbuf.available());
 	}
@@ -214,8 +351,18 @@ class TcpSocket : public Base<T>
 
 	int _sendmsg(const iovec * iov, size_t N);
 
+	/// Append data to output buffer without sending, it is sent with next post without TLL_POST_MORE flag or on process
+	void _store_more(const iovec * iov, size_t N);
+	/// Send data accumulated by _store_more
+	int _flush_more();
+
 	void _store_output(const void * base, size_t size, size_t offset = 0);
 
+	/// Send data from output buffer, with MSG_ZEROCOPY if it is large enough. Returns send result
+	ssize_t _send_output();
+	/// Release buffers of completed zerocopy sends
+	int _process_zerocopy();
+
 	std::chrono::nanoseconds _cmsg_timestamp(msghdr * msg);
 };
 
@@ -224,7 +371,6 @@ class TcpClient : public S
 {
  protected:
 	std::optional<tll::network::hostport> _peer;
-	bool _timestamping = false;
 
 	using addr_list_t = std::vector<tll::network::sockaddr_any>;
 	addr_list_t _addr_list;
@@ -260,17 +406,102 @@ class TcpServerSocket : public tll::channel::Base<TcpServerSocket<T>>
  protected:
 	using tcp_server_socket_t = TcpServerSocket<T>;
 
+	bool * _alive = nullptr; ///< Cleared in destructor to detect destruction from callback
+
  public:
 	static constexpr std::string_view channel_protocol() { return "tcp"; }
 
+	~TcpServerSocket()
+	{
+		if (_alive)
+			*_alive = false;
+	}
+
 	int _init(const tll::Channel::Url &url, tll::Channel *master);
 
 	int _open(const tll::ConstConfig &props);
 	int _close();
 
+	/// Accept all pending connections
 	int _process(long timeout, int flags);
 
 	void bind(int fd) { this->_update_fd(fd); }
+
+ private:
+	int _accept();
+};
+
+/**
+ * State shared by server shards that listen on the same address with ``SO_REUSEPORT``
+ *
+ * Shards are usually processed by different worker threads so all updates are done under lock.
+ * Group keeps list of clients of all shards in config subtree of first shard and aggregated stat
+ * block.
+ */
+struct TcpShardGroup
+{
+	struct StatType
+	{
+		tll::stat::Integer<tll::stat::Sum, tll::stat::Unknown, 'c', 'o', 'n', 'n', 'e', 'c', 't'> connect;
+		tll::stat::Integer<tll::stat::Sum, tll::stat::Unknown, 'd', 'i', 's', 'c', 'o', 'n', 'n'> disconn;
+		tll::stat::Integer<tll::stat::Last, tll::stat::Unknown, 'c', 'l', 'i', 'e', 'n', 't', 's'> clients;
+	};
+
+	std::mutex lock;
+	tll::Config config; ///< Client list of each shard, ``<shard>.<addr>: <peer>``
+	std::map<uint64_t, std::string> owners; ///< Shard name for each client address
+	std::unique_ptr<tll::stat::Block<StatType>> stat;
+
+	void join(std::string_view shard)
+	{
+		std::unique_lock<std::mutex> l(lock);
+		config.sub(shard, true);
+	}
+
+	void leave(std::string_view shard)
+	{
+		std::unique_lock<std::mutex> l(lock);
+		config.remove(shard);
+	}
+
+	void connect(std::string_view shard, const tll_addr_t &addr, std::string_view peer)
+	{
+		std::unique_lock<std::mutex> l(lock);
+		owners.emplace(addr.u64, shard);
+		config.set(fmt::format("{}.{}", shard, addr.u64), peer);
+		_stat_update(1, 0);
+	}
+
+	void disconnect(const tll_addr_t &addr)
+	{
+		std::unique_lock<std::mutex> l(lock);
+		auto it = owners.find(addr.u64);
+		if (it == owners.end())
+			return;
+		config.remove(fmt::format("{}.{}", it->second, addr.u64));
+		owners.erase(it);
+		_stat_update(0, 1);
+	}
+
+	/// Find shard that owns client address, empty string if there is no such client
+	std::string owner(const tll_addr_t &addr)
+	{
+		std::unique_lock<std::mutex> l(lock);
+		auto it = owners.find(addr.u64);
+		return it == owners.end() ? "" : it->second;
+	}
+
+ private:
+	void _stat_update(int connect, int disconnect)
+	{
+		if (!stat)
+			return;
+		auto page = stat->acquire_wait();
+		page->connect = connect;
+		page->disconn = disconnect;
+		page->clients = owners.size();
+		stat->release(page);
+	}
 };
 
 template <typename T, typename C>
@@ -285,11 +516,17 @@ class TcpServer : public Base<T>
 	using tcp_socket_t = TcpSocket<C>;
 	std::list<std::unique_ptr<Channel>> _sockets;
 	std::map<int, tcp_socket_t *> _clients;
+	std::vector<tcp_socket_t *> _socket_cache; ///< Closed client sockets kept for reuse
+	unsigned _socket_cache_size = 0;
+	unsigned _socket_idx = 0; ///< Name index of cached sockets
 	bool _cleanup_flag = false;
 	tcp_settings_t _settings = {};
 	tll::Channel::Url _socket_url;
 	tll::Channel::Url _client_init;
 	tll::Config _client_config;
+	std::shared_ptr<BufferPool> _pool; ///< Buffers shared by client sockets, if enabled
+	std::shared_ptr<TcpShardGroup> _shard; ///< Group of servers on the same address, if sharded
+	bool _shard_leader = false; ///< Group is created by this server
 
  public:
 	static constexpr std::string_view channel_protocol() { return "tcp"; }
@@ -301,6 +538,7 @@ class TcpServer : public Base<T>
 	static constexpr auto socket_impl_policy() { return SocketImplPolicy::Dynamic; }
 
 	int _init(const tll::Channel::Url &url, tll::Channel *master);
+	void _free();
 
 	int _open(const tll::ConstConfig &props);
 	int _close();
@@ -347,6 +585,8 @@ class TcpServer : public Base<T>
 
 	int _bind(tll::network::sockaddr_any &addr);
 	void _cleanup(tcp_socket_t *);
+	/// Get socket from cache or create new one
+	std::unique_ptr<tll::Channel> _socket_create(int fd);
 	tcp_socket_t * _lookup(const tll_addr_t &addr);
 };
 
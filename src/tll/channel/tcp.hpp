@@ -23,6 +23,7 @@
 #include <unistd.h>
 
 #ifdef __linux__
+#include <linux/errqueue.h>
 #include <linux/sockios.h>
 #include <linux/net_tstamp.h>
 #include <sys/ioctl.h>
@@ -99,6 +100,107 @@ inline int select_protocol(tll::Logger &log, const tcp_settings_t &settings, int
 	return log.fail(-1, "Undefined protocol variant: {}", int(settings.protocol));
 }
 
+/**
+ * Read zerocopy completion notifications from socket error queue and release completed buffers
+ *
+ * If ``free`` list is not null released storage is kept there for reuse, up to 4 buffers.
+ * Returns 0 when there are no more notifications or errno value on failure.
+ */
+inline int zerocopy_complete(int fd, std::vector<char> &cbuf, std::list<tcp_zerocopy_buffer_t> &pending, std::list<std::vector<char>> * free)
+{
+#ifdef MSG_ZEROCOPY
+	while (pending.size()) {
+		msghdr msg = {};
+		msg.msg_control = cbuf.data();
+		msg.msg_controllen = cbuf.size();
+		if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+			return errno == EAGAIN ? 0 : errno;
+
+		for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if (!((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+			      (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)))
+				continue;
+			auto err = (const sock_extended_err *) CMSG_DATA(cmsg);
+			if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+				continue;
+			// Completed ids are in [ee_info, ee_data] range, compare with wraparound
+			const uint32_t lo = err->ee_info, hi = err->ee_data;
+			for (auto it = pending.begin(); it != pending.end();) {
+				if (it->id - lo > hi - lo) {
+					it++;
+					continue;
+				}
+				if (free && free->size() < 4)
+					free->push_back(std::move(it->data));
+				it = pending.erase(it);
+			}
+		}
+	}
+#endif
+	return 0;
+}
+
+/**
+ * Sockets closed while zerocopy sends were in flight
+ *
+ * Kernel references buffer pages until it reports completion, freeing them earlier allows reuse of
+ * memory that is still being sent. Such sockets are shut down but file descriptor is kept open
+ * (completions are read from its error queue) and buffers are released only after all sends are
+ * completed. Pending sockets are checked when any tcp socket is opened or closed and when server
+ * accepts new connections, remaining descriptors are closed on process exit.
+ */
+class ZerocopyReaper
+{
+	struct Entry
+	{
+		int fd;
+		std::list<tcp_zerocopy_buffer_t> pending;
+	};
+
+	std::mutex _lock;
+	std::list<Entry> _list;
+	std::atomic<size_t> _size = 0; ///< Number of entries, checked without lock
+	std::vector<char> _cbuf = std::vector<char>(256);
+
+ public:
+	~ZerocopyReaper()
+	{
+		for (auto & e : _list)
+			::close(e.fd);
+	}
+
+	static ZerocopyReaper & instance()
+	{
+		static ZerocopyReaper reaper;
+		return reaper;
+	}
+
+	/// Take ownership of socket and its pending buffers
+	void add(int fd, std::list<tcp_zerocopy_buffer_t> &&pending)
+	{
+		std::unique_lock<std::mutex> lock(_lock);
+		_list.push_back({ fd, std::move(pending) });
+		_size = _list.size();
+	}
+
+	/// Release completed buffers, close sockets that have nothing pending
+	void process()
+	{
+		if (!_size.load(std::memory_order_relaxed))
+			return;
+		std::unique_lock<std::mutex> lock(_lock);
+		for (auto it = _list.begin(); it != _list.end();) {
+			if (zerocopy_complete(it->fd, _cbuf, it->pending, nullptr) == 0 && it->pending.size()) {
+				it++;
+				continue;
+			}
+			::close(it->fd);
+			it = _list.erase(it);
+		}
+		_size = _list.size();
+	}
+};
+
 } // namespace _
 
 template <typename T>
@@ -114,6 +216,9 @@ int TcpSocket<T>::_open(const ConstConfig &url)
 {
 	_rbuf.clear();
 	_wbuf.clear();
+	_more = false;
+	_zerocopy_id = 0;
+	_::ZerocopyReaper::instance().process();
 	if (this->fd() == -1) {
 		auto fd = url.getT<int>("fd");
 		if (!fd)
@@ -128,9 +233,24 @@ int TcpSocket<T>::_open(const ConstConfig &url)
 template <typename T>
 int TcpSocket<T>::_close()
 {
+	if (_zerocopy_pending.size())
+		_process_zerocopy();
 	auto fd = this->_update_fd(-1);
-	if (fd != -1)
+	if (fd != -1 && _zerocopy_pending.size()) {
+		this->_log.debug("Keep socket open until {} zerocopy sends are completed", _zerocopy_pending.size());
+		::shutdown(fd, SHUT_RDWR);
+		_::ZerocopyReaper::instance().add(fd, std::move(_zerocopy_pending));
+		_zerocopy_pending.clear();
+	} else if (fd != -1)
 		::close(fd);
+	_::ZerocopyReaper::instance().process();
+	if (_pool) {
+		_rbuf.clear();
+		_wbuf.clear();
+		_more = false;
+		_rbuf.give_back(_pool.get());
+		_wbuf.give_back(_pool.get());
+	}
 	return 0;
 }
 
@@ -177,6 +297,12 @@ void TcpSocket<T>::_on_output_ready()
 template <typename T>
 std::optional<size_t> TcpSocket<T>::_recv(size_t size)
 {
+	if (_zerocopy_pending.size()) {
+		if (auto r = _process_zerocopy(); r)
+			return std::nullopt;
+	}
+	if (_pool)
+		_rbuf.borrow(_pool.get(), _rbuf_size);
 	auto left = _rbuf.available();
 	if (left == 0) return EAGAIN;
 
@@ -216,8 +342,15 @@ int TcpSocket<T>::setup(const tcp_settings_t &settings, int af)
 {
 	using namespace tll::network;
 
-	_rbuf.resize(settings.rcv_buffer_size);
-	_wbuf.resize(settings.snd_buffer_size);
+	if (_pool) { // Buffers are taken from the pool when needed
+		_rbuf_size = settings.rcv_buffer_size;
+		_wbuf_size = settings.snd_buffer_size;
+		_rbuf.buf = {};
+		_wbuf.buf = {};
+	} else {
+		_rbuf.resize(settings.rcv_buffer_size);
+		_wbuf.resize(settings.snd_buffer_size);
+	}
 
 	if (int r = nonblock(this->fd()))
 		return this->_log.fail(EINVAL, "Failed to set nonblock: {}", strerror(r));
@@ -227,12 +360,14 @@ int TcpSocket<T>::setup(const tcp_settings_t &settings, int af)
 		return this->_log.fail(EINVAL, "Failed to set SO_NOSIGPIPE: {}", strerror(errno));
 #endif
 
+	_timestamping = false;
 #ifdef __linux__
 	if (settings.timestamping) {
 		int v = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE | SOF_TIMESTAMPING_SOFTWARE;
 		if (setsockopt(this->fd(), SOL_SOCKET, SO_TIMESTAMPING, &v, sizeof(v)))
 			return this->_log.fail(EINVAL, "Failed to enable timestamping: {}", strerror(errno));
 		_cbuf.resize(256);
+		_timestamping = true;
 	}
 #endif
 
@@ -248,6 +383,23 @@ int TcpSocket<T>::setup(const tcp_settings_t &settings, int af)
 	if (settings.nodelay && af != AF_UNIX && settings.protocol != settings.SCTP && setsockoptT<int>(this->fd(), SOL_TCP, TCP_NODELAY, 1))
 		return this->_log.fail(EINVAL, "Failed to set nodelay: {}", strerror(errno));
 
+	_zerocopy_size = 0;
+	if (settings.zerocopy_size) {
+#ifdef SO_ZEROCOPY
+		if (af == AF_UNIX)
+			this->_log.info("Zerocopy is not supported for unix sockets, disabled");
+		else if (setsockoptT<int>(this->fd(), SOL_SOCKET, SO_ZEROCOPY, 1))
+			this->_log.warning("Failed to enable zerocopy, disabled: {}", strerror(errno));
+		else {
+			_zerocopy_size = settings.zerocopy_size;
+			if (_cbuf.size() < 256)
+				_cbuf.resize(256);
+		}
+#else
+		this->_log.info("Zerocopy is supported only on Linux, disabled");
+#endif
+	}
+
 	return 0;
 }
 
@@ -278,8 +430,10 @@ void TcpSocket<T>::_store_output(const void * base, size_t size, size_t offset)
 {
 	auto len = size - offset;
 	auto data = offset + (const char *) base;
+	if (_pool)
+		_wbuf.borrow(_pool.get(), _wbuf_size);
 	if (_wbuf.available() < len)
-		_wbuf.resize(_wbuf.size() + len);
+		_wbuf.resize(_pool.get(), _wbuf.size() + len);
 	memcpy(_wbuf.end(), data, len);
 	_wbuf.extend(len);
 	if (_wbuf.size() == len) {
@@ -288,9 +442,51 @@ void TcpSocket<T>::_store_output(const void * base, size_t size, size_t offset)
 	}
 }
 
+template <typename T>
+void TcpSocket<T>::_store_more(const iovec * iov, size_t N)
+{
+	size_t full = 0;
+	for (unsigned i = 0; i < N; i++)
+		full += iov[i].iov_len;
+	if (_pool)
+		_wbuf.borrow(_pool.get(), _wbuf_size);
+	if (_wbuf.available() < full)
+		_wbuf.resize(_pool.get(), _wbuf.size() + full);
+	for (unsigned i = 0; i < N; i++) {
+		memcpy(_wbuf.end(), iov[i].iov_base, iov[i].iov_len);
+		_wbuf.extend(iov[i].iov_len);
+	}
+	if (!_more) {
+		_more = true;
+		this->_dcaps_pending(true); // Flush on next process call
+	}
+}
+
+template <typename T>
+int TcpSocket<T>::_flush_more()
+{
+	_more = false;
+	const auto full = _wbuf.size();
+	if (_send_output() < 0 && errno != EAGAIN)
+		return this->_on_send_error(this->_log.fail(EINVAL, "Failed to send {} bytes of data: {}", full, strerror(errno)));
+	if (_wbuf.size()) {
+		this->_log.trace("Partial send: {} < {}, {} bytes not sent", full - _wbuf.size(), full, _wbuf.size());
+		_wbuf.shift();
+		this->channelT()->_on_output_full();
+		this->_update_dcaps(dcaps::CPOLLOUT);
+	} else if (_pool)
+		_wbuf.give_back(_pool.get());
+	return 0;
+}
+
 template <typename T>
 int TcpSocket<T>::_sendmsg(const iovec * iov, size_t N)
 {
+	if (_more) { // Send accumulated data together with this message
+		_store_more(iov, N);
+		return _flush_more();
+	}
+
 	if (_wbuf.size()) {
 		auto old = _wbuf.size();
 		for (unsigned i = 0; i < N; i++)
@@ -312,6 +508,8 @@ int TcpSocket<T>::_sendmsg(const iovec * iov, size_t N)
 			return this->_on_send_error(this->_log.fail(EINVAL, "Failed to send {} bytes of data: {}", full, strerror(errno)));
 		r = 0;
 	}
+	if (r)
+		this->channelT()->_on_send(r);
 	if (r < (ssize_t) full) {
 		this->_log.trace("Partial send: {} < {}, {} bytes not sent", r, full, full - r);
 		auto old = _wbuf.size();
@@ -329,6 +527,60 @@ int TcpSocket<T>::_sendmsg(const iovec * iov, size_t N)
 	return 0;
 }
 
+template <typename T>
+ssize_t TcpSocket<T>::_send_output()
+{
+	const auto size = _wbuf.size();
+#ifdef MSG_ZEROCOPY
+	if (_zerocopy_size && size >= _zerocopy_size) {
+		auto r = ::send(this->fd(), _wbuf.data(), size, MSG_NOSIGNAL | MSG_DONTWAIT | MSG_ZEROCOPY);
+		if (r > 0) {
+			// Kernel references sent part of the buffer until completion, so it is detached from
+			// socket and not sent data is moved into new storage
+			const size_t left = size - r;
+			tcp_zerocopy_buffer_t buf = { _zerocopy_id++ };
+			std::swap(buf.data, _wbuf.buf);
+			auto tail = buf.data.data() + _wbuf._offset + r;
+			if (_pool) {
+				_pool->forget(buf.data);
+				if (left)
+					_wbuf.buf = _pool->acquire(std::max(left, _wbuf_size));
+			} else if (_zerocopy_free.size()) {
+				_wbuf.buf = std::move(_zerocopy_free.front());
+				_zerocopy_free.pop_front();
+			}
+			if (left > _wbuf.buf.size()) { // Only copied tail is initialized, buffer grows on next store
+				_wbuf.buf.clear();
+				_wbuf.buf.reserve(buf.data.size());
+				_wbuf.buf.insert(_wbuf.buf.end(), tail, tail + left);
+			} else if (left)
+				memcpy(_wbuf.buf.data(), tail, left);
+			_wbuf.clear();
+			_wbuf.extend(left);
+			_zerocopy_pending.push_back(std::move(buf));
+			this->channelT()->_on_send(r);
+			return r;
+		}
+		if (r == 0 || errno != ENOBUFS) // Fallback to copy if optmem limit is reached
+			return r;
+	}
+#endif
+	auto r = ::send(this->fd(), _wbuf.data(), size, MSG_NOSIGNAL | MSG_DONTWAIT);
+	if (r > 0) {
+		this->channelT()->_on_send(r);
+		_wbuf.done(r);
+	}
+	return r;
+}
+
+template <typename T>
+int TcpSocket<T>::_process_zerocopy()
+{
+	if (auto r = _::zerocopy_complete(this->fd(), _cbuf, _zerocopy_pending, _pool ? nullptr : &_zerocopy_free); r)
+		return this->_log.fail(r, "Failed to receive zerocopy notification: {}", strerror(r));
+	return 0;
+}
+
 template <typename T>
 template <typename ... Args>
 int TcpSocket<T>::_sendv(const Args & ... args)
@@ -343,19 +595,22 @@ int TcpSocket<T>::_sendv(const Args & ... args)
 template <typename T>
 int TcpSocket<T>::_process_output()
 {
+	if (_more)
+		return _flush_more();
 	if (!_wbuf.size())
 		return 0;
-	auto r = ::send(this->fd(), _wbuf.data(), _wbuf.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+	auto r = _send_output();
 	if (r < 0) {
 		if (errno == EAGAIN)
 			return 0;
 		return this->_on_send_error(this->_log.fail(errno, "Failed to send pending data: {}", strerror(errno)));
 	}
 
-	_wbuf.done(r);
 	this->_log.trace("Sent {} bytes of pending data, {} bytes left", r, _wbuf.size());
 	_wbuf.shift();
 	if (!_wbuf.size()) {
+		if (_pool)
+			_wbuf.give_back(_pool.get());
 		this->_update_dcaps(0, dcaps::CPOLLOUT);
 		this->channelT()->_on_output_ready();
 	}
@@ -368,8 +623,11 @@ int TcpSocket<T>::_process(long timeout, int flags)
 	auto r = _recv();
 	if (!r)
 		return EINVAL;
-	if (!*r)
+	if (!*r) {
+		if (_pool)
+			_rbuf.give_back(_pool.get());
 		return EAGAIN;
+	}
 	this->_log.trace("Got data: {}", *r);
 	tll_msg_t msg = { TLL_MESSAGE_DATA };
 	msg.data = _rbuf.data();
@@ -379,6 +637,8 @@ int TcpSocket<T>::_process(long timeout, int flags)
 	this->_callback_data(&msg);
 	rdone(*r);
 	rshift();
+	if (_pool)
+		_rbuf.give_back(_pool.get());
 	return 0;
 }
 
@@ -401,6 +661,8 @@ int TcpClient<T, S>::_init(const tll::Channel::Url &url, tll::Channel *master)
 		_settings.snd_buffer_size = reader.getT("send-buffer-size", size);
 		_settings.rcv_buffer_size = reader.getT("recv-buffer-size", size);
 	}
+	if (reader.getT("zerocopy", false))
+		_settings.zerocopy_size = reader.getT("zerocopy-size", util::Size { 16 * 1024 });
 	_bind_host = reader.getT("bind", std::optional<tll::network::hostport> {});
 	_settings.protocol = reader.getT("protocol", tcp_settings_t::Protocol::TCP);
 	if (!reader)
@@ -569,11 +831,41 @@ int TcpServerSocket<T>::_close()
 
 template <typename T>
 int TcpServerSocket<T>::_process(long timeout, int flags)
+{
+	bool alive = true;
+	_alive = &alive;
+	unsigned count = 0;
+	for (;; count++) {
+		auto r = _accept();
+		if (!alive) // Destroyed from callback, for example server is closed
+			return 0;
+		if (r == EAGAIN)
+			break;
+		if (r) {
+			_alive = nullptr;
+			return r;
+		}
+		if (this->state() != tll::state::Active)
+			break;
+	}
+	_alive = nullptr;
+	_::ZerocopyReaper::instance().process();
+	if (count > 1)
+		this->_log.debug("Accepted {} connections", count);
+	return count ? 0 : EAGAIN;
+}
+
+template <typename T>
+int TcpServerSocket<T>::_accept()
 {
 	tll::network::sockaddr_any addr = {};
 	addr.size = sizeof(addr.buf);
 
-	tll::network::scoped_socket fd(accept(this->fd(), addr, &addr.size)); //XXX: accept4
+#ifdef __linux__
+	tll::network::scoped_socket fd(accept4(this->fd(), addr, &addr.size, SOCK_NONBLOCK | SOCK_CLOEXEC));
+#else
+	tll::network::scoped_socket fd(accept(this->fd(), addr, &addr.size));
+#endif
 	if (fd == -1) {
 		if (errno == EAGAIN || errno == EWOULDBLOCK)
 			return EAGAIN;
@@ -585,8 +877,10 @@ int TcpServerSocket<T>::_process(long timeout, int flags)
 	else
 		this->_log.info("Connection {} from {}", fd, "unix socket");
 
+#ifndef __linux__
 	if (int e = tll::network::nonblock(fd))
 		return this->_log.fail(e, "Failed to set nonblock: {}", strerror(e));
+#endif
 
 #ifdef __APPLE__
 	if (tll::network::setsockoptT<int>(fd, SOL_SOCKET, SO_NOSIGPIPE, 1))
@@ -623,13 +917,53 @@ int TcpServer<T, C>::_init(const tll::Channel::Url &url, tll::Channel *master)
 		_settings.snd_buffer_size = reader.getT("send-buffer-size", size);
 		_settings.rcv_buffer_size = reader.getT("recv-buffer-size", size);
 	}
+	if (reader.getT("zerocopy", false))
+		_settings.zerocopy_size = reader.getT("zerocopy-size", util::Size { 16 * 1024 });
 	_settings.protocol = reader.getT("protocol", tcp_settings_t::Protocol::TCP);
+	_settings.reuseport = reader.getT("reuse-port", false);
+	_socket_cache_size = reader.getT("socket-cache", 0u);
+	if (reader.getT("buffer-pool", false)) {
+		_pool.reset(new BufferPool);
+		_pool->limit = reader.getT("buffer-pool-cache", util::Size { 4 * 1024 * 1024 });
+	} else
+		_pool.reset();
+	_settings.incoming_cpu = reader.getT("incoming-cpu", -1);
+	auto shard = reader.getT("shard", false);
 	if (!reader)
 		return this->_log.fail(EINVAL, "Invalid url: {}", reader.error());
 
+	_shard.reset();
+	_shard_leader = false;
+	if (shard) {
+		_settings.reuseport = true;
+		if (master) {
+			auto leader = channel_cast<T>(master);
+			if (!leader || !leader->_shard)
+				return this->_log.fail(EINVAL, "Master '{}' is not sharded tcp server", master->name());
+			this->_log.info("Join shard group of '{}'", master->name());
+			_shard = leader->_shard;
+		} else {
+			_shard.reset(new TcpShardGroup);
+			_shard_leader = true;
+			_shard->config = *this->config_info().sub("shard", true);
+			if (this->_stat_enable) {
+				_shard->stat.reset(new tll::stat::Block<TcpShardGroup::StatType>(fmt::format("{}/shard", this->name)));
+				tll_stat_list_add(this->context().stat_list(), _shard->stat.get());
+			}
+		}
+		_shard->join(this->name);
+	}
+
 	if (_host.set_af(af))
 		return this->_log.fail(EINVAL, "Mismatched address family: parameter {}, parsed {}", af, _host.af);
 
+	if (_settings.reuseport && _host.af == AF_UNIX)
+		return this->_log.fail(EINVAL, "Port reuse is not supported for unix sockets");
+#ifndef SO_INCOMING_CPU
+	if (_settings.incoming_cpu != -1)
+		return this->_log.fail(EINVAL, "Incoming CPU affinity is not supported on this platform");
+#endif
+
 	{
 		_socket_url.proto(this->channelT()->channel_protocol());
 		auto r = url.getT<tll::Channel::Url>("socket", _socket_url);
@@ -641,6 +975,11 @@ int TcpServer<T, C>::_init(const tll::Channel::Url &url, tll::Channel *master)
 		_socket_url.set("mode", "socket");
 	}
 
+	if (_socket_cache_size && _socket_url.proto() != this->channelT()->channel_protocol()) {
+		this->_log.info("Socket cache is not supported for prefixed socket {}, disabled", _socket_url.proto());
+		_socket_cache_size = 0;
+	}
+
 
 	this->_scheme_control.reset(this->context().scheme_load(tcp_scheme::scheme_string));
 	if (!this->_scheme_control.get())
@@ -653,6 +992,17 @@ int TcpServer<T, C>::_init(const tll::Channel::Url &url, tll::Channel *master)
 	return 0;
 }
 
+template <typename T, typename C>
+void TcpServer<T, C>::_free()
+{
+	if (!_shard)
+		return;
+	_shard->leave(this->name);
+	if (_shard_leader && _shard->stat)
+		tll_stat_list_remove(this->context().stat_list(), _shard->stat.get());
+	_shard.reset();
+}
+
 template <typename T, typename C>
 int TcpServer<T, C>::_open(const ConstConfig &url)
 {
@@ -727,6 +1077,14 @@ int TcpServer<T, C>::_bind(tll::network::sockaddr_any &addr)
 	if (setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &flag, sizeof(flag)))
 		return this->_log.fail(EINVAL, "Failed to set SO_KEEPALIVE: {}", strerror(errno));
 
+	if (_settings.reuseport && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &flag, sizeof(flag)))
+		return this->_log.fail(EINVAL, "Failed to set SO_REUSEPORT: {}", strerror(errno));
+
+#ifdef SO_INCOMING_CPU
+	if (_settings.incoming_cpu != -1 && tll::network::setsockoptT<int>(fd, SOL_SOCKET, SO_INCOMING_CPU, _settings.incoming_cpu))
+		return this->_log.fail(EINVAL, "Failed to set SO_INCOMING_CPU to {}: {}", _settings.incoming_cpu, strerror(errno));
+#endif
+
 	if (bind(fd, addr, addr.size))
 		return this->_log.fail(errno, "Failed to bind: {}", strerror(errno));
 
@@ -767,9 +1125,15 @@ int TcpServer<T, C>::_close()
 		if (unlink(this->_host.host.c_str()))
 			this->_log.warning("Failed to unlink socket {}: {}", this->_host.host, strerror(errno));
 	}
-	for (auto & c : _clients)
+	for (auto & c : _clients) {
+		if (_shard)
+			_shard->disconnect(c.second->msg_addr());
 		tll_channel_free(*c.second);
+	}
 	_clients.clear();
+	for (auto & c : _socket_cache)
+		tll_channel_free(*c);
+	_socket_cache.clear();
 	_sockets.clear();
 	this->_config.remove("client");
 	return 0;
@@ -782,8 +1146,13 @@ typename TcpServer<T, C>::tcp_socket_t * TcpServer<T, C>::_lookup(const tll_addr
 	if (addr->fd == -1)
 		return this->_log.fail(nullptr, "Invalid address");
 	auto i = _clients.find(addr->fd);
-	if (i == _clients.end())
+	if (i == _clients.end()) {
+		if (_shard) {
+			if (auto owner = _shard->owner(a); owner.size())
+				return this->_log.fail(nullptr, "Address {}/{} belongs to shard '{}'", addr->fd, addr->seq, owner);
+		}
 		return this->_log.fail(nullptr, "Address not found: {}/{}", addr->fd, addr->seq);
+	}
 	if (addr->seq != i->second->msg_addr().seq)
 		return this->_log.fail(nullptr, "Address seq mismatch: {} != {}", addr->seq, i->second->msg_addr().seq);
 	return i->second;
@@ -825,9 +1194,36 @@ void TcpServer<T, C>::_cleanup(tcp_socket_t * c)
 {
 	this->_log.debug("Cleanup client {} @{}", c->name, (void *) c);
 	this->_child_del(*c);
+	if (c->state() == state::Closed && _socket_cache.size() < _socket_cache_size) {
+		_socket_cache.push_back(c);
+		return;
+	}
 	delete c->self();
 }
 
+template <typename T, typename C>
+std::unique_ptr<tll::Channel> TcpServer<T, C>::_socket_create(int fd)
+{
+	if (_socket_cache.size()) {
+		auto client = _socket_cache.back();
+		_socket_cache.pop_back();
+		this->_log.debug("Reuse cached client {} for fd {}", client->name, fd);
+		return std::unique_ptr<tll::Channel>(client->self());
+	}
+
+	if (_socket_cache_size) // Name can not be changed so it is not bound to fd
+		_socket_url.set("name", fmt::format("{}/{}", this->name, _socket_idx++));
+	else
+		_socket_url.set("name", fmt::format("{}/{}", this->name, fd));
+	auto impl = this->channelT()->socket_impl_policy() == SocketImplPolicy::Fixed ? &tcp_socket_t::impl : nullptr;
+	auto r = this->context().channel(_socket_url, this->self(), impl);
+	if (!r)
+		return this->_log.fail(nullptr, "Failed to init client socket channel");
+	tll_channel_callback_add(r.get(), _cb_other, this, TLL_MESSAGE_MASK_STATE | TLL_MESSAGE_MASK_CONTROL);
+	tll_channel_callback_add(r.get(), _cb_data, this, TLL_MESSAGE_MASK_DATA);
+	return r;
+}
+
 template <typename T, typename C>
 int TcpServer<T, C>::_cb_other(const tll_channel_t *c, const tll_msg_t *msg)
 {
@@ -868,6 +1264,12 @@ void TcpServer<T, C>::_on_child_connect(tcp_socket_t *socket, const tcp_connect_
 	msg.size = connect.view().size();
 	msg.data = connect.view().data();
 	msg.addr = socket->msg_addr();
+	if (_shard) {
+		tll::network::sockaddr_any peer;
+		peer.size = std::min<socklen_t>(conn->addrlen, sizeof(peer.buf));
+		memcpy(peer.buf, conn->addr, peer.size);
+		_shard->connect(this->name, msg.addr, conv::to_string(peer));
+	}
 	this->_callback(&msg);
 }
 
@@ -877,6 +1279,8 @@ void TcpServer<T, C>::_on_child_closing(tcp_socket_t *socket)
 	tll_msg_t m = { TLL_MESSAGE_CONTROL };
 	m.msgid = tcp_scheme::Disconnect::meta_id();
 	m.addr = socket->msg_addr();
+	if (_shard)
+		_shard->disconnect(m.addr);
 	this->_callback(&m);
 }
 
@@ -915,20 +1319,17 @@ int TcpServer<T, C>::_cb_socket(const tll_channel_t *c, const tll_msg_t *msg)
 		return 0;
 	}
 
-	_socket_url.set("name", fmt::format("{}/{}", this->name, fd));
-	auto impl = this->channelT()->socket_impl_policy() == SocketImplPolicy::Fixed ? &tcp_socket_t::impl : nullptr;
-	auto r = this->context().channel(_socket_url, this->self(), impl);
+	auto r = _socket_create(fd);
 	if (!r)
-		return this->_log.fail(EINVAL, "Failed to init client socket channel");
+		return EINVAL;
 
 	auto client = channel_cast<tcp_socket_t>(r.get());
 	if (!client)
 		return this->_log.fail(EINVAL, "Failed to cast to tcp socket type, invalid socket protocol {}", _socket_url.proto());
-	//r.release();
 	client->bind(fd, _addr_seq++);
+	if (_pool)
+		client->buffer_pool(_pool);
 	client->setup(_settings, conn->addr->sa_family);
-	tll_channel_callback_add(r.get(), _cb_other, this, TLL_MESSAGE_MASK_STATE | TLL_MESSAGE_MASK_CONTROL);
-	tll_channel_callback_add(r.get(), _cb_data, this, TLL_MESSAGE_MASK_DATA);
 	if (this->channelT()->_on_accept(r.get())) {
 		this->_log.debug("Client channel rejected");
 		return 0;
@@ -7,6 +7,7 @@
 #include "tll/channel/base.h"
 #include "tll/util/size.h"
 #include "tll/util/sockaddr.h"
+#include "tll/util/time.h"
 
 #include <array>
 #include <chrono>
@@ -55,6 +56,7 @@ class Socket : public tll::channel::Base<T>
 	unsigned _ttl = 0;
 
 	std::array<long long, 8> _tx_seq;
+	std::array<long long, 8> _tx_time; ///< Post time of packets, used for transmit latency
 	unsigned _tx_idx = 0;
 
 	bool _timestamping = false;
@@ -68,6 +70,78 @@ class Socket : public tll::channel::Base<T>
 	int _mcast_ifindex = 0;
 	std::optional<in_addr> _mcast_ifaddr4; // Only for ipv4 multicast structures, ipv6 use interface index
 
+	unsigned _batch = 1; ///< Maximum number of packets in one recvmmsg/sendmmsg call
+	size_t _size = 0; ///< Size of one packet buffer
+
+#ifdef __linux__
+	std::vector<mmsghdr> _mmsg;
+	std::vector<iovec> _miov;
+	std::vector<tll::network::sockaddr_any> _mpeer;
+#endif
+
+	/// Packet posted with TLL_POST_MORE flag waiting for sendmmsg
+	struct out_packet_t
+	{
+		long long seq;
+		long long time;
+		size_t offset;
+		size_t size;
+		tll::network::sockaddr_any addr;
+	};
+	std::vector<out_packet_t> _out;
+	std::vector<char> _out_buf;
+	size_t _out_size = 0; ///< Used size of output buffer
+
+ public:
+	struct StatType : public Base::StatType
+	{
+		tll::stat::IntegerGroup<tll::stat::Unknown, 'r', 'x', 'b', 'a', 't', 'c', 'h'> rxbatch; ///< Packets per recv syscall
+		tll::stat::IntegerGroup<tll::stat::Unknown, 't', 'x', 'b', 'a', 't', 'c', 'h'> txbatch; ///< Packets per send syscall
+		tll::stat::IntegerGroup<tll::stat::Ns, 'r', 'x', 'l', 'a', 't'> rxlat; ///< Receive timestamp to callback delay
+		tll::stat::IntegerGroup<tll::stat::Ns, 't', 'x', 'l', 'a', 't'> txlat; ///< Post to transmit timestamp delay
+	};
+
+	tll::stat::BlockT<StatType> * stat() { return static_cast<tll::stat::BlockT<StatType> *>(this->internal.stat); }
+
+ protected:
+	void _stat_batch(bool rx, unsigned count)
+	{
+		if (!this->_stat_enable)
+			return;
+		auto page = stat()->acquire();
+		if (!page)
+			return;
+		if (rx)
+			page->rxbatch = count;
+		else
+			page->txbatch = count;
+		stat()->release(page);
+	}
+
+	void _stat_latency(bool rx, long long dt)
+	{
+		if (!this->_stat_enable)
+			return;
+		auto page = stat()->acquire();
+		if (!page)
+			return;
+		if (rx)
+			page->rxlat = dt;
+		else
+			page->txlat = dt;
+		stat()->release(page);
+	}
+
+	/// Store sequence number and post time of sent packet for transmit timestamps
+	void _tx_push(long long seq, long long time)
+	{
+		auto idx = ++_tx_idx % _tx_seq.size();
+		_tx_seq[idx] = seq;
+		_tx_time[idx] = time;
+	}
+
+	long long _tx_now() const { return _timestamping_tx && this->_stat_enable ? tll::time::now().time_since_epoch().count() : 0; }
+
 	int _nametoindex()
 	{
 		if (!_mcast_interface || _mcast_ifindex)
@@ -161,8 +235,11 @@ class Socket : public tll::channel::Base<T>
 		tll_msg_t msg = {};
 		if (_tx_idx - seq > _tx_seq.size())
 			msg.seq = -1;
-		else
+		else {
 			msg.seq = _tx_seq[seq % _tx_seq.size()];
+			if (auto post = _tx_time[seq % _tx_seq.size()]; post)
+				_stat_latency(false, time.count() - post);
+		}
 		msg.type = TLL_MESSAGE_CONTROL;
 		msg.msgid = time_msgid;
 		msg.time = time.count();
@@ -187,6 +264,7 @@ class Socket : public tll::channel::Base<T>
 
 		_timestamping = reader.getT("timestamping", false);
 		_timestamping_tx = reader.getT("timestamping-tx", false);
+		_batch = reader.getT("batch", 1u);
 
 		_multi = reader.getT("multicast", false);
 		if (_multi) {
@@ -196,10 +274,29 @@ class Socket : public tll::channel::Base<T>
 		}
 		if (!reader)
 			return this->_log.fail(EINVAL, "Invalid url: {}", reader.error());
-		_buf.resize(size);
+		if (_batch == 0)
+			return this->_log.fail(EINVAL, "Invalid batch parameter: must be non-zero");
+#ifndef __linux__
+		if (_batch > 1) {
+			this->_log.info("Batch recv and send are supported only on linux");
+			_batch = 1;
+		}
+#endif
+		_size = size;
+		_buf.resize(size * _batch);
+		_out.reserve(_batch);
+		if (_batch > 1)
+			_out_buf.resize(size * _batch);
+#ifdef __linux__
+		if (_batch > 1) {
+			_mmsg.resize(_batch);
+			_miov.resize(_batch);
+			_mpeer.resize(_batch);
+		}
+#endif
 		if (_timestamping) {
 #ifdef __linux__
-			_buf_control.resize(256);
+			_buf_control.resize(256 * _batch);
 			if (_timestamping_tx) {
 				this->_scheme_control.reset(this->context().scheme_load(control_scheme));
 				if (!this->_scheme_control.get())
@@ -220,6 +317,9 @@ class Socket : public tll::channel::Base<T>
 
 		_tx_idx = -1;
 		_tx_seq = {};
+		_tx_time = {};
+		_out.clear();
+		_out_size = 0;
 		if (_timestamping) {
 #ifdef __linux__
 			int v = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE | SOF_TIMESTAMPING_SOFTWARE;
@@ -296,6 +396,14 @@ class Socket : public tll::channel::Base<T>
 
 	int _process(long timeout, int flags)
 	{
+		if (_out.size()) {
+			if (auto r = _flush(); r && r != EAGAIN)
+				return r;
+		}
+#ifdef __linux__
+		if (_batch > 1)
+			return _process_batch();
+#endif
 		iovec iov = {_buf.data(), _buf.size()};
 		msghdr mhdr = {};
 		mhdr.msg_name = _peer.buf;
@@ -317,14 +425,171 @@ class Socket : public tll::channel::Base<T>
 		msg.size = r;
 		msg.data = _buf.data();
 
-		if (_timestamping)
+		if (_timestamping) {
 			msg.time = _cmsg_timestamp(&mhdr).count();
+			if (this->_stat_enable)
+				_stat_latency(true, tll::time::now().time_since_epoch().count() - msg.time);
+		}
 
+		_stat_batch(true, 1);
 		return this->channelT()->_on_data(_peer, msg);
 	}
 
-	int _sendv(long long seq, const iovec *iov, size_t iovlen, const tll::network::sockaddr_any &addr)
+#ifdef __linux__
+	/// Receive up to batch packets with one recvmmsg call and deliver them one by one
+	int _process_batch()
 	{
+		const auto control = _buf_control.size() / _batch;
+		for (auto i = 0u; i < _batch; i++) {
+			auto & m = _mmsg[i];
+			_miov[i] = {_buf.data() + i * _size, _size};
+			m.msg_hdr = {};
+			m.msg_hdr.msg_name = _mpeer[i].buf;
+			m.msg_hdr.msg_namelen = sizeof(_mpeer[i].buf);
+			m.msg_hdr.msg_iov = &_miov[i];
+			m.msg_hdr.msg_iovlen = 1;
+			if (control) {
+				m.msg_hdr.msg_control = _buf_control.data() + i * control;
+				m.msg_hdr.msg_controllen = control;
+			}
+			m.msg_len = 0;
+		}
+
+		auto r = recvmmsg(this->fd(), _mmsg.data(), _batch, MSG_DONTWAIT, nullptr);
+		if (r < 0) {
+			if (errno == EAGAIN)
+				return _process_errqueue();
+			return this->_log.fail(EINVAL, "Failed to receive data: {}", strerror(errno));
+		}
+		this->_log.trace("Got {} packets", r);
+		_stat_batch(true, r);
+
+		for (auto i = 0; i < r; i++) {
+			auto & m = _mmsg[i];
+			_peer = _mpeer[i];
+			_peer.size = m.msg_hdr.msg_namelen;
+
+			tll_msg_t msg = { TLL_MESSAGE_DATA };
+			msg.size = m.msg_len;
+			msg.data = _miov[i].iov_base;
+			if (_timestamping) {
+				msg.time = _cmsg_timestamp(&m.msg_hdr).count();
+				if (this->_stat_enable)
+					_stat_latency(true, tll::time::now().time_since_epoch().count() - msg.time);
+			}
+
+			if (auto e = this->channelT()->_on_data(_peer, msg); e)
+				return e;
+			if (this->state() != tll::state::Active) // Closed from callback, drop rest of packets
+				return 0;
+		}
+		return 0;
+	}
+#endif
+
+	/// Store packet until sendmmsg call
+	int _store(long long seq, const iovec *iov, size_t iovlen, const tll::network::sockaddr_any &addr)
+	{
+		size_t size = 0;
+		for (auto i = 0u; i < iovlen; i++)
+			size += iov[i].iov_len;
+		if (size > _size)
+			return this->_log.fail(EMSGSIZE, "Message size {} is too large, buffer size {}", size, _size);
+		if (_out.size() == _batch)
+			return EAGAIN;
+		out_packet_t p = { seq, _tx_now(), _out_size, size, addr };
+		for (auto i = 0u; i < iovlen; i++) {
+			memcpy(_out_buf.data() + _out_size, iov[i].iov_base, iov[i].iov_len);
+			_out_size += iov[i].iov_len;
+		}
+		_out.push_back(p);
+		if (_out.size() == 1)
+			this->_update_dcaps(dcaps::Process | dcaps::Pending); // Flush on next process call
+		return 0;
+	}
+
+	/// Send stored packets, unsent ones are kept in the buffer
+	int _flush()
+	{
+#ifdef __linux__
+		for (auto i = 0u; i < _out.size(); i++) {
+			auto & p = _out[i];
+			auto & m = _mmsg[i];
+			_miov[i] = {_out_buf.data() + p.offset, p.size};
+			m.msg_hdr = {};
+			m.msg_hdr.msg_name = p.addr.buf;
+			m.msg_hdr.msg_namelen = p.addr.size;
+			m.msg_hdr.msg_iov = &_miov[i];
+			m.msg_hdr.msg_iovlen = 1;
+		}
+
+		auto r = sendmmsg(this->fd(), _mmsg.data(), _out.size(), MSG_NOSIGNAL);
+		if (r < 0) {
+			if (errno == EAGAIN)
+				return EAGAIN;
+			_out.clear();
+			_out_size = 0;
+			_update_pending();
+			return this->_log.fail(errno, "Failed to post data: {}", strerror(errno));
+		}
+		this->_log.trace("Sent {} of {} packets", r, _out.size());
+		_stat_batch(false, r);
+		for (auto i = 0; i < r; i++)
+			_tx_push(_out[i].seq, _out[i].time);
+
+		if ((size_t) r < _out.size()) { // Move unsent packets to the beginning
+			auto offset = _out[r].offset;
+			_out.erase(_out.begin(), _out.begin() + r);
+			for (auto & p : _out)
+				p.offset -= offset;
+			_out_size -= offset;
+			memmove(_out_buf.data(), _out_buf.data() + offset, _out_size);
+		} else {
+			_out.clear();
+			_out_size = 0;
+		}
+		_update_pending();
+		for (auto i = 0; i < r; i++) {
+			if (auto e = _process_errqueue(); e) {
+				if (e == EAGAIN)
+					break;
+				return e;
+			}
+		}
+		return _out.size() ? EAGAIN : 0;
+#else
+		return 0;
+#endif
+	}
+
+	void _update_pending()
+	{
+		if (_out.size())
+			return;
+		if ((this->internal.caps & caps::InOut) != caps::Output)
+			this->_update_dcaps(0, dcaps::Pending);
+		else
+			this->_update_dcaps(0, dcaps::Process | dcaps::Pending);
+	}
+
+	int _sendv(long long seq, const iovec *iov, size_t iovlen, const tll::network::sockaddr_any &addr, int flags = 0)
+	{
+		if (_batch > 1 && ((flags & TLL_POST_MORE) || _out.size())) {
+			if (auto r = _store(seq, iov, iovlen, addr); r) {
+				if (r != EAGAIN)
+					return r;
+				if (auto f = _flush(); f && f != EAGAIN) // Batch is full, send it and retry
+					return f;
+				if (auto r = _store(seq, iov, iovlen, addr); r)
+					return r;
+			}
+			if (!(flags & TLL_POST_MORE) || _out.size() == _batch) {
+				if (auto r = _flush(); r && r != EAGAIN)
+					return r;
+			}
+			return 0;
+		}
+
 		size_t size = 0;
 		for (auto i = 0u; i < iovlen; i++)
 			size += iov[i].iov_len;
@@ -335,7 +600,7 @@ class Socket : public tll::channel::Base<T>
 		m.msg_namelen = addr.size;
 		m.msg_iov = (iovec *) iov;
 		m.msg_iovlen = iovlen;
-		_tx_seq[++_tx_idx % _tx_seq.size()] = seq;
+		_tx_push(seq, _tx_now());
 
 		auto r = sendmsg(this->fd(), &m, MSG_NOSIGNAL);
 		if (r < 0) {
@@ -344,6 +609,7 @@ class Socket : public tll::channel::Base<T>
 			return this->_log.fail(errno, "Failed to post data: {}", strerror(errno));
 		} else if ((size_t) r != size)
 			return this->_log.fail(errno, "Failed to post data (truncated): {}", strerror(errno));
+		_stat_batch(false, 1);
 		r = _process_errqueue();
 		if (r == EAGAIN)
 			return 0;
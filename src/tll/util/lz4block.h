@@ -5,37 +5,55 @@
 #define _TLL_UTIL_LZ4BLOCK_H
 
 #include <cerrno>
+#include <cstdio>
+#include <cstring>
 #include <memory>
 #include <optional>
+#include <string>
 #include <vector>
 
 #include "tll/util/memoryview.h"
 
 #include <lz4.h>
+#include <lz4hc.h>
 
 namespace tll::lz4 {
 
 struct lz4_stream_delete { void operator () (LZ4_stream_t *ptr) const { LZ4_freeStream(ptr); } };
 struct lz4_stream_decode_delete { void operator () (LZ4_streamDecode_t *ptr) const { LZ4_freeStreamDecode(ptr); } };
+struct lz4_stream_hc_delete { void operator () (LZ4_streamHC_t *ptr) const { LZ4_freeStreamHC(ptr); } };
 
 struct Ring
 {
 	static constexpr size_t prefix_size = 64 * 1024; // LZ4 prefix size
 
 	std::vector<char> ring;
+	std::vector<char> dict; ///< Preset dictionary, placed in the beginning of the ring on reset
 	size_t block = 0;
 	size_t offset = 0;
 
-	int init(size_t block)
+	int init(size_t block, tll::const_memory dict = {})
 	{
 		this->block = block;
+		if (dict.size > prefix_size) { // Only last 64kb are used by LZ4
+			dict.data = static_cast<const char *>(dict.data) + dict.size - prefix_size;
+			dict.size = prefix_size;
+		}
+		this->dict.assign(static_cast<const char *>(dict.data), static_cast<const char *>(dict.data) + dict.size);
 		offset = 0;
 		ring.resize(0);
 		ring.resize(std::max((size_t) LZ4_decoderRingBufferSize(block), 2 * block + prefix_size));
+		reset();
 		return 0;
 	}
 
-	void reset() { offset = 0; }
+	/// Reset ring, new data follows dictionary so it is used as stream prefix
+	void reset()
+	{
+		offset = dict.size();
+		if (offset)
+			memcpy(ring.data(), dict.data(), offset);
+	}
 
 	void shift(size_t size)
 	{
@@ -53,28 +71,55 @@ struct StreamEncode
 	Ring ring;
 
 	std::unique_ptr<LZ4_stream_t, lz4_stream_delete> stream;
+	std::unique_ptr<LZ4_streamHC_t, lz4_stream_hc_delete> stream_hc;
+	int hc_level = 0; ///< Use high compression mode with this level if non-zero
 
-	int init(size_t block)
+	int init(size_t block, tll::const_memory dict = {}, int hc_level = 0)
 	{
-		stream.reset(LZ4_createStream());
-		if (stream == nullptr)
-			return ENOMEM;
-		return ring.init(block);
+		this->hc_level = hc_level;
+		stream.reset();
+		stream_hc.reset();
+		if (hc_level) {
+			stream_hc.reset(LZ4_createStreamHC());
+			if (stream_hc == nullptr)
+				return ENOMEM;
+		} else {
+			stream.reset(LZ4_createStream());
+			if (stream == nullptr)
+				return ENOMEM;
+		}
+		if (auto r = ring.init(block, dict); r)
+			return r;
+		reset();
+		return 0;
 	}
 
 	void reset()
 	{
 		ring.reset();
+		if (hc_level) {
+			LZ4_resetStreamHC_fast(stream_hc.get(), hc_level);
+			if (ring.dict.size())
+				LZ4_loadDictHC(stream_hc.get(), ring.ring.data(), ring.dict.size());
+			return;
+		}
 		LZ4_resetStream_fast(stream.get());
+		if (ring.dict.size())
+			LZ4_loadDict(stream.get(), ring.ring.data(), ring.dict.size());
 	}
 
+	/// Compress data from ring view, level is acceleration in fast mode and is ignored in high compression mode
 	template <typename Buf>
 	tll::const_memory compress(Buf &result, size_t size, int level)
 	{
 		auto view = ring.view();
 		ring.shift(size);
-		auto r = LZ4_compress_fast_continue(stream.get(), view.dataT<char>(), result.data(), size, result.size(), level);
-		if (r < 0)
+		int r = 0;
+		if (hc_level)
+			r = LZ4_compress_HC_continue(stream_hc.get(), view.dataT<char>(), result.data(), size, result.size());
+		else
+			r = LZ4_compress_fast_continue(stream.get(), view.dataT<char>(), result.data(), size, result.size(), level);
+		if (r <= 0)
 			return { nullptr, 0 };
 		return tll::const_memory { result.data(), (size_t) r };
 	}
@@ -88,18 +133,21 @@ struct StreamDecode
 
 	std::unique_ptr<LZ4_streamDecode_t, lz4_stream_decode_delete> stream;
 
-	int init(size_t block)
+	int init(size_t block, tll::const_memory dict = {})
 	{
 		stream.reset(LZ4_createStreamDecode());
 		if (stream == nullptr)
 			return ENOMEM;
-		return ring.init(block);
+		if (auto r = ring.init(block, dict); r)
+			return r;
+		reset();
+		return 0;
 	}
 
 	void reset()
 	{
 		ring.reset();
-		if (stream) LZ4_setStreamDecode(stream.get(), nullptr, 0);
+		if (stream) LZ4_setStreamDecode(stream.get(), ring.ring.data(), ring.dict.size());
 	}
 
 	tll::const_memory decompress(const void * data, size_t size)
@@ -113,6 +161,27 @@ struct StreamDecode
 	}
 };
 
+/**
+ * Load preset dictionary from file, dictionary is stored as is, without any headers.
+ *
+ * @return 0 on success, errno value otherwise.
+ */
+inline int load_dictionary(const std::string &filename, std::vector<char> &dict)
+{
+	auto fp = fopen(filename.c_str(), "r");
+	if (!fp)
+		return errno;
+	std::unique_ptr<FILE, int (*)(FILE *)> _fp = { fp, fclose };
+
+	dict.clear();
+	char buf[4096];
+	while (auto r = fread(buf, 1, sizeof(buf), fp))
+		dict.insert(dict.end(), buf, buf + r);
+	if (ferror(fp))
+		return EIO;
+	return 0;
+}
+
 } // namespace tll::util
 
 #endif//_TLL_UTIL_LZ4BLOCK_H